@@ -5,9 +5,11 @@
 
 #define _XOPEN_SOURCE 500
 #define _POSIX_C_SOURCE 200112L
+#define _GNU_SOURCE
 
 #include <unistd.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
@@ -15,9 +17,19 @@
 #include <sys/types.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
 
 #include "rl_lock_library.h"
 
@@ -26,24 +38,544 @@
  */
 static rl_all_files rla;
 
+/**
+ * @brief The flag of the files opened with `rl_open_private()`, beyond the
+ * `RL_ATTR_*` flags
+ */
+#define RL_PRIVATE_FILE 0x10000
+
+/**
+ * @brief The flag of the files held by the arena of huge pages
+ */
+#define RL_ARENA_FILE 0x20000
+
+/**
+ * @brief The arena of huge pages mapped by this process, NULL if it is not
+ * mapped yet
+ */
+static rl_arena *arena = NULL;
+
+/**
+ * @brief The shared pool of overflow chunks mapped by this process, NULL if it
+ * is not mapped yet
+ */
+static rl_chunk_pool *chunk_pool = NULL;
+
 /******************************************************************************/
 
 /**
- * @brief Initializes `pmutex` for process sync
- * @param pmutex the mutex to initialize
- * @return 0 if the initialization was successfull, the error code otherwise
+ * @brief The value of the wait word of a queue node whose owner got the lock
+ */
+#define RL_MCS_GRANTED 0
+
+/**
+ * @brief The value of the wait word of a queue node whose owner spins
+ */
+#define RL_MCS_SPINNING 1
+
+/**
+ * @brief The value of the wait word of a queue node whose owner is parked on
+ * its futex
+ */
+#define RL_MCS_PARKED 2
+
+/**
+ * @brief The value of the wait word of a queue node whose owner took the lock
+ * over from a dead process
+ */
+#define RL_MCS_TAKEN_OVER 3
+
+/**
+ * @brief The number of times a waiter checks its wait word before parking
+ */
+#define RL_MCS_SPIN 2000
+
+/**
+ * @brief The duration in ns after which a parked waiter checks if the process
+ * before it in the queue has died
+ */
+#define RL_MCS_PROBE_NS 10000000
+
+/**
+ * @brief The duration in ns for which a process waits for a free queue node
+ */
+#define RL_MCS_CLAIM_NS 1000000000LL
+
+/**
+ * @brief The maximal number of times in a row the lock on a file created with
+ * `RL_ATTR_COHORT` is handed over inside a cohort
+ */
+#define RL_COHORT_BATCH 64
+
+/**
+ * @brief Waits on the futex `addr` while it contains `val`
+ * @param addr the futex word, in shared memory
+ * @param val the value the futex word must contain for the call to wait
+ * @param timeout the maximal duration of the wait, NULL for no limit
+ * @return 0 when woken up, -1 on error, with errno set to EAGAIN if `addr`
+ *         didn't contain `val`, ETIMEDOUT if `timeout` expired or EINTR if a
+ *         signal interrupted the wait
+ */
+static int futex_wait(atomic_int *addr, int val,
+        const struct timespec *timeout) {
+    return syscall(SYS_futex, (int *) addr, FUTEX_WAIT, val, timeout, NULL,
+            0);
+}
+
+/**
+ * @brief Wakes up at most `nb` processes waiting on the futex `addr`
+ * @param addr the futex word, in shared memory
+ * @param nb the maximal number of processes to wake up
+ */
+static void futex_wake(atomic_int *addr, int nb) {
+    syscall(SYS_futex, (int *) addr, FUTEX_WAKE, nb, NULL, NULL, 0);
+}
+
+static long long get_time_ns();
+
+/**
+ * @brief Claims a free queue node among `nodes` for the calling process
+ *
+ * The search starts at a node given by the PID so that a process tends to
+ * reuse the same node. If all the nodes are used, this function yields the
+ * processor until one is released, for at most `RL_MCS_CLAIM_NS` ns: the
+ * nodes of dead processes are only freed once their successors take the lock
+ * over.
+ *
+ * @param nodes the queue nodes of the lock
+ * @param nb_nodes the number of nodes in `nodes`
+ * @return the index of the claimed node, -1 with errno set to ENOLCK if no
+ *         node was released in time
+ */
+static int claim_mcs_node(rl_mcs_node *nodes, int nb_nodes) {
+    pid_t pid = getpid();
+    int first = (unsigned int) pid % nb_nodes;
+    long long deadline = -1;
+    for (;;) {
+        for (int n = 0; n < nb_nodes; n++) {
+            atomic_int *owner = &nodes[(first + n) % nb_nodes].owner;
+            int expected = 0;
+            if (atomic_load(owner) == 0
+                    && atomic_compare_exchange_strong(owner, &expected, pid))
+                return (first + n) % nb_nodes;
+        }
+        if (deadline == -1) {
+            deadline = get_time_ns() + RL_MCS_CLAIM_NS;
+        } else if (get_time_ns() >= deadline) {
+            errno = ENOLCK;
+            return -1;
+        }
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Checks if the owner of `node` died while holding the lock
+ *
+ * A node holds the lock from the moment its wait word is granted, so this also
+ * detects a waiter that died before its predecessor handed the lock over. A
+ * node queued without predecessor holds it as soon as it takes the tail.
+ *
+ * @param node the queue node to check, in the queue
+ * @return 1 if the owner of `node` holds the lock and has died, 0 otherwise
+ */
+static int is_mcs_holder_dead(rl_mcs_node *node) {
+    pid_t pid = atomic_load(&node->owner);
+    int wait = atomic_load(&node->wait);
+    if (pid == 0 || (wait != RL_MCS_GRANTED && wait != RL_MCS_TAKEN_OVER
+                && atomic_load(&node->prev) != 0))
+        return 0;
+    return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+/**
+ * @brief Takes the lock over from the dead owner of `prev`, if it holds it
+ *
+ * If the owner of `prev` died while waiting, its own predecessor is checked in
+ * turn, and so on: the lock is taken over once the dead waiters lead to a dead
+ * holder. A live process among them hands the lock over itself.
+ *
+ * Only the successor of a node refers to it, so the waiter frees all the
+ * nodes it passes. A dead process can't write them anymore.
+ *
+ * @param nodes the queue nodes of the lock
+ * @param nb_nodes the number of nodes in `nodes`
+ * @param node the queue node of the waiter
+ * @param prev the queue node of the predecessor of the waiter
+ * @return 1 if the lock was taken over, 0 otherwise
+ */
+static int take_mcs_over(rl_mcs_node *nodes, int nb_nodes, rl_mcs_node *node,
+        rl_mcs_node *prev) {
+    rl_mcs_node *dead = prev;
+    for (int n = 0; !is_mcs_holder_dead(dead); n++) {
+        pid_t pid = atomic_load(&dead->owner);
+        if (n == nb_nodes || pid == 0 || kill(pid, 0) == 0 || errno != ESRCH)
+            return 0;
+        /* a waiter that died before the lock was handed over to it */
+        dead = &nodes[atomic_load(&dead->prev) - 1];
+    }
+
+    int expected = RL_MCS_PARKED;
+    /* the lock may have been handed over just before the death */
+    atomic_compare_exchange_strong(&node->wait, &expected, RL_MCS_TAKEN_OVER);
+    for (rl_mcs_node *cur = prev; cur != dead;) {
+        rl_mcs_node *before = &nodes[atomic_load(&cur->prev) - 1];
+        atomic_store(&cur->owner, 0);
+        cur = before;
+    }
+    atomic_store(&dead->owner, 0);
+    return 1;
+}
+
+/**
+ * @brief Waits until the lock is handed over to the owner of `node`
+ *
+ * The owner spins on its own wait word for a while, then parks on it. It wakes
+ * up every `RL_MCS_PROBE_NS` ns to check if the owner of `prev` died with the
+ * lock, in which case it takes it over.
+ *
+ * @param nodes the queue nodes of the lock
+ * @param nb_nodes the number of nodes in `nodes`
+ * @param node the queue node of the waiter
+ * @param prev the queue node of the predecessor of the waiter
+ */
+static void wait_mcs_turn(rl_mcs_node *nodes, int nb_nodes, rl_mcs_node *node,
+        rl_mcs_node *prev) {
+    for (int i = 0; i < RL_MCS_SPIN; i++) {
+        if (atomic_load(&node->wait) == RL_MCS_GRANTED)
+            return;
+    }
+
+    int expected = RL_MCS_SPINNING;
+    if (!atomic_compare_exchange_strong(&node->wait, &expected,
+                RL_MCS_PARKED))
+        return; /* granted meanwhile */
+    struct timespec probe = {0, RL_MCS_PROBE_NS};
+    while (atomic_load(&node->wait) == RL_MCS_PARKED) {
+        if (futex_wait(&node->wait, RL_MCS_PARKED, &probe) == -1
+                && errno == ETIMEDOUT
+                && take_mcs_over(nodes, nb_nodes, node, prev))
+            return;
+    }
+}
+
+/**
+ * @brief Takes the MCS queue lock whose queue ends at `tail`
+ *
+ * The caller appends a queue node to the tail of the queue, then waits on its
+ * own node until its predecessor hands the lock over, or dies with it. The
+ * predecessor is recorded in the node before it becomes the tail, so that the
+ * queue can be followed even if the caller dies before linking itself.
+ *
+ * @param tail the tail of the queue of the lock
+ * @param nodes the queue nodes of the lock
+ * @param nb_nodes the number of nodes in `nodes`
+ * @return the index of the node of the caller, to be given back to
+ *         `release_mcs()`, -1 with errno set to ENOLCK if no node is free. The
+ *         wait word of the node is `RL_MCS_TAKEN_OVER` if the lock was taken
+ *         over from a dead process.
+ */
+static int acquire_mcs(atomic_int *tail, rl_mcs_node *nodes, int nb_nodes) {
+    int me = claim_mcs_node(nodes, nb_nodes);
+    if (me == -1)
+        return -1;
+    rl_mcs_node *node = &nodes[me];
+    atomic_store(&node->next, 0);
+    atomic_store(&node->wait, RL_MCS_SPINNING);
+
+    int prev = atomic_load(tail);
+    do {
+        atomic_store(&node->prev, prev);
+    } while (!atomic_compare_exchange_weak(tail, &prev, me + 1));
+    if (prev != 0) {
+        atomic_store(&nodes[prev - 1].next, me + 1);
+        wait_mcs_turn(nodes, nb_nodes, node, &nodes[prev - 1]);
+    } else {
+        atomic_store(&node->wait, RL_MCS_GRANTED);
+    }
+    return me;
+}
+
+/**
+ * @brief Takes the MCS queue lock whose queue ends at `tail` if it is free
+ * @param tail the tail of the queue of the lock
+ * @param nodes the queue nodes of the lock
+ * @param nb_nodes the number of nodes in `nodes`
+ * @return the index of the node of the caller, -1 if the lock is held
+ */
+static int try_acquire_mcs(atomic_int *tail, rl_mcs_node *nodes,
+        int nb_nodes) {
+    int last = atomic_load(tail);
+    if (last != 0) {
+        /* a dead holder without successor is unlinked */
+        rl_mcs_node *holder = &nodes[last - 1];
+        if (atomic_load(&holder->next) != 0 || !is_mcs_holder_dead(holder)
+                || !atomic_compare_exchange_strong(tail, &last, 0))
+            return -1;
+        atomic_store(&holder->owner, 0);
+    }
+
+    int me = claim_mcs_node(nodes, nb_nodes);
+    if (me == -1)
+        return -1;
+    atomic_store(&nodes[me].next, 0);
+    atomic_store(&nodes[me].prev, 0);
+    atomic_store(&nodes[me].wait, RL_MCS_GRANTED);
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(tail, &expected, me + 1)) {
+        atomic_store(&nodes[me].owner, 0);
+        return -1;
+    }
+    return me;
+}
+
+/**
+ * @brief Checks if a process waits for the MCS queue lock held with the node
+ * `me`
+ * @param tail the tail of the queue of the lock
+ * @param nodes the queue nodes of the lock
+ * @param me the index of the node of the holder
+ * @return 1 if there is a waiter, 0 otherwise
+ */
+static int has_mcs_waiter(atomic_int *tail, rl_mcs_node *nodes, int me) {
+    return atomic_load(&nodes[me].next) != 0 || atomic_load(tail) != me + 1;
+}
+
+/**
+ * @brief Waits until the successor of the node `me` links itself to it
+ *
+ * The successor has taken the tail already. If it is not linked after a while,
+ * it is found by following the recorded predecessors from the tail: if its
+ * owner died before linking itself, it is returned all the same, so that the
+ * lock is handed over to it and its own successor takes it over.
+ *
+ * @param tail the tail of the queue of the lock
+ * @param nodes the queue nodes of the lock
+ * @param nb_nodes the number of nodes in `nodes`
+ * @param me the index of the node of the holder
+ * @return the index + 1 of the successor
+ */
+static int wait_mcs_link(atomic_int *tail, rl_mcs_node *nodes, int nb_nodes,
+        int me) {
+    for (int i = 1;; i++) {
+        int next = atomic_load(&nodes[me].next);
+        if (next != 0)
+            return next;
+        if (i % RL_MCS_SPIN != 0)
+            continue;
+
+        /* the holder is the head, so none of its waiters is taken over */
+        int cur = atomic_load(tail);
+        for (int n = 0; cur != 0 && cur != me + 1 && n < nb_nodes; n++) {
+            int prev = atomic_load(&nodes[cur - 1].prev);
+            if (prev == me + 1) {
+                pid_t pid = atomic_load(&nodes[cur - 1].owner);
+                if (kill(pid, 0) == -1 && errno == ESRCH)
+                    return cur;
+                break;
+            }
+            cur = prev;
+        }
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Hands the MCS queue lock held with the node `me` over to the next
+ * waiter, or frees it if there is none
+ * @param tail the tail of the queue of the lock
+ * @param nodes the queue nodes of the lock
+ * @param nb_nodes the number of nodes in `nodes`
+ * @param me the index of the node of the holder
+ */
+static void release_mcs(atomic_int *tail, rl_mcs_node *nodes, int nb_nodes,
+        int me) {
+    rl_mcs_node *node = &nodes[me];
+    int next = atomic_load(&node->next);
+    if (next == 0) {
+        int expected = me + 1;
+        if (atomic_compare_exchange_strong(tail, &expected, 0)) {
+            atomic_store(&node->owner, 0);
+            return;
+        }
+        /* a waiter has taken the tail but is not linked yet */
+        next = wait_mcs_link(tail, nodes, nb_nodes, me);
+    }
+
+    rl_mcs_node *succ = &nodes[next - 1];
+    if (atomic_exchange(&succ->wait, RL_MCS_GRANTED) == RL_MCS_PARKED)
+        futex_wake(&succ->wait, 1);
+    atomic_store(&node->owner, 0);
+}
+
+/**
+ * @brief Gets the NUMA node the calling process is running on
+ * @return the NUMA node, 0 if it is unknown
+ */
+static int get_numa_node(void) {
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == -1)
+        return 0;
+    return node;
+}
+
+/**
+ * @brief Rounds `size` up to a multiple of the page size
+ * @param size the size to round
+ * @return the rounded size
+ */
+static size_t round_to_page(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+/**
+ * @brief Gets the cohort `c` of a file created with `RL_ATTR_COHORT`
+ * @param file the open file
+ * @param c the index of the cohort
+ * @return the cohort
+ */
+static rl_cohort *get_cohort(rl_open_file *file, int c) {
+    return (rl_cohort *) ((char *) file + file->cohorts_offset
+            + c * round_to_page(sizeof(rl_cohort)));
+}
+
+/**
+ * @brief Asks the kernel to place the page of each cohort of `file` on the
+ * NUMA node of the same index
+ *
+ * This must be done before the pages are touched. Failures are ignored: the
+ * cohorts of nodes which don't exist stay wherever the kernel puts them.
+ *
+ * @param file the open file created with `RL_ATTR_COHORT`
+ */
+static void bind_cohorts(rl_open_file *file) {
+    for (int c = 0; c < RL_MAX_COHORTS; c++) {
+        unsigned long mask = 1UL << c;
+        syscall(SYS_mbind, get_cohort(file, c),
+                round_to_page(sizeof(rl_cohort)), MPOL_PREFERRED, &mask,
+                sizeof(mask) * 8, 0);
+    }
+}
+
+/**
+ * @brief Gets the PID map of `file`
+ * @param file the open file
+ * @return the first entry of the map
+ */
+static rl_pid_fd_count *get_pid_map(const rl_open_file *file) {
+    return (rl_pid_fd_count *) ((char *) file + file->pid_map_offset);
+}
+
+/**
+ * @brief Gets the queue nodes of the exclusive lock on `file`
+ * @param file the open file
+ * @return the first node
+ */
+static rl_mcs_node *get_mcs_nodes(const rl_open_file *file) {
+    return (rl_mcs_node *) ((char *) file + file->mcs_nodes_offset);
+}
+
+/**
+ * @brief Gets the biased slots of a file created with
+ * `RL_ATTR_READER_BIAS`
+ * @param file the open file
+ * @return the first slot
+ */
+static rl_fast_slot *get_bias_slots(const rl_open_file *file) {
+    return (rl_fast_slot *) ((char *) file + file->bias_slots_offset);
+}
+
+/**
+ * @brief Gets the number of biased slots of `file`
+ * @param file the open file
+ * @return `RL_BIAS_SLOTS` with `RL_ATTR_READER_BIAS`, 0 otherwise
+ */
+static int get_nb_bias_slots(const rl_open_file *file) {
+    return file->flags & RL_ATTR_READER_BIAS ? RL_BIAS_SLOTS : 0;
+}
+
+/**
+ * @brief Gets the request slots of a file created with
+ * `RL_ATTR_COMBINING`
+ * @param file the open file
+ * @return the first slot
  */
-static int initialize_mutex(pthread_mutex_t *pmutex) {
-    pthread_mutexattr_t mutexattr;
-    int code;
+static rl_request_slot *get_requests(const rl_open_file *file) {
+    return (rl_request_slot *) ((char *) file + file->requests_offset);
+}
+
+/**
+ * @brief Gets the reader registry of a file created with
+ * `RL_ATTR_COUNTED_READERS`
+ * @param file the open file
+ * @return the first entry of the registry
+ */
+static rl_owner *get_readers(const rl_open_file *file) {
+    return (rl_owner *) ((char *) file + file->readers_offset);
+}
+
+/**
+ * @brief Gets the holders of file-level modes of a file created with
+ * `RL_ATTR_INTENTS`
+ * @param file the open file
+ * @return the first holder
+ */
+static rl_intent *get_intents(const rl_open_file *file) {
+    return (rl_intent *) ((char *) file + file->intents_offset);
+}
+
+/**
+ * @brief Gets the leases of the owners of a file with leases
+ * @param file the open file
+ * @return the first lease
+ */
+static rl_lease *get_leases(const rl_open_file *file) {
+    return (rl_lease *) ((char *) file + file->leases_offset);
+}
+
+/**
+ * @brief Gets the asynchronous requests of `file`
+ * @param file the open file
+ * @return the first request
+ */
+static rl_pending_request *get_pending(const rl_open_file *file) {
+    return (rl_pending_request *) ((char *) file + file->pending_offset);
+}
+
+/**
+ * @brief Gets the reserved ranges of `file`
+ * @param file the open file
+ * @return the first range
+ */
+static rl_append_slot *get_appends(const rl_open_file *file) {
+    return (rl_append_slot *) ((char *) file + file->appends_offset);
+}
+
+/**
+ * @brief Gets the lock groups of `file`
+ * @param file the open file
+ * @return the first group
+ */
+static rl_group *get_groups(const rl_open_file *file) {
+    return (rl_group *) ((char *) file + file->groups_offset);
+}
 
-    code = pthread_mutexattr_init(&mutexattr);
-    if (code != 0)
-        return code;
-    code = pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
-    if(code != 0)
-        return code;
-    return pthread_mutex_init(pmutex, &mutexattr);
+/**
+ * @brief Gets the reader map of `lck`, a lock of a file created with
+ * `RL_ATTR_COUNTED_READERS`
+ *
+ * The map is kept at the index of `lck` in the lock table, so it moves with
+ * the lock.
+ *
+ * @param file the open file
+ * @param lck the lock of `file->lock_table`
+ * @return the `RL_MAX_READERS / 64` words of the map
+ */
+static unsigned long long *get_reader_map(const rl_open_file *file,
+        const rl_lock *lck) {
+    return (unsigned long long *) ((char *) file + file->reader_maps_offset)
+        + (lck - file->lock_table) * (RL_MAX_READERS / 64);
 }
 
 /******************************************************************************/
@@ -78,15 +610,15 @@ static void erase_map_entry(rl_pid_fd_count *map_entry) {
  */
 static int organize_map_entries(rl_open_file *file) {
     for (int i = 0; i < file->nb_map_entries; i++) {
-        if (is_map_entry_free(&file->pid_map[i])) {
+        if (is_map_entry_free(&get_pid_map(file)[i])) {
             int j = i + 1;
             while (j < RL_MAX_MAP_ENTRIES
-                    && is_map_entry_free(&file->pid_map[j]))
+                    && is_map_entry_free(&get_pid_map(file)[j]))
                 j++;
             if (j >= RL_MAX_MAP_ENTRIES)
                 return -1;
-            file->pid_map[i] = file->pid_map[j];
-            erase_map_entry(&file->pid_map[j]);
+            get_pid_map(file)[i] = get_pid_map(file)[j];
+            erase_map_entry(&get_pid_map(file)[j]);
         }
     }
     return 0;
@@ -105,15 +637,15 @@ static int organize_map_entries(rl_open_file *file) {
 static int map_increment(rl_open_file *file, pid_t pid) {
     rl_pid_fd_count *entry = NULL;
     for (int i = 0; i < file->nb_map_entries; i++)
-        if (file->pid_map[i].pid == pid)
-            entry = &file->pid_map[i];
+        if (get_pid_map(file)[i].pid == pid)
+            entry = &get_pid_map(file)[i];
     
     if (entry == NULL) {
         if (file->nb_map_entries >= RL_MAX_MAP_ENTRIES)
             return -1;
         
-        file->pid_map[file->nb_map_entries].pid = pid;
-        file->pid_map[file->nb_map_entries].fd_count = 1;
+        get_pid_map(file)[file->nb_map_entries].pid = pid;
+        get_pid_map(file)[file->nb_map_entries].fd_count = 1;
         file->nb_map_entries++;
     } else
         entry->fd_count++;
@@ -134,8 +666,8 @@ static int map_increment(rl_open_file *file, pid_t pid) {
 static int map_decrement(rl_open_file *file, pid_t pid) {
     rl_pid_fd_count *entry = NULL;
     for (int i = 0; i < file->nb_map_entries; i++)
-        if (file->pid_map[i].pid == pid)
-            entry = &file->pid_map[i];
+        if (get_pid_map(file)[i].pid == pid)
+            entry = &get_pid_map(file)[i];
 
     if (entry == NULL)
         return -1;
@@ -175,32 +707,128 @@ static void erase_owner(rl_owner *owner) {
     }
 }
 
+/**
+ * @brief Gets the overflow chunk `c` of `file`
+ *
+ * The chunk is in the shared pool, mapped by `lock_open_file()`, or in the
+ * memory of a private lock space.
+ *
+ * @param file the open file
+ * @param c the index of the chunk
+ * @return the chunk
+ */
+static rl_owner_chunk *get_chunk(const rl_open_file *file, int c) {
+    if (file->chunks_offset != 0)
+        return (rl_owner_chunk *) ((char *) file + file->chunks_offset) + c;
+    return (rl_owner_chunk *) ((char *) chunk_pool
+            + chunk_pool->chunks_offset) + c;
+}
+
+/**
+ * @brief Gets the number of owners `lck` can store without taking another
+ * overflow chunk
+ * @param lck the lock
+ * @return the capacity of `lck`
+ */
+static int get_owner_capacity(const rl_lock *lck) {
+    return lck->overflow != 0 ? RL_MAX_OWNERS : RL_INLINE_OWNERS;
+}
+
+/**
+ * @brief Gets the owner `k` of `lck`
+ * @param file the file that contains `lck`
+ * @param lck the lock
+ * @param k the index of the owner, lower than the capacity of `lck`
+ * @return the owner `k`, inline or in the overflow chunk of `lck`
+ */
+static rl_owner *get_lock_owner(const rl_open_file *file, const rl_lock *lck,
+        int k) {
+    if (k < RL_INLINE_OWNERS)
+        return (rl_owner *) &lck->lock_owners[k];
+    return &get_chunk(file, lck->overflow - 1)->owners[k - RL_INLINE_OWNERS];
+}
+
+static int take_pool_chunk(rl_open_file *file);
+static void give_back_pool_chunk(int c);
+
+/**
+ * @brief Takes a free overflow chunk for `lck`, from the shared pool or from
+ * the chunks of a private lock space
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file that contains `lck`
+ * @param lck the lock whose inline owners are all used
+ * @return 0 on success, -1 if the chunks are exhausted
+ */
+static int take_chunk(rl_open_file *file, rl_lock *lck) {
+    int c = -1;
+    if (file->chunks_offset == 0)
+        c = take_pool_chunk(file);
+    for (int i = 0; file->chunks_offset != 0 && i < RL_OWNER_CHUNKS; i++) {
+        if (!(file->chunk_map & (1ULL << i))) {
+            file->chunk_map |= 1ULL << i;
+            c = i;
+            break;
+        }
+    }
+    if (c == -1)
+        return -1;
+
+    rl_owner_chunk *chunk = get_chunk(file, c);
+    for (int k = 0; k < RL_MAX_OWNERS - RL_INLINE_OWNERS; k++)
+        erase_owner(&chunk->owners[k]);
+    lck->overflow = c + 1;
+    return 0;
+}
+
+/**
+ * @brief Gives the overflow chunk of `lck` back once its owners fit in its
+ * inline owners
+ * @param file the file that contains `lck`
+ * @param lck the lock
+ */
+static void give_back_chunk(rl_open_file *file, rl_lock *lck) {
+    if (lck->overflow == 0 || lck->nb_owners > RL_INLINE_OWNERS)
+        return;
+    if (file->chunks_offset != 0)
+        file->chunk_map &= ~(1ULL << (lck->overflow - 1));
+    else
+        give_back_pool_chunk(lck->overflow - 1);
+    lck->overflow = 0;
+}
+
 /**
  * @brief Moves the owners of `lck` in order to fit in the first
  * `lck->nb_owners` cells of `lck` owner table
  *
  * This function does not use any locking mechanism, so be sure to have an
  * exclusive lock on the structure before organizing its owners in order to
- * preserve data integrity.
+ * preserve data integrity. The overflow chunk of `lck` is given back to the
+ * pool if its owners don't need it anymore.
  *
+ * @param file the file that contains `lck`
  * @param lck the lck that contains the owners to organize
  * @return 0 if the owners were successfully organized, -1 on error
  */
-static int organize_owners(rl_lock *lck) {
+static int organize_owners(rl_open_file *file, rl_lock *lck) {
     if (lck == NULL || lck->nb_owners < 0 || lck->nb_owners > RL_MAX_OWNERS)
         return -1;
 
+    int capacity = get_owner_capacity(lck);
     for (int i = 0; i < lck->nb_owners; i++) {
-        if (is_owner_free(&lck->lock_owners[i])) {
+        if (is_owner_free(get_lock_owner(file, lck, i))) {
             int j = i + 1;
-            while (j < RL_MAX_OWNERS && is_owner_free(&lck->lock_owners[j]))
+            while (j < capacity
+                    && is_owner_free(get_lock_owner(file, lck, j)))
                 j++;
-            if (j >= RL_MAX_OWNERS)
+            if (j >= capacity)
                 return -1;
-            lck->lock_owners[i] = lck->lock_owners[j];
-            erase_owner(&lck->lock_owners[j]);
+            *get_lock_owner(file, lck, i) = *get_lock_owner(file, lck, j);
+            erase_owner(get_lock_owner(file, lck, j));
         }
     }
+    give_back_chunk(file, lck);
     return 0;
 }
 
@@ -218,54 +846,159 @@ static int equals(rl_owner o1, rl_owner o2) {
 /******************************************************************************/
 
 /**
- * @brief Erases `lck` if possible
- * @param lck the lock to erase
+ * @brief The fd of a reader registry entry whose owner has gone, which lets
+ * the lookups go on past it
  */
-static void erase_lock(rl_lock *lck) {
-    if (lck != NULL)
-        lck->start = RL_FREE_LOCK;
-}
+#define RL_GONE_READER -2
 
 /**
- * @brief Checks if `lck` is free
+ * @brief Checks if the owners of `lck` are counted in its reader map rather
+ * than stored in its owner table
+ * @param file the file that contains `lck`
  * @param lck the lock to check
- * @return 1 if `lck` is free, 0 otherwise
+ * @return 1 if they are, 0 otherwise
  */
-static int is_lock_free(rl_lock *lck) {
-    return lck != NULL && lck->start == RL_FREE_LOCK;
+static int has_reader_map(const rl_open_file *file, const rl_lock *lck) {
+    return (file->flags & RL_ATTR_COUNTED_READERS) && lck->type == F_RDLCK;
 }
 
 /**
- * @brief Moves the locks of `file` in order to fit in the first
- * `file->nb_locks` cells of `file` lock table
+ * @brief Gets the index of `owner` in the reader registry of `file`
  *
- * This function does not use any locking mechanism, so be sure to have an
- * exclusive lock on the structure before organizing its lock in order to
- * preserve data integrity.
+ * The registry is a hash table with linear probing, an owner is registered
+ * until it closes its descriptor or its process dies.
  *
- * @param file the file that contains the locks to organize
- * @return 0 if the locks were successfully organized, -1 on error
+ * @param file the file that contains the registry
+ * @param owner the owner to look for
+ * @param create whether to register `owner` if it is not registered yet
+ * @return the index of `owner`, -1 if it is not registered and could not be
  */
-static int organize_locks(rl_open_file *file) {
-    if (file == NULL || file->nb_locks < 0 || file->nb_locks > RL_MAX_LOCKS)
-        return -1;
-
-    for (int i = 0; i < file->nb_locks; i++) {
-        if (is_lock_free(&file->lock_table[i])) {
-            int j = i + 1;
-            while (j < RL_MAX_LOCKS && is_lock_free(&file->lock_table[j]))
-                j++;
-            if (j >= RL_MAX_LOCKS)
-                return -1;
-            file->lock_table[i] = file->lock_table[j];
-            erase_lock(&file->lock_table[j]);
-        }
+static int find_reader(rl_open_file *file, rl_owner owner, int create) {
+    int hash = ((unsigned int) owner.pid * 31U + (unsigned int) owner.fd)
+        % RL_MAX_READERS;
+    int free_index = -1;
+    for (int n = 0; n < RL_MAX_READERS; n++) {
+        int r = (hash + n) % RL_MAX_READERS;
+        rl_owner *cur = &get_readers(file)[r];
+        if (equals(*cur, owner))
+            return r;
+        if (free_index == -1
+                && (is_owner_free(cur) || cur->fd == RL_GONE_READER))
+            free_index = r;
+        if (is_owner_free(cur))
+            break;
     }
-    return 0;
+
+    if (!create || free_index == -1)
+        return -1;
+    get_readers(file)[free_index] = owner;
+    return free_index;
 }
 
 /**
- * @brief Converts `from` into a `struct flock` and puts the result in `to`
+ * @brief Unregisters from the reader registry of `file` the owners matching
+ * `crit`, which must not be counted in any reader map anymore
+ * @param file the file that contains the registry
+ * @param crit a function that take two lock owners and returns an integer
+ * @param owner_crit the owner used as second parameter of `crit`
+ */
+static void unregister_readers(rl_open_file *file,
+        int (*crit)(rl_owner, rl_owner), rl_owner owner_crit) {
+    if (!(file->flags & RL_ATTR_COUNTED_READERS))
+        return;
+    for (int r = 0; r < RL_MAX_READERS; r++) {
+        rl_owner *cur = &get_readers(file)[r];
+        if (!is_owner_free(cur) && cur->fd != RL_GONE_READER
+                && crit(*cur, owner_crit) > 0) {
+            cur->pid = (pid_t) RL_FREE_OWNER;
+            cur->fd = RL_GONE_READER;
+        }
+    }
+}
+
+/**
+ * @brief Checks if the reader `r` of the registry is counted in `lck`
+ * @param file the file that contains `lck`
+ * @param lck the lock to check
+ * @param r the index of the reader in the registry
+ * @return 1 if it is, 0 otherwise
+ */
+static int test_reader(const rl_open_file *file, const rl_lock *lck, int r) {
+    return (get_reader_map(file, lck)[r / 64] >> (r % 64)) & 1;
+}
+
+/**
+ * @brief Counts or uncounts the reader `r` of the registry in `lck`
+ * @param file the file that contains `lck`
+ * @param lck the lock to modify
+ * @param r the index of the reader in the registry
+ * @param value 1 to count the reader, 0 to uncount it
+ */
+static void set_reader(rl_open_file *file, rl_lock *lck, int r, int value) {
+    if (test_reader(file, lck, r) == value)
+        return;
+    get_reader_map(file, lck)[r / 64] ^= 1ULL << (r % 64);
+    if (value)
+        lck->nb_readers++;
+    else
+        lck->nb_readers--;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Erases `lck` if possible
+ * @param lck the lock to erase
+ */
+static void erase_lock(rl_lock *lck) {
+    if (lck != NULL)
+        lck->start = RL_FREE_LOCK;
+}
+
+/**
+ * @brief Checks if `lck` is free
+ * @param lck the lock to check
+ * @return 1 if `lck` is free, 0 otherwise
+ */
+static int is_lock_free(rl_lock *lck) {
+    return lck != NULL && lck->start == RL_FREE_LOCK;
+}
+
+/**
+ * @brief Moves the locks of `file` in order to fit in the first
+ * `file->nb_locks` cells of `file` lock table
+ *
+ * This function does not use any locking mechanism, so be sure to have an
+ * exclusive lock on the structure before organizing its lock in order to
+ * preserve data integrity.
+ *
+ * @param file the file that contains the locks to organize
+ * @return 0 if the locks were successfully organized, -1 on error
+ */
+static int organize_locks(rl_open_file *file) {
+    if (file == NULL || file->nb_locks < 0 || file->nb_locks > RL_MAX_LOCKS)
+        return -1;
+
+    for (int i = 0; i < file->nb_locks; i++) {
+        if (is_lock_free(&file->lock_table[i])) {
+            int j = i + 1;
+            while (j < RL_MAX_LOCKS && is_lock_free(&file->lock_table[j]))
+                j++;
+            if (j >= RL_MAX_LOCKS)
+                return -1;
+            file->lock_table[i] = file->lock_table[j];
+            if (file->flags & RL_ATTR_COUNTED_READERS)
+                memcpy(get_reader_map(file, &file->lock_table[i]),
+                        get_reader_map(file, &file->lock_table[j]),
+                        RL_MAX_READERS / 8);
+            erase_lock(&file->lock_table[j]);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Converts `from` into a `struct flock` and puts the result in `to`
  * @param from the original `rl_lock`
  * @param to the conversion of `from` to a `struct flock`
  * @return 0 on success, -1 on error
@@ -303,7 +1036,7 @@ static int delete_owner_on_criteria(rl_open_file *file,
     for (int i = 0; i < file->nb_locks; i++) {
         int owners_count = file->lock_table[i].nb_owners;
         for (int j = 0; j < file->lock_table[i].nb_owners; j++) {
-            rl_owner *cur = &file->lock_table[i].lock_owners[j];
+            rl_owner *cur = get_lock_owner(file, &file->lock_table[i], j);
             int res = crit(*cur, owner_crit);
             if (res > 0) {
                 erase_owner(cur);
@@ -312,9 +1045,19 @@ static int delete_owner_on_criteria(rl_open_file *file,
                 return -1;
         }
         file->lock_table[i].nb_owners = owners_count;
-        if (organize_owners(&file->lock_table[i]) < 0)
+        if (organize_owners(file, &file->lock_table[i]) < 0)
             return -1;
-        if (owners_count == 0) {
+        for (int r = 0; r < RL_MAX_READERS
+                && file->lock_table[i].nb_readers > 0; r++) {
+            if (!test_reader(file, &file->lock_table[i], r))
+                continue;
+            int res = crit(get_readers(file)[r], owner_crit);
+            if (res > 0)
+                set_reader(file, &file->lock_table[i], r, 0);
+            else if (res == -1)
+                return -1;
+        }
+        if (owners_count == 0 && file->lock_table[i].nb_readers == 0) {
             erase_lock(&file->lock_table[i]);
             locks_count--;
         }
@@ -322,811 +1065,6332 @@ static int delete_owner_on_criteria(rl_open_file *file,
     file->nb_locks = locks_count;
     if (organize_locks(file) < 0)
         return -1;
+    unregister_readers(file, crit, owner_crit);
     return 0;
 }
 
 /******************************************************************************/
 
 /**
- * @brief Puts in `buffer` the name of the shm corresponding to `fd`
- * @param fd a file descriptor associated to a regular file
- * @param buffer a memory zone big enough for the shm name
- * @return 0 on success, -1 on error
+ * @brief The state of a free fast slot
  */
-static int get_shm_name(int fd, char *buffer) {
-    struct stat st;
-    if (fstat(fd, &st))
-        return -1;
-    
-    int sprintf_res = sprintf(buffer, "/%s_%lu_%lu", SHM_PREFIX,
-            st.st_dev, st.st_ino);
-    if (sprintf_res < 0)
-        return -1;
-    
-    return 0;
-}
+#define RL_SLOT_FREE 0
 
 /**
- * @brief Closes the given locked file descriptor
- *
- * This function removes from each lock of the descripted open file the owner
- * `{getpid(), lfd.fd}` if present. After deletion, the lock owners of each lock
- * are reorganized, as each lock of the lock table of the open file description.
- * The `close()` operation is made only if the previous operations are
- * successful.
- *
- * @param lfd the locked file descriptor to close
- * @return 0 if `lfd` was successfully closed, -1 on error
+ * @brief The state of a fast slot being filled or moved to the lock table
  */
-int rl_close(rl_descriptor lfd) {
-    /* check descriptor validity */
-    if (lfd.fd < 0 || lfd.file == NULL)
-        return -1;
+#define RL_SLOT_BUSY 1
 
-    /* take lock on open file */
-    int err = pthread_mutex_lock(&lfd.file->mutex);
-    if (err != 0)
-        return -1;
+/**
+ * @brief The state of a fast slot that holds a granted lock
+ */
+#define RL_SLOT_HELD 2
 
-    rl_owner lfd_owner = {.pid = getpid(), .fd = lfd.fd};
-    if (delete_owner_on_criteria(lfd.file, equals, lfd_owner) < 0)
-        return -1;
+/**
+ * @brief The state of a fast slot whose request is being checked by its
+ * requester
+ */
+#define RL_SLOT_PENDING 3
 
-    char shm_name[256];
-    if (get_shm_name(lfd.fd, shm_name))
-        return -1;
+/**
+ * @brief The state of a fast slot whose lock was released by its owner on a
+ * file created with `RL_ATTR_LEASES`, the owner keeping a lease on it
+ */
+#define RL_SLOT_IDLE 4
 
-    if (close(lfd.fd) == -1)
-        return -1;
+/**
+ * @brief The increment of the generation of a fast slot state
+ */
+#define RL_SLOT_GENERATION 8U
 
-    if (map_decrement(lfd.file, getpid()))
-        return -1;
+/**
+ * @brief Gets the kind (`RL_SLOT_*`) of a fast slot state
+ */
+#define SLOT_KIND(state) ((state) & (RL_SLOT_GENERATION - 1))
 
-    int unlink_shm = 1;
-    int new_nb_map_entries = lfd.file->nb_map_entries;
-    for (int i = 0; i < lfd.file->nb_map_entries; i++) {
-        rl_pid_fd_count *entry = &lfd.file->pid_map[i];
-        if (kill(entry->pid, 0) == -1 && errno == ESRCH) {
-            erase_map_entry(entry);
-            new_nb_map_entries--;
-        } else
-            unlink_shm = 0;
-    }
-    lfd.file->nb_map_entries = new_nb_map_entries;
-    if (organize_map_entries(lfd.file))
-        return -1;
+/**
+ * @brief Gets the state `state` would have with the kind `kind`, keeping its
+ * generation
+ */
+#define SLOT_WITH_KIND(state, kind) \
+    (((state) & ~(RL_SLOT_GENERATION - 1)) | (kind))
 
-    if (msync(lfd.file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE) == -1)
-        return -1;
-    err = pthread_mutex_unlock(&lfd.file->mutex);
-    if (err != 0)
-        return -1;
+/**
+ * @brief The state of the reader bias when it is off
+ */
+#define RL_BIAS_OFF 0
 
-    if (unlink_shm) {
-        if (shm_unlink(shm_name))
-            return -1;
-    }
-    
-    return 0;
-}
+/**
+ * @brief The state of the reader bias while the mutex path checks that no write
+ * lock was granted without the mutex before turning it on
+ */
+#define RL_BIAS_ARMING 1
 
-/******************************************************************************/
+/**
+ * @brief The state of the reader bias when it is on
+ */
+#define RL_BIAS_ON 2
 
 /**
- * @brief Initializes the library
- * 
- * You must call this function before using the library.
+ * @brief Writes the summary of `file`
  *
- * @return always 0
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file whose summary is written
+ * @param start the start of the bounding segment
+ * @param len the length of the bounding segment, 0 if extensible, -1 if empty
+ * @param writer whether there is a write lock in the lock table
  */
-int rl_init_library() {
-    rla.nb_files = 0;
-    for (int i = 0; i < RL_MAX_FILES; i++)
-        rla.open_files[i] = RL_FREE_FILE;
-    return 0;
+static void write_summary(rl_open_file *file, off_t start, off_t len,
+        int writer) {
+    atomic_fetch_add(&file->summary_seq, 1);
+    atomic_store(&file->summary_start, start);
+    atomic_store(&file->summary_len, len);
+    atomic_store(&file->summary_writer, writer);
+    atomic_fetch_add(&file->summary_seq, 1);
 }
 
-/******************************************************************************/
+/**
+ * @brief Reads the summary of `file` without taking its mutex
+ * @param file the file whose summary is read
+ * @param start the start of the bounding segment
+ * @param len the length of the bounding segment, 0 if extensible, -1 if empty
+ * @param writer whether there is a write lock in the lock table
+ */
+static void read_summary(rl_open_file *file, off_t *start, off_t *len,
+        int *writer) {
+    unsigned int seq;
+    do {
+        seq = atomic_load(&file->summary_seq);
+        *start = atomic_load(&file->summary_start);
+        *len = atomic_load(&file->summary_len);
+        *writer = atomic_load(&file->summary_writer);
+    } while ((seq & 1) || atomic_load(&file->summary_seq) != seq);
+}
 
 /**
- * @brief Adds the given open file to the open file descriptions of this process
- * if it is not already there
+ * @brief Extends the summary of `file` so that it covers the segment
+ * (start, len) of type `type`
  *
- * Fails if rla is full and rlo must be added
+ * This must be done under the mutex before a lock is added to the lock table,
+ * so that the fast path falls back on the mutex for overlapping requests.
  *
- * @param rlo the open file to add
- * @return 0 on success, -1 on error
+ * @param file the file whose summary is extended
+ * @param start the start of the segment
+ * @param len the length of the segment, 0 if extensible
+ * @param type the type of the lock
  */
-static int add_to_rla(rl_open_file *rlo) {
-    for (int i = 0; i < rla.nb_files; i++)
-        if (rla.open_files[i] == rlo)
-            return 0;
-
-    if (rla.nb_files >= RL_MAX_FILES)
-        return -1;
-
-    rla.open_files[rla.nb_files] = rlo;
-    rla.nb_files++;
-    return 0;
+static void include_in_summary(rl_open_file *file, off_t start, off_t len,
+        short type) {
+    off_t s_start = atomic_load(&file->summary_start);
+    off_t s_len = atomic_load(&file->summary_len);
+    int writer = atomic_load(&file->summary_writer) || type == F_WRLCK;
+
+    if (s_len == -1) {
+        write_summary(file, start, len, writer);
+        return;
+    }
+    off_t new_start = start < s_start ? start : s_start;
+    off_t new_len = 0;
+    if (s_len != 0 && len != 0) {
+        off_t end = start + len > s_start + s_len ?
+            start + len : s_start + s_len;
+        new_len = end - new_start;
+    }
+    write_summary(file, new_start, new_len, writer);
 }
 
 /**
- * @brief Opens the file at the given path
+ * @brief Recomputes the summary of `file` from its lock table
  *
- * Opens `path` with the open() system call (identical parameters). Also does
- * the memory projection of the `rl_open_file` associated with the file at path,
- * creating the shared memory object if it doesn't exist. Returns the
- * corresponding `rl_descriptor`.
+ * This function must be called with the mutex of `file` held.
  *
- * @param path the relative or absolute path to the file
- * @param oflag the flags passed to `open()`
- * @param ... the mode (permissions) for the new file, required if O_CREAT flag
- *            is specified
- * @return the rl_descriptor containing the file descriptor returned by open()
- *         and a pointer to the rl_open_file associated to the file, or an
- *         rl_descriptor containing fd -1 and rl_open_file pointer NULL on error
+ * @param file the file whose summary is recomputed
  */
-rl_descriptor rl_open(const char *path, int oflag, ...) {
-    rl_descriptor err_desc = {.fd = -1, .file = NULL};
-
-    if (rla.nb_files >= RL_MAX_FILES) {
-        errno = EMFILE;
-        return err_desc;
+static void update_summary(rl_open_file *file) {
+    off_t start = 0;
+    off_t end = 0;
+    int extensible = 0;
+    int writer = 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *lck = &file->lock_table[i];
+        if (i == 0 || lck->start < start)
+            start = lck->start;
+        if (lck->len == 0)
+            extensible = 1;
+        else if (lck->start + lck->len > end)
+            end = lck->start + lck->len;
+        if (lck->type == F_WRLCK || lck->upgrading)
+            writer = 1;
     }
-    
-    va_list va;
-    va_start(va, oflag);
 
-    int open_res;
-    if (oflag & O_CREAT)
-        open_res = open(path, oflag, va_arg(va, mode_t));
+    if (file->nb_locks == 0)
+        write_summary(file, 0, -1, 0);
     else
-        open_res = open(path, oflag);
+        write_summary(file, start, extensible ? 0 : end - start, writer);
+}
 
-    va_end(va);
+static void release_open_file(rl_open_file *file);
+static int attach_chunk_pool(rl_open_file *file);
 
-    if (open_res == -1)
-        return err_desc;
+/**
+ * @brief Maps the shared pool of overflow chunks of `file` once its exclusive
+ * lock is taken
+ * @param file the open file, whose lock was just taken
+ * @return 0 on success, -1 with the lock released on error
+ */
+static int enter_open_file(rl_open_file *file) {
+    if (attach_chunk_pool(file) == 0)
+        return 0;
+    int err = errno;
+    release_open_file(file);
+    errno = err;
+    return -1;
+}
 
-    char shm_path[256];
-    if (get_shm_name(open_res, shm_path)) {
-        close(open_res);
-        return err_desc;
+/**
+ * @brief Takes the exclusive lock on `file`
+ *
+ * The lock is an MCS queue lock. With `RL_ATTR_COHORT`, the caller first takes
+ * the local lock of the cohort of its NUMA node: the lock of the file is only
+ * taken if it was not handed over by a process of the same cohort.
+ *
+ * A process that dies while holding the lock, or while waiting for it, is
+ * skipped by its successor in the queue, which takes the lock over.
+ *
+ * @param file the open file to lock
+ * @return 0 on success, -1 on error
+ */
+static int lock_open_file(rl_open_file *file) {
+    if (!(file->flags & RL_ATTR_COHORT) || file->cohorts_offset == 0) {
+        int me = acquire_mcs(&file->mcs_tail, get_mcs_nodes(file),
+                RL_MCS_NODES);
+        if (me == -1)
+            return -1;
+        file->mcs_holder = me;
+        file->cohort_holder = -1;
+        return enter_open_file(file);
     }
 
-    int shm_res = shm_open(shm_path, O_RDWR, 0);
-    int shm_res2 = -1;
-    rl_open_file *rlo = NULL;
-    // Problem: process 1 creates the shm and is paused before initializing it
-    // then process 2 comes here and the shm exists but is not initialized
-    if (shm_res >= 0) {
-        rlo = mmap(NULL, sizeof(rl_open_file), PROT_READ | PROT_WRITE,
-                MAP_SHARED, shm_res, 0);
-        if (rlo == MAP_FAILED) {
-        error2:
-            close(open_res);
-            close(shm_res);
-            return err_desc;
-        }
-
-        if (pthread_mutex_lock(&rlo->mutex))
-            goto error2;
-
-        if (map_increment(rlo, getpid()))
-            goto error2;
-
-        if (msync(rlo, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE) == -1)
-            goto error2;
-        if (pthread_mutex_unlock(&rlo->mutex))
-            goto error2;
-    } else { // We create the shm
-        shm_res2 = shm_open(shm_path, O_RDWR | O_CREAT,
-                S_IRWXU | S_IRWXG | S_IRWXO);
-        if (shm_res2 == -1) {
-            close(open_res);
-            shm_unlink(shm_path);
-            return err_desc;
-        }
-        
-        int trunc_res = ftruncate(shm_res2, sizeof(rl_open_file));
-        if (trunc_res == -1) {
-        error:
-            close(open_res);
-            close(shm_res2);
-            shm_unlink(shm_path);
-            return err_desc;
+    int c = get_numa_node() % RL_MAX_COHORTS;
+    rl_cohort *cohort = get_cohort(file, c);
+    int me = acquire_mcs(&cohort->tail, cohort->nodes, RL_COHORT_NODES);
+    if (me == -1)
+        return -1;
+    cohort->holder = me;
+    /* the dead holder of the cohort also held the lock of the file, which is
+     * taken over in its queue */
+    if (atomic_load(&cohort->nodes[me].wait) == RL_MCS_TAKEN_OVER)
+        cohort->global_held = 0;
+    if (!cohort->global_held) {
+        int global = acquire_mcs(&file->mcs_tail, get_mcs_nodes(file),
+                RL_MCS_NODES);
+        if (global == -1) {
+            release_mcs(&cohort->tail, cohort->nodes, RL_COHORT_NODES, me);
+            return -1;
         }
+        file->mcs_holder = global;
+        cohort->global_held = 1;
+    }
+    file->cohort_holder = c;
+    return enter_open_file(file);
+}
 
-        rlo = mmap(NULL, sizeof(rl_open_file), PROT_READ | PROT_WRITE,
-                MAP_SHARED, shm_res2, 0);
-        if (rlo == MAP_FAILED)
-            goto error;
-
-        if (initialize_mutex(&rlo->mutex))
-            goto error;
-        if (pthread_mutex_lock(&rlo->mutex)) 
-            goto error;
-
-        rlo->nb_map_entries = 0;
-        for (int i = 0; i < RL_MAX_MAP_ENTRIES; i++)
-            erase_map_entry(&rlo->pid_map[i]);
-
-        if (map_increment(rlo, getpid()))
-            goto error;
+/**
+ * @brief Takes the exclusive lock on `file` if nobody holds it
+ * @param file the open file to lock
+ * @return 0 on success, -1 if the lock is held
+ */
+static int try_lock_open_file(rl_open_file *file) {
+    if (!(file->flags & RL_ATTR_COHORT) || file->cohorts_offset == 0) {
+        int me = try_acquire_mcs(&file->mcs_tail, get_mcs_nodes(file),
+                RL_MCS_NODES);
+        if (me == -1)
+            return -1;
+        file->mcs_holder = me;
+        file->cohort_holder = -1;
+        return enter_open_file(file);
+    }
 
-        rlo->nb_locks = 0;
-        for (int i = 0; i < RL_MAX_LOCKS; i++) {
-            erase_lock(&rlo->lock_table[i]);
-            for (int j = 0; j < RL_MAX_OWNERS; j++)
-                erase_owner(&rlo->lock_table[i].lock_owners[j]);
+    int c = get_numa_node() % RL_MAX_COHORTS;
+    rl_cohort *cohort = get_cohort(file, c);
+    int me = try_acquire_mcs(&cohort->tail, cohort->nodes, RL_COHORT_NODES);
+    if (me == -1)
+        return -1;
+    cohort->holder = me;
+    if (!cohort->global_held) {
+        int global = try_acquire_mcs(&file->mcs_tail, get_mcs_nodes(file),
+                RL_MCS_NODES);
+        if (global == -1) {
+            release_mcs(&cohort->tail, cohort->nodes, RL_COHORT_NODES, me);
+            return -1;
         }
-
-        if (msync(rlo, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE) == -1)
-            goto error;
-        if (pthread_mutex_unlock(&rlo->mutex))
-            goto error;
+        file->mcs_holder = global;
+        cohort->global_held = 1;
     }
+    file->cohort_holder = c;
+    return enter_open_file(file);
+}
 
-    if (add_to_rla(rlo) == -1) {
-        close(open_res);
-        close(shm_res);
-        close(shm_res2);
-        return err_desc;
+/**
+ * @brief Hands the exclusive lock on `file` over to the next waiter, or frees
+ * it if there is none
+ *
+ * With `RL_ATTR_COHORT`, the lock is handed over to the next waiter of the
+ * same cohort, at most `RL_COHORT_BATCH` times in a row, before being given
+ * back to the other cohorts.
+ *
+ * @param file the open file to unlock
+ */
+static void release_open_file(rl_open_file *file) {
+    int c = file->cohort_holder;
+    if (c < 0) {
+        release_mcs(&file->mcs_tail, get_mcs_nodes(file), RL_MCS_NODES,
+                file->mcs_holder);
+        return;
     }
 
-    rl_descriptor desc = {.fd = open_res, .file = rlo};
-    return desc;
+    rl_cohort *cohort = get_cohort(file, c);
+    pid_t succ = 0;
+    if (cohort->batch < RL_COHORT_BATCH
+            && has_mcs_waiter(&cohort->tail, cohort->nodes, cohort->holder)) {
+        int next = wait_mcs_link(&cohort->tail, cohort->nodes,
+                RL_COHORT_NODES, cohort->holder);
+        succ = atomic_load(&cohort->nodes[next - 1].owner);
+        /* a dead successor is taken over with the lock of the cohort only */
+        if (kill(succ, 0) == -1 && errno == ESRCH)
+            succ = 0;
+    }
+    if (succ != 0) {
+        cohort->batch++;
+        /* the node of the lock of the file passes to the next holder, so that
+         * it is only taken over if that one dies */
+        atomic_store(&get_mcs_nodes(file)[file->mcs_holder].owner, succ);
+    } else {
+        cohort->batch = 0;
+        cohort->global_held = 0;
+        release_mcs(&file->mcs_tail, get_mcs_nodes(file), RL_MCS_NODES,
+                file->mcs_holder);
+    }
+    release_mcs(&cohort->tail, cohort->nodes, RL_COHORT_NODES,
+            cohort->holder);
 }
 
 /**
- * @brief Checks if the segment [s1, s1 + l1[ and [s2, s2 + l2[ overlap
+ * @brief Signals the processes waiting for a lock on `file` that some locks
+ * may have been released
+ * @param file the open file
+ */
+static void notify_release(rl_open_file *file) {
+    if (atomic_load(&file->nb_waiters) == 0)
+        return;
+    atomic_fetch_add(&file->release_seq, 1);
+    if (atomic_load(&file->nb_parked) > 0)
+        futex_wake(&file->release_seq, INT_MAX);
+}
+
+/**
+ * @brief Releases the exclusive lock on `file`, after having updated its
+ * summary and synchronized its memory projection
+ * @param file the open file to unlock
+ * @return 0 on success, -1 on error
+ */
+static int unlock_open_file(rl_open_file *file) {
+    update_summary(file);
+    int res = 0;
+    if (!(file->flags & RL_PRIVATE_FILE))
+        res = msync(file, file->size, MS_SYNC | MS_INVALIDATE);
+    release_open_file(file);
+    return res == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Releases the fast locks and leases of `file` whose owner matches
+ * `crit`
+ *
+ * A lock or lease of which `crit(slot owner, owner_crit)` is > 0 is released.
+ *
+ * @param file the file that contains the fast locks
+ * @param crit a function that take two lock owners and returns an integer
+ * @param owner_crit the owner used as second parameter of `crit`
+ */
+static void drop_fast_locks(rl_open_file *file,
+        int (*crit)(rl_owner, rl_owner), rl_owner owner_crit) {
+    for (int i = 0; i < RL_FAST_SLOTS + get_nb_bias_slots(file); i++) {
+        rl_fast_slot *slot = i < RL_FAST_SLOTS ?
+            &file->fast_slots[i] : &get_bias_slots(file)[i - RL_FAST_SLOTS];
+        unsigned int state = atomic_load(&slot->state);
+        if ((SLOT_KIND(state) == RL_SLOT_HELD
+                    || SLOT_KIND(state) == RL_SLOT_IDLE)
+                && crit(slot->owner, owner_crit) > 0)
+            atomic_compare_exchange_strong(&slot->state, &state,
+                    SLOT_WITH_KIND(state, RL_SLOT_FREE));
+    }
+}
+
+/******************************************************************************/
+
+/**
+ * @brief The compatibility of the file-level modes: `rl_compatible[a][b]` is 1
+ * if `a` can be held while `b` is held by another owner
+ */
+static const int rl_compatible[RL_NB_MODES][RL_NB_MODES] = {
+    /*           IS IX  S SIX  X */
+    /* IS  */  {  1, 1, 1,  1, 0 },
+    /* IX  */  {  1, 1, 0,  0, 0 },
+    /* S   */  {  1, 0, 1,  0, 0 },
+    /* SIX */  {  1, 0, 0,  0, 0 },
+    /* X   */  {  0, 0, 0,  0, 0 },
+};
+
+/**
+ * @brief Finds the file-level mode held by `owner`
+ * @param file the file created with `RL_ATTR_INTENTS`
+ * @param owner the owner to look for
+ * @return the index of the entry of `owner` in the intents of `file`, -1 if it
+ *         holds no mode
+ */
+static int find_intent(const rl_open_file *file, rl_owner owner) {
+    for (int i = 0; i < RL_MAX_INTENTS; i++) {
+        if (equals(get_intents(file)[i].owner, owner))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Gets the file-level mode held by `owner`
+ * @param file the file created with `RL_ATTR_INTENTS`
+ * @param owner the owner of the mode
+ * @return the `RL_MODE_*` mode, `RL_MODE_NONE` if it holds none
+ */
+static int get_mode(const rl_open_file *file, rl_owner owner) {
+    int i = find_intent(file, owner);
+    return i == -1 ? RL_MODE_NONE : get_intents(file)[i].mode;
+}
+
+/**
+ * @brief Checks if the holder of `mode` may put range locks of type `type`
+ * @param mode the `RL_MODE_*` mode
+ * @param type F_RDLCK or F_WRLCK
+ * @return 1 if it may, 0 otherwise
+ */
+static int mode_covers(int mode, short type) {
+    if (type == F_RDLCK)
+        return mode != RL_MODE_NONE;
+    return mode == RL_MODE_IX || mode == RL_MODE_SIX || mode == RL_MODE_X;
+}
+
+/**
+ * @brief Releases the file-level modes of `file` whose owner matches `crit`
+ * @param file the file that contains the modes
+ * @param crit a function that take two lock owners and returns an integer
+ * @param owner_crit the owner used as second parameter of `crit`
+ */
+static void drop_intents(rl_open_file *file, int (*crit)(rl_owner, rl_owner),
+        rl_owner owner_crit) {
+    if (!(file->flags & RL_ATTR_INTENTS))
+        return;
+    for (int i = 0; i < RL_MAX_INTENTS; i++) {
+        rl_intent *intent = &get_intents(file)[i];
+        if (!is_owner_free(&intent->owner)
+                && crit(intent->owner, owner_crit) > 0) {
+            file->nb_modes[intent->mode]--;
+            erase_owner(&intent->owner);
+            intent->mode = RL_MODE_NONE;
+        }
+    }
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Checks if `owner` is the owner of the locks of a lock group
+ * @param owner the owner to check
+ * @return 1 if `owner` is a lock group, 0 otherwise
+ */
+static int is_group_owner(rl_owner owner) {
+    return owner.pid < RL_FREE_OWNER;
+}
+
+/**
+ * @brief Gets the owner of the locks of a lock group
+ * @param group the index of the group in the `groups` of its file
+ * @return the owner of the locks of the group
+ */
+static rl_owner get_group_owner(int group) {
+    rl_owner owner = {.pid = (pid_t) (-2 - group), .fd = 0};
+    return owner;
+}
+
+/**
+ * @brief Gets the index of the lock group of a group owner
+ * @param owner the owner of the locks of the group
+ * @return the index of the group in the `groups` of its file
+ */
+static int get_group(rl_owner owner) {
+    return -2 - (int) owner.pid;
+}
+
+/**
+ * @brief Finds the lock group membership of `fd` in this process
+ * @param fd the descriptor
+ * @return the membership of `fd`, NULL if it is not in a lock group
+ */
+static rl_fd_group *find_membership(int fd) {
+    for (int i = 0; i < RL_MAX_FILES && fd != -1; i++) {
+        if (rla.groups[i].fd == fd)
+            return &rla.groups[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Gets the owner on behalf of which `lfd` locks
+ * @param lfd the descriptor
+ * @return the lock group of `lfd` if it joined one, `lfd` itself otherwise
+ */
+static rl_owner get_owner(rl_descriptor lfd) {
+    rl_fd_group *membership = find_membership(lfd.fd);
+    if (membership != NULL)
+        return get_group_owner(membership->group);
+    rl_owner owner = {.pid = getpid(), .fd = lfd.fd};
+    return owner;
+}
+
+/**
+ * @brief Gets a descriptor of this process through which `owner` locks
+ * @param file the file locked by `owner`
+ * @param owner the owner
+ * @return `owner.fd`, or a descriptor of this process which is a member of
+ *         the lock group `owner`, -1 if there is none
+ */
+static int get_owner_fd(const rl_open_file *file, rl_owner owner) {
+    if (!is_group_owner(owner))
+        return owner.fd;
+    for (int i = 0; i < RL_MAX_FILES; i++) {
+        rl_fd_group *membership = &rla.groups[i];
+        if (membership->fd != -1 && membership->file == file
+                && membership->group == get_group(owner))
+            return membership->fd;
+    }
+    return -1;
+}
+
+/**
+ * @brief Checks if the process `pid` which uses `file` has died
+ *
+ * The processes of a file opened with `rl_open_private()` are never probed:
+ * only the calling process uses it.
+ *
+ * @param file the open file
+ * @param pid the process to check
+ * @return 1 if the process has died, 0 otherwise
+ */
+static int is_process_dead(const rl_open_file *file, pid_t pid) {
+    if (file->flags & RL_PRIVATE_FILE)
+        return 0;
+    return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+/**
+ * @brief Checks if the owner `owner` has died
+ *
+ * A lock group has died when all its members have.
+ *
+ * @param file the file locked by `owner`
+ * @param owner the owner to check
+ * @return 1 if the owner has died, 0 otherwise
+ */
+static int is_owner_dead(rl_open_file *file, rl_owner owner) {
+    if (!is_group_owner(owner))
+        return is_process_dead(file, owner.pid);
+
+    rl_group *group = &get_groups(file)[get_group(owner)];
+    for (int m = 0; m < RL_MAX_MEMBERS; m++) {
+        rl_owner *member = &group->members[m];
+        if (!is_owner_free(member) && !is_process_dead(file, member->pid))
+            return 0;
+    }
+    return 1;
+}
+
+static void drop_lease(rl_open_file *file, rl_owner owner);
+
+/**
+ * @brief Releases the locks and modes of the lock group `owner` and frees it
+ *
+ * This function does not use any locking mechanism, take the mutex of `file`
+ * before.
+ *
+ * @param file the file that contains the group
+ * @param owner the owner of the locks of the group
+ * @return 0 on success, -1 on error
+ */
+static int release_group(rl_open_file *file, rl_owner owner) {
+    if (delete_owner_on_criteria(file, equals, owner) < 0)
+        return -1;
+    if (file->flags & RL_ATTR_INTENTS)
+        drop_intents(file, equals, owner);
+
+    drop_lease(file, owner);
+
+    rl_group *group = &get_groups(file)[get_group(owner)];
+    group->name[0] = '\0';
+    group->nb_members = 0;
+    for (int m = 0; m < RL_MAX_MEMBERS; m++)
+        erase_owner(&group->members[m]);
+    return 0;
+}
+
+/**
+ * @brief Removes the descriptor of `membership` from its lock group
+ *
+ * The locks of the group are released when its last member leaves it. This
+ * function does not use any locking mechanism, take the mutex of the file
+ * before.
+ *
+ * @param membership the membership of a descriptor of this process
+ * @return 0 on success, -1 on error
+ */
+static int leave_group(rl_fd_group *membership) {
+    rl_open_file *file = membership->file;
+    rl_group *group = &get_groups(file)[membership->group];
+    rl_owner member = {.pid = getpid(), .fd = membership->fd};
+    for (int m = 0; m < RL_MAX_MEMBERS; m++) {
+        if (equals(group->members[m], member)) {
+            erase_owner(&group->members[m]);
+            group->nb_members--;
+        }
+    }
+
+    int res = 0;
+    if (group->nb_members <= 0)
+        res = release_group(file, get_group_owner(membership->group));
+    membership->fd = -1;
+    rla.nb_groups--;
+    return res;
+}
+
+/******************************************************************************/
+
+static int count_owned_locks(rl_open_file *file, rl_owner owner, short type);
+
+/**
+ * @brief Checks if `owner` holds locks or a mode on `file`
+ * @param file the open file
+ * @param owner the owner to check
+ * @return 1 if `owner` holds locks or a mode, 0 otherwise
+ */
+static int holds_locks(rl_open_file *file, rl_owner owner) {
+    return count_owned_locks(file, owner, -1) > 0
+        || (file->flags & RL_ATTR_INTENTS
+                && get_mode(file, owner) != RL_MODE_NONE);
+}
+
+/**
+ * @brief Gets the lease of `owner` on `file`
+ *
+ * The leases of owners that died are reused, then those of owners which hold
+ * no locks, which get a new lease with their next request, and last the
+ * oldest revoked leases. There are as many leases as owners of locks and
+ * modes, so that an owner of locks always gets a lease. This function must be
+ * called with the mutex of `file` held.
+ *
+ * @param file the file created with leases
+ * @param owner the holder of the lease
+ * @param create whether to give `owner` a lease expiring in `lease_ns` ns if
+ *               it has none
+ * @return the lease of `owner`, NULL if it has none and could not get one
+ */
+static rl_lease *get_lease(rl_open_file *file, rl_owner owner, int create) {
+    rl_lease *leases = get_leases(file);
+    rl_lease *free_lease = NULL;
+    for (int i = 0; i < RL_MAX_LEASES; i++) {
+        if (equals(leases[i].owner, owner))
+            return &leases[i];
+        if (free_lease == NULL && is_owner_free(&leases[i].owner))
+            free_lease = &leases[i];
+    }
+    if (!create)
+        return NULL;
+    for (int i = 0; free_lease == NULL && i < RL_MAX_LEASES; i++) {
+        if (is_owner_dead(file, leases[i].owner))
+            free_lease = &leases[i];
+    }
+    for (int i = 0; free_lease == NULL && i < RL_MAX_LEASES; i++) {
+        if (!leases[i].revoked && !holds_locks(file, leases[i].owner))
+            free_lease = &leases[i];
+    }
+    rl_lease *oldest = NULL;
+    for (int i = 0; free_lease == NULL && i < RL_MAX_LEASES; i++) {
+        if (leases[i].revoked && !holds_locks(file, leases[i].owner)
+                && (oldest == NULL || leases[i].expires < oldest->expires))
+            oldest = &leases[i];
+    }
+    if (free_lease == NULL)
+        free_lease = oldest;
+    if (free_lease == NULL)
+        return NULL;
+    free_lease->owner = owner;
+    free_lease->expires = get_time_ns() + file->lease_ns;
+    free_lease->revoked = 0;
+    return free_lease;
+}
+
+/**
+ * @brief Frees the lease of `owner` on `file`, which won't make requests
+ * anymore
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the open file
+ * @param owner the holder of the lease
+ */
+static void drop_lease(rl_open_file *file, rl_owner owner) {
+    rl_lease *lease = file->lease_ns > 0 ? get_lease(file, owner, 0) : NULL;
+    if (lease != NULL)
+        erase_owner(&lease->owner);
+}
+
+/**
+ * @brief Renews the lease of `owner` on `file`
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file created with leases
+ * @param owner the holder of the lease
+ * @return 0 on success, -1 on failure with errno set to ENOLCK if all the
+ *         leases are held
+ */
+static int renew_lease(rl_open_file *file, rl_owner owner) {
+    rl_lease *lease = get_lease(file, owner, 1);
+    if (lease == NULL) {
+        errno = ENOLCK;
+        return -1;
+    }
+    lease->expires = get_time_ns() + file->lease_ns;
+    return 0;
+}
+
+/**
+ * @brief Checks if the lease of `owner` on `file` has expired
+ *
+ * An owner that got locks without a request of its own, from `rl_fork()` or
+ * `rl_transfer()`, is given a lease by the first check, which it always gets
+ * since it holds locks.
+ *
+ * @param file the file that contains the locks of `owner`
+ * @param owner the owner to check
+ * @return 1 if the locks of `owner` may be revoked, 0 otherwise
+ */
+static int is_lease_expired(rl_open_file *file, rl_owner owner) {
+    if (file->lease_ns == 0)
+        return 0;
+    rl_lease *lease = get_lease(file, owner, 1);
+    return lease != NULL && lease->expires < get_time_ns();
+}
+
+/**
+ * @brief Revokes the locks and modes of `owner`, whose lease has expired
+ *
+ * The revocation is recorded in the lease of the owner so that its next
+ * request fails. This function does not use any locking mechanism, take the
+ * mutex of `file` before.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner whose locks are revoked
+ * @return 0 on success, -1 on error
+ */
+static int revoke_owner(rl_open_file *file, rl_owner owner) {
+    if (delete_owner_on_criteria(file, equals, owner) < 0)
+        return -1;
+    if (file->flags & RL_ATTR_INTENTS)
+        drop_intents(file, equals, owner);
+
+    rl_lease *lease = get_lease(file, owner, 0);
+    if (lease != NULL)
+        lease->revoked = 1;
+    return 0;
+}
+
+/**
+ * @brief Checks if the locks of `owner` were revoked since its last request,
+ * and forgets it
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner of the request
+ * @return 1 if the locks of `owner` were revoked, 0 otherwise
+ */
+static int take_revoked(rl_open_file *file, rl_owner owner) {
+    rl_lease *lease = get_lease(file, owner, 0);
+    if (lease == NULL || !lease->revoked)
+        return 0;
+    lease->revoked = 0;
+    return 1;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Puts in `buffer` the name of the shm corresponding to `fd`
+ * @param fd a file descriptor associated to a regular file
+ * @param buffer a memory zone big enough for the shm name
+ * @return 0 on success, -1 on error
+ */
+static int get_shm_name(int fd, char *buffer) {
+    struct stat st;
+    if (fstat(fd, &st))
+        return -1;
+    
+    int sprintf_res = sprintf(buffer, "/%s_%lu_%lu", SHM_PREFIX,
+            st.st_dev, st.st_ino);
+    if (sprintf_res < 0)
+        return -1;
+    
+    return 0;
+}
+
+/**
+ * @brief Puts in `buffer` the name of the shm of the named lock space `key`
+ * @param key the key of the lock space, shorter than `RL_MAX_KEY`
+ * @param buffer a memory zone big enough for the shm name
+ * @return 0 on success, -1 on error
+ */
+static int get_named_shm_name(const char *key, char *buffer) {
+    if (sprintf(buffer, "/%s_%s", SHM_NAMED_PREFIX, key) < 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Checks if the offsets of `file` are the bytes of a file
+ * @param file the open file
+ * @return 0 for a named or private lock space, 1 otherwise
+ */
+static int has_backing_file(const rl_open_file *file) {
+    return file->key[0] == '\0' && !(file->flags & RL_PRIVATE_FILE);
+}
+
+/******************************************************************************/
+
+/**
+ * @brief The number of bits in a word of a block bitmap
+ */
+#define RL_WORD_BITS (8 * sizeof(unsigned long))
+
+/**
+ * @brief The value of a block holder being reaped after the death of its
+ * process
+ */
+#define RL_REAPING_HOLDER (~0ULL)
+
+/**
+ * @brief The arrays of the block area of a file created with `RL_ATTR_BLOCKS`
+ */
+typedef struct {
+    atomic_uint *readers; /**< The number of readers of each block */
+    atomic_ullong *writers; /**< The packed owner writing each block, 0 if
+                             * none
+                             */
+    atomic_ulong *write_map; /**< The bitmap of the write-locked blocks */
+    atomic_ullong *holders; /**< The packed owners that hold read locks */
+    atomic_ulong *holder_maps; /**< The bitmaps of the blocks read-locked by
+                                * each holder
+                                */
+} rl_block_area;
+
+/**
+ * @brief Computes the number of words of a bitmap of `nb_blocks` bits
+ * @param nb_blocks the number of blocks
+ * @return the number of words of the bitmap
+ */
+static size_t block_map_words(size_t nb_blocks) {
+    return (nb_blocks + RL_WORD_BITS - 1) / RL_WORD_BITS;
+}
+
+/**
+ * @brief Computes the layout of a block area of `nb_blocks` blocks starting at
+ * `base`
+ * @param base the start of the block area, NULL to only compute its size
+ * @param nb_blocks the number of blocks
+ * @param area the arrays of the block area, may be NULL
+ * @return the size of the block area
+ */
+static size_t get_block_area(char *base, size_t nb_blocks, rl_block_area *area) {
+    size_t words = block_map_words(nb_blocks);
+    size_t readers = 0;
+    size_t writers = (readers + nb_blocks * sizeof(atomic_uint) + 7) & ~7UL;
+    size_t write_map = writers + nb_blocks * sizeof(atomic_ullong);
+    size_t holders = write_map + words * sizeof(atomic_ulong);
+    size_t holder_maps = holders + RL_MAX_BLOCK_HOLDERS * sizeof(atomic_ullong);
+    size_t size = holder_maps
+        + RL_MAX_BLOCK_HOLDERS * words * sizeof(atomic_ulong);
+
+    if (base != NULL && area != NULL) {
+        area->readers = (atomic_uint *) (base + readers);
+        area->writers = (atomic_ullong *) (base + writers);
+        area->write_map = (atomic_ulong *) (base + write_map);
+        area->holders = (atomic_ullong *) (base + holders);
+        area->holder_maps = (atomic_ulong *) (base + holder_maps);
+    }
+    return size;
+}
+
+/**
+ * @brief Packs `owner` in a single word
+ * @param owner the owner to pack
+ * @return the packed owner, never 0
+ */
+static unsigned long long pack_owner(rl_owner owner) {
+    return ((unsigned long long) (unsigned int) owner.pid << 32)
+        | (unsigned int) owner.fd;
+}
+
+/**
+ * @brief Checks if the process of a packed owner is dead
+ * @param packed the packed owner
+ * @return 1 if the process does not exist anymore, 0 otherwise
+ */
+static int is_packed_owner_dead(unsigned long long packed) {
+    if (packed == 0 || packed == RL_REAPING_HOLDER)
+        return 0;
+    return kill((pid_t) (packed >> 32), 0) == -1 && errno == ESRCH;
+}
+
+/**
+ * @brief Checks if the bit `b` of `map` is set
+ * @param map the bitmap
+ * @param b the index of the bit
+ * @return 1 if the bit is set, 0 otherwise
+ */
+static int test_block_bit(atomic_ulong *map, size_t b) {
+    return map != NULL
+        && (atomic_load(&map[b / RL_WORD_BITS]) >> (b % RL_WORD_BITS)) & 1UL;
+}
+
+/**
+ * @brief Removes the write lock of block `b` if its writer is dead
+ * @param area the block area
+ * @param b the block
+ * @return 1 if the write lock was removed, 0 otherwise
+ */
+static int reap_block_writer(rl_block_area *area, size_t b) {
+    unsigned long long writer = atomic_load(&area->writers[b]);
+    if (!is_packed_owner_dead(writer))
+        return 0;
+    if (!atomic_compare_exchange_strong(&area->writers[b], &writer, 0))
+        return 0;
+    atomic_fetch_and(&area->write_map[b / RL_WORD_BITS],
+            ~(1UL << (b % RL_WORD_BITS)));
+    return 1;
+}
+
+/**
+ * @brief Removes the read locks of the block holders whose process is dead
+ * @param area the block area
+ * @param nb_blocks the number of blocks
+ * @return the number of holders removed
+ */
+static int reap_block_holders(rl_block_area *area, size_t nb_blocks) {
+    size_t words = block_map_words(nb_blocks);
+    int reaped = 0;
+    for (int h = 0; h < RL_MAX_BLOCK_HOLDERS; h++) {
+        unsigned long long holder = atomic_load(&area->holders[h]);
+        if (!is_packed_owner_dead(holder)
+                || !atomic_compare_exchange_strong(&area->holders[h], &holder,
+                        RL_REAPING_HOLDER))
+            continue;
+        atomic_ulong *map = &area->holder_maps[h * words];
+        for (size_t b = 0; b < nb_blocks; b++) {
+            if (test_block_bit(map, b)) {
+                atomic_fetch_and(&map[b / RL_WORD_BITS],
+                        ~(1UL << (b % RL_WORD_BITS)));
+                atomic_fetch_sub(&area->readers[b], 1);
+            }
+        }
+        atomic_store(&area->holders[h], 0);
+        reaped++;
+    }
+    return reaped;
+}
+
+/**
+ * @brief Finds the holder slot of `self` in the block area, claiming a free one
+ * if asked to
+ * @param area the block area
+ * @param nb_blocks the number of blocks
+ * @param self the packed owner
+ * @param claim whether to claim a free slot if `self` has none
+ * @return the index of the holder slot, -1 if there is none
+ */
+static int find_block_holder(rl_block_area *area, size_t nb_blocks,
+        unsigned long long self, int claim) {
+    for (int h = 0; h < RL_MAX_BLOCK_HOLDERS; h++)
+        if (atomic_load(&area->holders[h]) == self)
+            return h;
+
+    if (!claim)
+        return -1;
+    do {
+        for (int h = 0; h < RL_MAX_BLOCK_HOLDERS; h++) {
+            unsigned long long expected = 0;
+            if (atomic_compare_exchange_strong(&area->holders[h], &expected,
+                        self))
+                return h;
+        }
+    } while (reap_block_holders(area, nb_blocks) > 0);
+    return -1;
+}
+
+/**
+ * @brief Write-locks block `b` for `self`
+ *
+ * The write bit of the block is set first and the readers are checked after,
+ * while readers count themselves first and check the write bit after, so that
+ * a reader and a writer can never both succeed.
+ *
+ * @param area the block area
+ * @param nb_blocks the number of blocks
+ * @param own_map the read bitmap of `self`, NULL if it has none
+ * @param self the packed owner
+ * @param b the block
+ * @return 1 if the block was locked, 2 if `self` already had it write-locked,
+ * 0 if it is locked by another owner
+ */
+static int wrlock_block(rl_block_area *area, size_t nb_blocks,
+        atomic_ulong *own_map, unsigned long long self, size_t b) {
+    if (atomic_load(&area->writers[b]) == self)
+        return 2;
+
+    unsigned long bit = 1UL << (b % RL_WORD_BITS);
+    atomic_ulong *word = &area->write_map[b / RL_WORD_BITS];
+    while (atomic_fetch_or(word, bit) & bit) {
+        if (!reap_block_writer(area, b))
+            return 0;
+    }
+    atomic_store(&area->writers[b], self);
+
+    unsigned int own = test_block_bit(own_map, b);
+    while (atomic_load(&area->readers[b]) > own) {
+        if (reap_block_holders(area, nb_blocks) == 0) {
+            atomic_store(&area->writers[b], 0);
+            atomic_fetch_and(word, ~bit);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Read-locks block `b` for `self`
+ * @param area the block area
+ * @param own_map the read bitmap of `self`
+ * @param self the packed owner
+ * @param b the block
+ * @return 1 if the block was locked, 2 if `self` already had it locked, 0 if
+ * it is write-locked by another owner
+ */
+static int rdlock_block(rl_block_area *area, atomic_ulong *own_map,
+        unsigned long long self, size_t b) {
+    if (test_block_bit(own_map, b) || atomic_load(&area->writers[b]) == self)
+        return 2;
+
+    unsigned long bit = 1UL << (b % RL_WORD_BITS);
+    for (;;) {
+        atomic_fetch_add(&area->readers[b], 1);
+        if (!(atomic_load(&area->write_map[b / RL_WORD_BITS]) & bit))
+            break;
+        atomic_fetch_sub(&area->readers[b], 1);
+        if (!reap_block_writer(area, b))
+            return 0;
+    }
+    atomic_fetch_or(&own_map[b / RL_WORD_BITS], bit);
+    return 1;
+}
+
+/**
+ * @brief Removes the read lock of `own_map` and the write lock of `self` on
+ * block `b`, if any
+ * @param area the block area
+ * @param own_map the read bitmap of `self`, NULL if it has none
+ * @param self the packed owner
+ * @param b the block
+ */
+static void unlock_block(rl_block_area *area, atomic_ulong *own_map,
+        unsigned long long self, size_t b) {
+    unsigned long bit = 1UL << (b % RL_WORD_BITS);
+    if (test_block_bit(own_map, b)) {
+        atomic_fetch_and(&own_map[b / RL_WORD_BITS], ~bit);
+        atomic_fetch_sub(&area->readers[b], 1);
+    }
+    unsigned long long writer = self;
+    if (atomic_compare_exchange_strong(&area->writers[b], &writer, 0))
+        atomic_fetch_and(&area->write_map[b / RL_WORD_BITS], ~bit);
+}
+
+/**
+ * @brief Applies `lck` on the blocks of a file created with `RL_ATTR_BLOCKS`
+ *
+ * No mutex is taken: every block is locked with atomic operations. The region
+ * must start and end on block boundaries. If a block of the region is locked
+ * by another owner, the blocks locked by this call are released and the call
+ * fails with EAGAIN. Converting a lock of `owner` from read to write or from
+ * write to read is done once every block of the region has been acquired.
+ *
+ * @param file the file on which to apply `lck`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return 0 on success, -1 on failure
+ */
+static int apply_block_lock(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    off_t start = lck->l_start;
+    size_t bs = file->block_size;
+    if (start % bs != 0 || lck->l_len % bs != 0
+            || (size_t) start / bs >= file->nb_blocks) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t first = start / bs;
+    size_t last = lck->l_len == 0 ? file->nb_blocks : first + lck->l_len / bs;
+    if (last > file->nb_blocks) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rl_block_area area;
+    get_block_area((char *) file + file->blocks_offset, file->nb_blocks,
+            &area);
+    size_t words = block_map_words(file->nb_blocks);
+    unsigned long long self = pack_owner(owner);
+    int holder = find_block_holder(&area, file->nb_blocks, self,
+            lck->l_type == F_RDLCK);
+    if (holder == -1 && lck->l_type == F_RDLCK) {
+        errno = ENOLCK;
+        return -1;
+    }
+    atomic_ulong *own_map = holder >= 0 ?
+        &area.holder_maps[holder * words] : NULL;
+
+    if (lck->l_type == F_UNLCK) {
+        for (size_t b = first; b < last; b++)
+            unlock_block(&area, own_map, self, b);
+        return 0;
+    }
+
+    /* remember which blocks this call locks in order to undo on conflict */
+    unsigned long stack_fresh[8] = {0};
+    unsigned long *fresh = stack_fresh;
+    if (last - first > 8 * RL_WORD_BITS) {
+        fresh = calloc(block_map_words(last - first), sizeof(unsigned long));
+        if (fresh == NULL)
+            return -1;
+    }
+
+    size_t b;
+    for (b = first; b < last; b++) {
+        int code = lck->l_type == F_WRLCK ?
+            wrlock_block(&area, file->nb_blocks, own_map, self, b)
+            : rdlock_block(&area, own_map, self, b);
+        if (code == 0)
+            break;
+        if (code == 1)
+            fresh[(b - first) / RL_WORD_BITS] |= 1UL << ((b - first) % RL_WORD_BITS);
+    }
+
+    int conflict = b < last;
+    for (size_t c = first; c < last; c++) {
+        int is_fresh = (fresh[(c - first) / RL_WORD_BITS]
+                >> ((c - first) % RL_WORD_BITS)) & 1UL;
+        if (conflict) {
+            if (c < b && is_fresh)
+                unlock_block(&area, own_map, self, c);
+        } else if (lck->l_type == F_WRLCK) {
+            /* drop the read lock the owner might have had on the block */
+            if (test_block_bit(own_map, c)) {
+                atomic_fetch_and(&own_map[c / RL_WORD_BITS],
+                        ~(1UL << (c % RL_WORD_BITS)));
+                atomic_fetch_sub(&area.readers[c], 1);
+            }
+        } else if (!is_fresh) {
+            /* the block was write-locked by the owner: convert it */
+            if (atomic_load(&area.writers[c]) == self) {
+                atomic_fetch_add(&area.readers[c], 1);
+                atomic_fetch_or(&own_map[c / RL_WORD_BITS],
+                        1UL << (c % RL_WORD_BITS));
+                unlock_block(&area, NULL, self, c);
+            }
+        }
+    }
+
+    if (fresh != stack_fresh)
+        free(fresh);
+    if (conflict) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Removes every block lock of `owner` and frees its holder slot
+ * @param file the file created with `RL_ATTR_BLOCKS`
+ * @param owner the owner whose locks are removed
+ */
+static void release_blocks(rl_open_file *file, rl_owner owner) {
+    rl_block_area area;
+    get_block_area((char *) file + file->blocks_offset, file->nb_blocks,
+            &area);
+    unsigned long long self = pack_owner(owner);
+    int holder = find_block_holder(&area, file->nb_blocks, self, 0);
+    atomic_ulong *own_map = holder >= 0 ?
+        &area.holder_maps[holder * block_map_words(file->nb_blocks)] : NULL;
+
+    for (size_t b = 0; b < file->nb_blocks; b++)
+        unlock_block(&area, own_map, self, b);
+    if (holder >= 0)
+        atomic_store(&area.holders[holder], 0);
+}
+
+/******************************************************************************/
+
+static void cancel_pending(rl_open_file *file, rl_owner owner);
+static void grant_pending(rl_open_file *file);
+static void remove_from_rla(rl_open_file *rlo);
+static int close_in_arena(rl_open_file *file);
+static void leave_chunk_pool(rl_open_file *file);
+
+/**
+ * @brief Closes the given locked file descriptor
+ *
+ * This function removes from each lock of the descripted open file the owner
+ * `{getpid(), lfd.fd}` if present. After deletion, the lock owners of each lock
+ * are reorganized, as each lock of the lock table of the open file description.
+ * The asynchronous requests of the descriptor are cancelled and the syncs
+ * batched by its I/O policy are done, a failure of which is reported once the
+ * descriptor is closed. The `close()` operation is made only if the previous
+ * operations are successful. A private lock space is freed with its last
+ * descriptor.
+ *
+ * @param lfd the locked file descriptor to close
+ * @return 0 if `lfd` was successfully closed, -1 on error
+ */
+int rl_close(rl_descriptor lfd) {
+    /* check descriptor validity */
+    if (lfd.fd < 0 || lfd.file == NULL)
+        return -1;
+
+    int flushed = rl_flush(lfd);
+    int flush_error = errno;
+    rl_set_policy(lfd, 0, 1);
+
+    /* take lock on open file */
+    if (lock_open_file(lfd.file) != 0)
+        return -1;
+
+    rl_fd_group *membership = find_membership(lfd.fd);
+    if (membership != NULL && leave_group(membership) < 0)
+        return -1;
+
+    rl_owner lfd_owner = {.pid = getpid(), .fd = lfd.fd};
+    if (lfd.file->flags & RL_ATTR_BLOCKS)
+        release_blocks(lfd.file, lfd_owner);
+    drop_fast_locks(lfd.file, equals, lfd_owner);
+    drop_intents(lfd.file, equals, lfd_owner);
+    drop_lease(lfd.file, lfd_owner);
+    cancel_pending(lfd.file, lfd_owner);
+    if (delete_owner_on_criteria(lfd.file, equals, lfd_owner) < 0)
+        return -1;
+
+    int private = lfd.file->flags & RL_PRIVATE_FILE;
+    int in_arena = lfd.file->flags & RL_ARENA_FILE;
+    char shm_name[256];
+    if (!private && !in_arena && (lfd.file->key[0] != '\0' ?
+                get_named_shm_name(lfd.file->key, shm_name)
+                : get_shm_name(lfd.fd, shm_name)))
+        return -1;
+
+    if (close(lfd.fd) == -1)
+        return -1;
+
+    if (map_decrement(lfd.file, getpid()))
+        return -1;
+
+    int unlink_shm = 1;
+    int new_nb_map_entries = lfd.file->nb_map_entries;
+    for (int i = 0; !private && i < lfd.file->nb_map_entries; i++) {
+        rl_pid_fd_count *entry = &get_pid_map(lfd.file)[i];
+        if (kill(entry->pid, 0) == -1 && errno == ESRCH) {
+            erase_map_entry(entry);
+            new_nb_map_entries--;
+        } else
+            unlink_shm = 0;
+    }
+    /* the pid_map of a private file only counts the descriptors */
+    if (private)
+        unlink_shm = lfd.file->nb_map_entries == 0;
+    else
+        lfd.file->nb_map_entries = new_nb_map_entries;
+    if (organize_map_entries(lfd.file))
+        return -1;
+    if (unlink_shm && !private && !in_arena)
+        leave_chunk_pool(lfd.file);
+
+    if (unlock_open_file(lfd.file) != 0)
+        return -1;
+    notify_release(lfd.file);
+    grant_pending(lfd.file);
+
+    if (unlink_shm && private) {
+        remove_from_rla(lfd.file);
+        free(lfd.file);
+    } else if (unlink_shm && in_arena) {
+        if (close_in_arena(lfd.file))
+            return -1;
+    } else if (unlink_shm) {
+        if (shm_unlink(shm_name))
+            return -1;
+    }
+
+    if (flushed == -1) {
+        errno = flush_error;
+        return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Initializes the library
+ * 
+ * You must call this function before using the library.
+ *
+ * @return always 0
+ */
+int rl_init_library() {
+    rla.nb_files = 0;
+    for (int i = 0; i < RL_MAX_FILES; i++)
+        rla.open_files[i] = RL_FREE_FILE;
+    rla.nb_policies = 0;
+    for (int i = 0; i < RL_MAX_FILES; i++)
+        rla.policies[i].fd = -1;
+    rla.nb_groups = 0;
+    for (int i = 0; i < RL_MAX_FILES; i++)
+        rla.groups[i].fd = -1;
+    return 0;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Adds the given open file to the open file descriptions of this process
+ * if it is not already there
+ *
+ * Fails if rla is full and rlo must be added
+ *
+ * @param rlo the open file to add
+ * @return 0 on success, -1 on error
+ */
+static int add_to_rla(rl_open_file *rlo) {
+    for (int i = 0; i < rla.nb_files; i++)
+        if (rla.open_files[i] == rlo)
+            return 0;
+
+    if (rla.nb_files >= RL_MAX_FILES)
+        return -1;
+
+    rla.open_files[rla.nb_files] = rlo;
+    rla.nb_files++;
+    return 0;
+}
+
+/**
+ * @brief Removes the given open file from the open file descriptions of this
+ * process
+ * @param rlo the open file to remove
+ */
+static void remove_from_rla(rl_open_file *rlo) {
+    for (int i = 0; i < rla.nb_files; i++) {
+        if (rla.open_files[i] == rlo) {
+            rla.nb_files--;
+            rla.open_files[i] = rla.open_files[rla.nb_files];
+            rla.open_files[rla.nb_files] = RL_FREE_FILE;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Places an area of `area_size` bytes, aligned on a cache line, after
+ * the `*size` bytes already laid out
+ * @param size the size laid out so far, increased by the area
+ * @param area_size the size of the area
+ * @return the offset of the area
+ */
+static size_t place_area(size_t *size, size_t area_size) {
+    size_t offset = (*size + 63) & ~(size_t) 63;
+    *size = offset + area_size;
+    return offset;
+}
+
+/**
+ * @brief Sets the offsets of the areas of `rlo`, created with the attributes
+ * `attr`
+ *
+ * The areas every request uses come right after the lock table, so that a
+ * file with a few locks and processes only uses the first pages of its object.
+ * The areas of the attributes the file is not created with are left out. The
+ * owners beyond the inline ones of the locks are in the shared pool of
+ * overflow chunks instead, see `rl_chunk_pool`.
+ *
+ * @param rlo the open file, only its offsets are written
+ * @param attr the attributes of the file, NULL for the default ones
+ * @return the size of the shared memory object
+ */
+static size_t lay_out_open_file(rl_open_file *rlo, const rl_file_attr *attr) {
+    int flags = attr != NULL ? attr->flags : 0;
+    int leases = attr != NULL && attr->lease_ns > 0;
+    size_t size = sizeof(rl_open_file) + RL_MAX_LOCKS * sizeof(rl_lock);
+    rlo->pid_map_offset = place_area(&size,
+            RL_MAX_MAP_ENTRIES * sizeof(rl_pid_fd_count));
+    rlo->mcs_nodes_offset = place_area(&size,
+            RL_MCS_NODES * sizeof(rl_mcs_node));
+    rlo->bias_slots_offset = flags & RL_ATTR_READER_BIAS ?
+        place_area(&size, RL_BIAS_SLOTS * sizeof(rl_fast_slot)) : 0;
+    rlo->requests_offset = flags & RL_ATTR_COMBINING ?
+        place_area(&size, RL_REQUEST_SLOTS * sizeof(rl_request_slot)) : 0;
+    rlo->readers_offset = flags & RL_ATTR_COUNTED_READERS ?
+        place_area(&size, RL_MAX_READERS * sizeof(rl_owner)) : 0;
+    rlo->reader_maps_offset = flags & RL_ATTR_COUNTED_READERS ?
+        place_area(&size, RL_MAX_LOCKS * RL_MAX_READERS / 8) : 0;
+    rlo->intents_offset = flags & RL_ATTR_INTENTS ?
+        place_area(&size, RL_MAX_INTENTS * sizeof(rl_intent)) : 0;
+    rlo->leases_offset = leases ?
+        place_area(&size, RL_MAX_LEASES * sizeof(rl_lease)) : 0;
+    rlo->pending_offset = flags & RL_ATTR_ASYNC ?
+        place_area(&size, RL_MAX_PENDING * sizeof(rl_pending_request)) : 0;
+    rlo->appends_offset = flags & RL_ATTR_APPENDS ?
+        place_area(&size, RL_MAX_APPENDS * sizeof(rl_append_slot)) : 0;
+    rlo->groups_offset = flags & RL_ATTR_GROUPS ?
+        place_area(&size, RL_MAX_GROUPS * sizeof(rl_group)) : 0;
+    rlo->blocks_offset = flags & RL_ATTR_BLOCKS ?
+        place_area(&size, get_block_area(NULL, attr->nb_blocks, NULL)) : 0;
+    rlo->cohorts_offset = 0;
+    if (flags & RL_ATTR_COHORT) {
+        rlo->cohorts_offset = round_to_page(size);
+        size = rlo->cohorts_offset
+            + RL_MAX_COHORTS * round_to_page(sizeof(rl_cohort));
+    }
+    return round_to_page(size);
+}
+
+/**
+ * @brief Computes the size of the shared memory object of a file created with
+ * the attributes `attr`, see `lay_out_open_file()`
+ * @param attr the attributes of the file, NULL for the default ones
+ * @return the size of the shared memory object, 0 if `attr` is invalid
+ */
+static size_t get_shm_size(const rl_file_attr *attr) {
+    if (attr != NULL) {
+        if (attr->escalation < 0 || attr->lease_ns < 0 || attr->quota < 0
+                || attr->group_quota < 0)
+            return 0;
+        /* the fast slots, and the leases they keep, are off with lease_ns */
+        if (attr->flags & RL_ATTR_LEASES && attr->lease_ns > 0)
+            return 0;
+        if (attr->flags & RL_ATTR_BLOCKS && (attr->block_size == 0
+                    || attr->nb_blocks == 0 || attr->flags & RL_ATTR_INTENTS
+                    || attr->lease_ns > 0))
+            return 0;
+    }
+    rl_open_file layout;
+    return lay_out_open_file(&layout, attr);
+}
+
+/**
+ * @brief Initializes the zeroed memory `rlo` of a new open file, created with
+ * the attributes `attr`
+ *
+ * The locks and the fast slots of zeroed memory are free, its lock groups are
+ * unused, and its block area has no readers, no writers. The areas of `rlo`
+ * are laid out by `lay_out_open_file()`, only those that exist are
+ * initialized.
+ *
+ * @param rlo the memory of the open file
+ * @param size the size of the memory
+ * @param extra_flags the internal flags of the file
+ * @param attr the attributes of the file, NULL for the default ones
+ * @param key the key of a named lock space, NULL for a file
+ * @param space the size of the lock space, 0 if unbounded
+ * @return 0 on success, -1 on error
+ */
+static int init_open_file(rl_open_file *rlo, size_t size, int extra_flags,
+        const rl_file_attr *attr, const char *key, off_t space) {
+    int flags = attr != NULL ? attr->flags : 0;
+    lay_out_open_file(rlo, attr);
+    rlo->block_size = 0;
+    rlo->nb_blocks = 0;
+    if (flags & RL_ATTR_BLOCKS) {
+        rlo->block_size = attr->block_size;
+        rlo->nb_blocks = attr->nb_blocks;
+    }
+    if (flags & RL_ATTR_COHORT)
+        bind_cohorts(rlo);
+    rlo->pool_id = 0;
+    rlo->chunks_offset = extra_flags & RL_PRIVATE_FILE ?
+        size - RL_OWNER_CHUNKS * sizeof(rl_owner_chunk) : 0;
+    rlo->chunk_map = 0;
+    rlo->flags = flags | extra_flags;
+    if (key != NULL)
+        strcpy(rlo->key, key);
+    rlo->space = space;
+    rlo->escalation = attr != NULL ? attr->escalation : 0;
+    rlo->lease_ns = attr != NULL ? attr->lease_ns : 0;
+    rlo->quota = attr != NULL ? attr->quota : 0;
+    rlo->group_quota = attr != NULL && attr->group_quota > 0 ?
+        attr->group_quota : rlo->quota;
+    if (lock_open_file(rlo))
+        return -1;
+
+    rlo->size = size;
+
+    rlo->nb_map_entries = 0;
+    for (int i = 0; i < RL_MAX_MAP_ENTRIES; i++)
+        erase_map_entry(&get_pid_map(rlo)[i]);
+
+    if (map_increment(rlo, getpid()))
+        return -1;
+
+    rlo->nb_locks = 0;
+    for (int i = 0; i < RL_MAX_LOCKS; i++) {
+        erase_lock(&rlo->lock_table[i]);
+        rlo->lock_table[i].overflow = 0;
+        for (int j = 0; j < RL_INLINE_OWNERS; j++)
+            erase_owner(&rlo->lock_table[i].lock_owners[j]);
+    }
+    for (int r = 0; flags & RL_ATTR_COUNTED_READERS && r < RL_MAX_READERS;
+            r++)
+        erase_owner(&get_readers(rlo)[r]);
+    for (int i = 0; flags & RL_ATTR_INTENTS && i < RL_MAX_INTENTS; i++) {
+        erase_owner(&get_intents(rlo)[i].owner);
+        get_intents(rlo)[i].mode = RL_MODE_NONE;
+    }
+    for (int l = 0; rlo->lease_ns > 0 && l < RL_MAX_LEASES; l++)
+        erase_owner(&get_leases(rlo)[l].owner);
+    atomic_store(&rlo->bias, rlo->flags & RL_ATTR_READER_BIAS ?
+            RL_BIAS_ON : RL_BIAS_OFF);
+    atomic_store(&rlo->bias_inhibit_until, 0);
+
+    if (unlock_open_file(rlo))
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Takes the lock `lock` of the arena or of the pool of chunks, which
+ * holds the PID of its holder
+ *
+ * The lock is taken over from a holder that died.
+ *
+ * @param lock the lock
+ */
+static void lock_by_pid(atomic_int *lock) {
+    pid_t pid = getpid();
+    for (;;) {
+        int holder = 0;
+        if (atomic_compare_exchange_strong(lock, &holder, pid))
+            return;
+        if (kill(holder, 0) == -1 && errno == ESRCH
+                && atomic_compare_exchange_strong(lock, &holder, pid))
+            return;
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Releases the lock `lock` taken with `lock_by_pid()`
+ * @param lock the lock
+ */
+static void unlock_by_pid(atomic_int *lock) {
+    atomic_store(lock, 0);
+}
+
+/**
+ * @brief Gets the open file in the slot `s` of `a`
+ * @param a the arena
+ * @param s the index of the slot
+ * @return the open file
+ */
+static rl_open_file *get_arena_file(rl_arena *a, int s) {
+    return (rl_open_file *) ((char *) a + a->slots_offset + s * a->slot_size);
+}
+
+/**
+ * @brief Gets the temporary name under which this process builds the object
+ * `name` before publishing it
+ * @param name the name of the object
+ * @param tmp_name the buffer for the temporary name, of NAME_MAX + 1 bytes
+ */
+static void get_tmp_name(const char *name, char *tmp_name) {
+    static atomic_uint seq = 0;
+    snprintf(tmp_name, NAME_MAX + 1, "%s.%d.%u", name, getpid(),
+            atomic_fetch_add(&seq, 1));
+}
+
+/**
+ * @brief Publishes the object built as `tmp_name` in `dir` under `name`
+ *
+ * The object is linked to `name` only if `name` does not exist: an object is
+ * found by other processes once it is fully initialized, and only one of the
+ * processes racing to create it wins. The temporary name is removed in any
+ * case.
+ *
+ * @param dir the directory of the objects
+ * @param tmp_name the temporary name of the object
+ * @param name the name to publish the object under
+ * @return 0 on success, -1 on error with errno set to EEXIST if `name` exists
+ */
+static int publish(const char *dir, const char *tmp_name, const char *name) {
+    char tmp_path[PATH_MAX], path[PATH_MAX];
+    snprintf(tmp_path, PATH_MAX, "%s%s", dir, tmp_name);
+    snprintf(path, PATH_MAX, "%s%s", dir, name);
+    int res = link(tmp_path, path);
+    int link_errno = errno;
+    unlink(tmp_path);
+    errno = link_errno;
+    return res;
+}
+
+/**
+ * @brief Maps the arena of huge pages or the pool of chunks open as `fd`
+ *
+ * The object is published once initialized, so that it is ready to be used.
+ *
+ * @param fd the descriptor of the object, closed by this function
+ * @return the mapping on success, NULL on error
+ */
+static void *map_published(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    void *a = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+            0);
+    close(fd);
+    return a == MAP_FAILED ? NULL : a;
+}
+
+/**
+ * @brief Unmaps the arena of huge pages `a` from this process
+ *
+ * The files of the arena are forgotten by this process, which no longer uses
+ * any of them.
+ *
+ * @param a the arena
+ */
+static void unmap_arena(rl_arena *a) {
+    for (int i = rla.nb_files - 1; i >= 0; i--) {
+        char *file = (char *) rla.open_files[i];
+        if (file >= (char *) a && file < (char *) a + a->size)
+            remove_from_rla(rla.open_files[i]);
+    }
+    munmap(a, a->size);
+}
+
+/**
+ * @brief Creates the arena of huge pages
+ *
+ * The arena is created in the hugetlbfs at `RL_HUGETLBFS_DIR` if there are
+ * huge pages for it, otherwise as a shared memory object whose pages are
+ * advised to be transparent huge pages. It is built under a temporary name,
+ * then published.
+ *
+ * @param size the size of the arena, a multiple of the huge page size
+ * @return the arena on success, NULL on error with errno set to EEXIST if
+ *         another process has just created it
+ */
+static rl_arena *create_arena(size_t size) {
+    char tmp_name[NAME_MAX + 1];
+    get_tmp_name(SHM_ARENA_NAME, tmp_name);
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, PATH_MAX, "%s%s", RL_HUGETLBFS_DIR, tmp_name);
+
+    rl_arena *a = MAP_FAILED;
+    int hugetlbfs = 1;
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_EXCL,
+            S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+    if (fd != -1) {
+        if (ftruncate(fd, size) == 0)
+            a = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        /* no huge page left: the arena is created as a shm instead */
+        if (a == MAP_FAILED)
+            unlink(tmp_path);
+    }
+
+    if (a == MAP_FAILED) {
+        hugetlbfs = 0;
+        fd = shm_open(tmp_name, O_RDWR | O_CREAT | O_EXCL,
+                S_IRWXU | S_IRWXG | S_IRWXO);
+        if (fd == -1)
+            return NULL;
+        if (ftruncate(fd, size) == 0)
+            a = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (a == MAP_FAILED) {
+            shm_unlink(tmp_name);
+            return NULL;
+        }
+        madvise(a, size, MADV_HUGEPAGE);
+    }
+
+    /* the slots of zeroed memory are free */
+    a->size = size;
+    a->slot_size = round_to_page(get_shm_size(NULL));
+    a->slots_offset = round_to_page(sizeof(rl_arena));
+    a->hugetlbfs = hugetlbfs;
+    if (publish(hugetlbfs ? RL_HUGETLBFS_DIR : RL_SHM_DIR, tmp_name,
+                SHM_ARENA_NAME) == -1) {
+        munmap(a, size);
+        return NULL;
+    }
+    return a;
+}
+
+/**
+ * @brief Gets the arena of huge pages, mapping it on first use, and takes the
+ * lock on its slots
+ *
+ * An arena that was removed once empty is unmapped, and the current one is
+ * mapped instead.
+ *
+ * @param create whether to create the arena if it does not exist
+ * @return the locked arena, NULL if it does not exist and could not be created
+ */
+static rl_arena *get_locked_arena(int create) {
+    for (;;) {
+        if (arena == NULL) {
+            int fd = open(RL_HUGETLBFS_DIR SHM_ARENA_NAME, O_RDWR);
+            if (fd == -1)
+                fd = shm_open(SHM_ARENA_NAME, O_RDWR, 0);
+            if (fd != -1)
+                arena = map_published(fd);
+            else if (!create)
+                return NULL;
+            else {
+                size_t size = round_to_page(sizeof(rl_arena))
+                    + RL_ARENA_SLOTS * round_to_page(get_shm_size(NULL));
+                size = (size + RL_HUGE_PAGE_SIZE - 1) / RL_HUGE_PAGE_SIZE
+                    * RL_HUGE_PAGE_SIZE;
+                arena = create_arena(size);
+                if (arena == NULL && errno == EEXIST)
+                    continue;
+            }
+            if (arena == NULL)
+                return NULL;
+        }
+
+        lock_by_pid(&arena->lock);
+        if (!arena->unlinked)
+            return arena;
+        unlock_by_pid(&arena->lock);
+        unmap_arena(arena);
+        arena = NULL;
+    }
+}
+
+/**
+ * @brief Publishes the marker which tells that the file standing for the
+ * shared memory object `shm_name` is held by the arena of huge pages
+ *
+ * The marker is a shared memory object named `shm_name` holding only the
+ * flags of an open file, with `RL_ARENA_FILE`.
+ *
+ * @param shm_name the name of the shared memory object of the file
+ * @return 0 on success, -1 on error with errno set to EEXIST if `shm_name`
+ *         exists
+ */
+static int publish_marker(const char *shm_name) {
+    char tmp_name[NAME_MAX + 1];
+    get_tmp_name(shm_name, tmp_name);
+    int fd = shm_open(tmp_name, O_RDWR | O_CREAT | O_EXCL,
+            S_IRWXU | S_IRWXG | S_IRWXO);
+    if (fd == -1)
+        return -1;
+    int flags = RL_ARENA_FILE;
+    int res = write(fd, &flags, sizeof(flags)) == sizeof(flags) ? 0 : -1;
+    close(fd);
+    if (res == -1) {
+        shm_unlink(tmp_name);
+        return -1;
+    }
+    return publish(RL_SHM_DIR, tmp_name, shm_name);
+}
+
+/**
+ * @brief Creates the file standing for the shared memory object `shm_name` in
+ * a slot of the arena of huge pages
+ * @param shm_name the name of the shared memory object of the file
+ * @param attr the attributes to create the file with
+ * @param key the key of a named lock space, NULL for a file
+ * @param space the size of the named lock space, 0 if unbounded
+ * @return the open file on success, NULL on error with errno set to EEXIST if
+ *         `shm_name` was created meanwhile
+ */
+static rl_open_file *create_in_arena(const char *shm_name,
+        const rl_file_attr *attr, const char *key, off_t space) {
+    if (strlen(shm_name) >= RL_SHM_NAME_MAX) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    rl_arena *a = get_locked_arena(1);
+    if (a == NULL)
+        return NULL;
+
+    rl_open_file *rlo = NULL;
+    int fd = shm_open(shm_name, O_RDONLY, 0);
+    if (fd != -1) {
+        close(fd);
+        errno = EEXIST;
+        goto out;
+    }
+
+    /* a slot still named after the file was left by a process that died */
+    int slot = -1;
+    for (int s = 0; s < RL_ARENA_SLOTS; s++) {
+        if (strcmp(a->slots[s].name, shm_name) == 0) {
+            slot = s;
+            break;
+        }
+        if (slot == -1 && a->slots[s].name[0] == '\0')
+            slot = s;
+    }
+    if (slot == -1) {
+        errno = ENOSPC;
+        goto out;
+    }
+
+    rlo = get_arena_file(a, slot);
+    memset(rlo, 0, a->slot_size);
+    if (init_open_file(rlo, a->slot_size, RL_ARENA_FILE, attr, key, space)) {
+        a->slots[slot].name[0] = '\0';
+        rlo = NULL;
+        goto out;
+    }
+    strcpy(a->slots[slot].name, shm_name);
+    if (publish_marker(shm_name) == -1) {
+        a->slots[slot].name[0] = '\0';
+        rlo = NULL;
+    }
+out:
+    unlock_by_pid(&a->lock);
+    return rlo;
+}
+
+/**
+ * @brief Opens the file standing for the shared memory object `shm_name` in
+ * the arena of huge pages, once its marker was found
+ *
+ * A marker which outlived its slot or the arena, after a crash, is removed.
+ *
+ * @param fd the descriptor of the marker, closed by this function
+ * @param shm_name the name of the shared memory object of the file
+ * @return the open file on success, NULL on error with errno set to ENOENT if
+ *         the file was closed meanwhile
+ */
+static rl_open_file *join_in_arena(int fd, const char *shm_name) {
+    rl_arena *a = get_locked_arena(0);
+    for (int s = 0; a != NULL && s < RL_ARENA_SLOTS; s++) {
+        if (strcmp(a->slots[s].name, shm_name) != 0)
+            continue;
+        close(fd);
+        rl_open_file *rlo = get_arena_file(a, s);
+        int res = -1;
+        if (lock_open_file(rlo) == 0) {
+            res = map_increment(rlo, getpid());
+            unlock_open_file(rlo);
+        }
+        unlock_by_pid(&a->lock);
+        return res == 0 ? rlo : NULL;
+    }
+
+    /* the marker of a file closed meanwhile is already unlinked */
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_nlink > 0)
+        shm_unlink(shm_name);
+    close(fd);
+    if (a != NULL)
+        unlock_by_pid(&a->lock);
+    errno = ENOENT;
+    return NULL;
+}
+
+/**
+ * @brief Gives the slot of `file` back to the arena of huge pages if no
+ * process uses it anymore
+ *
+ * The marker of the file is removed with its slot, and the arena is removed
+ * once all its slots are free.
+ *
+ * @param file the open file held by the arena
+ * @return 0 on success, -1 on error
+ */
+static int close_in_arena(rl_open_file *file) {
+    rl_arena *a = get_locked_arena(0);
+    if (a == NULL)
+        return -1;
+
+    int s = ((char *) file - (char *) a - a->slots_offset) / a->slot_size;
+    int res = -1;
+    if (lock_open_file(file) == 0) {
+        /* a process may have opened the file again meanwhile */
+        if (file->nb_map_entries == 0) {
+            leave_chunk_pool(file);
+            /* the marker first: a slot left named is reused */
+            shm_unlink(a->slots[s].name);
+            a->slots[s].name[0] = '\0';
+        }
+        res = unlock_open_file(file);
+    }
+
+    int empty = 1;
+    for (int i = 0; empty && i < RL_ARENA_SLOTS; i++)
+        empty = a->slots[i].name[0] == '\0';
+    if (empty) {
+        a->unlinked = 1;
+        if (a->hugetlbfs)
+            unlink(RL_HUGETLBFS_DIR SHM_ARENA_NAME);
+        else
+            shm_unlink(SHM_ARENA_NAME);
+    }
+    unlock_by_pid(&a->lock);
+    if (empty) {
+        unmap_arena(a);
+        arena = NULL;
+    }
+    return res;
+}
+
+/**
+ * @brief Creates the shared pool of overflow chunks
+ *
+ * The chunks of zeroed memory are free. The pool is built under a temporary
+ * name, then published.
+ *
+ * @return the pool on success, NULL on error with errno set to EEXIST if
+ *         another process has just created it
+ */
+static rl_chunk_pool *create_chunk_pool(void) {
+    char tmp_name[NAME_MAX + 1];
+    get_tmp_name(SHM_POOL_NAME, tmp_name);
+    int fd = shm_open(tmp_name, O_RDWR | O_CREAT | O_EXCL,
+            S_IRWXU | S_IRWXG | S_IRWXO);
+    if (fd == -1)
+        return NULL;
+
+    size_t offset = round_to_page(sizeof(rl_chunk_pool));
+    size_t size = offset + RL_POOL_CHUNKS * sizeof(rl_owner_chunk);
+    rl_chunk_pool *p = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(tmp_name);
+        return NULL;
+    }
+
+    /* the pools are removed and created in turn, at different times */
+    p->id = get_time_ns();
+    p->size = size;
+    p->chunks_offset = offset;
+    if (publish(RL_SHM_DIR, tmp_name, SHM_POOL_NAME) == -1) {
+        munmap(p, size);
+        return NULL;
+    }
+    return p;
+}
+
+/**
+ * @brief Gets the shared pool of overflow chunks, mapping it on first use, and
+ * takes the lock on its chunks
+ *
+ * A pool that was removed once unused is unmapped, and the current one is
+ * mapped instead.
+ *
+ * @param create whether to create the pool if it does not exist
+ * @return the locked pool, NULL if it does not exist and could not be created
+ */
+static rl_chunk_pool *get_locked_chunk_pool(int create) {
+    for (;;) {
+        if (chunk_pool == NULL) {
+            int fd = shm_open(SHM_POOL_NAME, O_RDWR, 0);
+            if (fd != -1)
+                chunk_pool = map_published(fd);
+            else if (!create)
+                return NULL;
+            else {
+                chunk_pool = create_chunk_pool();
+                if (chunk_pool == NULL && errno == EEXIST)
+                    continue;
+            }
+            if (chunk_pool == NULL)
+                return NULL;
+        }
+
+        lock_by_pid(&chunk_pool->lock);
+        if (!chunk_pool->unlinked)
+            return chunk_pool;
+        unlock_by_pid(&chunk_pool->lock);
+        munmap(chunk_pool, chunk_pool->size);
+        chunk_pool = NULL;
+    }
+}
+
+/**
+ * @brief Maps the shared pool of overflow chunks `file` draws from, unless it
+ * is mapped already
+ *
+ * A single pool is used at a time: the one mapped before by this process, if
+ * any, was removed once no file drew from it anymore. This function must be
+ * called with the mutex of `file` held.
+ *
+ * @param file the open file
+ * @return 0 on success, -1 on error with errno set to ENOENT if the pool was
+ *         removed from outside of the library
+ */
+static int attach_chunk_pool(rl_open_file *file) {
+    if (file->pool_id == 0
+            || (chunk_pool != NULL && chunk_pool->id == file->pool_id))
+        return 0;
+    if (chunk_pool != NULL) {
+        munmap(chunk_pool, chunk_pool->size);
+        chunk_pool = NULL;
+    }
+    rl_chunk_pool *p = get_locked_chunk_pool(0);
+    if (p == NULL)
+        return -1;
+    unlock_by_pid(&p->lock);
+    if (p->id != file->pool_id) {
+        errno = ENOENT;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Takes a free chunk of the shared pool of overflow chunks for `file`
+ *
+ * At its first chunk, `file` starts drawing from the current pool, which it
+ * keeps until it is removed, see `leave_chunk_pool()`. This function must be
+ * called with the mutex of `file` held.
+ *
+ * @param file the open file
+ * @return the index of the chunk, -1 if the pool is exhausted or could not be
+ *         mapped
+ */
+static int take_pool_chunk(rl_open_file *file) {
+    rl_chunk_pool *p = chunk_pool;
+    if (file->pool_id == 0) {
+        p = get_locked_chunk_pool(1);
+        if (p == NULL)
+            return -1;
+        p->nb_files++;
+        file->pool_id = p->id;
+    } else
+        lock_by_pid(&p->lock);
+
+    int chunk = -1;
+    for (int c = 0; chunk == -1 && c < RL_POOL_CHUNKS; c++) {
+        if (!(p->chunk_map[c / 64] & (1ULL << (c % 64)))) {
+            p->chunk_map[c / 64] |= 1ULL << (c % 64);
+            chunk = c;
+        }
+    }
+    unlock_by_pid(&p->lock);
+    return chunk;
+}
+
+/**
+ * @brief Gives the chunk `c` back to the shared pool of overflow chunks
+ * @param c the index of the chunk
+ */
+static void give_back_pool_chunk(int c) {
+    lock_by_pid(&chunk_pool->lock);
+    chunk_pool->chunk_map[c / 64] &= ~(1ULL << (c % 64));
+    unlock_by_pid(&chunk_pool->lock);
+}
+
+/**
+ * @brief Gives the chunks of `file` back to the shared pool of overflow chunks
+ * as the file is removed, and removes the pool once no file draws from it
+ *
+ * The locks left in `file` are those of dead processes: they keep their inline
+ * owners only. This function must be called with the mutex of `file` held.
+ *
+ * @param file the open file
+ */
+static void leave_chunk_pool(rl_open_file *file) {
+    if (file->pool_id == 0)
+        return;
+    rl_chunk_pool *p = chunk_pool;
+    lock_by_pid(&p->lock);
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *lck = &file->lock_table[i];
+        if (lck->overflow == 0)
+            continue;
+        int c = lck->overflow - 1;
+        p->chunk_map[c / 64] &= ~(1ULL << (c % 64));
+        lck->overflow = 0;
+        if (lck->nb_owners > RL_INLINE_OWNERS)
+            lck->nb_owners = RL_INLINE_OWNERS;
+    }
+    file->pool_id = 0;
+
+    int unused = --p->nb_files == 0;
+    if (unused) {
+        p->unlinked = 1;
+        shm_unlink(SHM_POOL_NAME);
+    }
+    unlock_by_pid(&p->lock);
+    if (unused) {
+        munmap(p, p->size);
+        chunk_pool = NULL;
+    }
+}
+
+/**
+ * @brief Maps the existing shared memory object open as `fd`
+ * @param fd the descriptor of the object, closed by this function
+ * @param shm_name the name of the object
+ * @return the projected `rl_open_file` on success, NULL on error with errno
+ *         set to ENOENT if the object is the marker of a file of the arena
+ *         closed meanwhile
+ */
+static rl_open_file *join_open_file(int fd, const char *shm_name) {
+    int flags;
+    struct stat st;
+    if (pread(fd, &flags, sizeof(flags), 0) != sizeof(flags)
+            || fstat(fd, &st) == -1) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    if (flags & RL_ARENA_FILE)
+        return join_in_arena(fd, shm_name);
+
+    rl_open_file *rlo = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (rlo == MAP_FAILED)
+        return NULL;
+
+    if (lock_open_file(rlo))
+        return NULL;
+
+    if (map_increment(rlo, getpid())) {
+        release_open_file(rlo);
+        return NULL;
+    }
+
+    if (unlock_open_file(rlo))
+        return NULL;
+    return rlo;
+}
+
+/**
+ * @brief Creates and initializes the shared memory object `shm_name`
+ *
+ * The file is created in the arena of huge pages if `attr` asks for
+ * `RL_ATTR_HUGE_PAGES` and its locks fit in a slot, otherwise the object is
+ * built under a temporary name and published.
+ *
+ * @param shm_name the name of the shared memory object
+ * @param size the size of the object
+ * @param attr the attributes to create the file with, NULL for the default ones
+ * @param key the key of a named lock space, NULL for a file
+ * @param space the size of the named lock space, 0 if unbounded
+ * @return the projected `rl_open_file` on success, NULL on error with errno set
+ *         to EEXIST if another process created the object meanwhile
+ */
+static rl_open_file *create_open_file(const char *shm_name, size_t size,
+        const rl_file_attr *attr, const char *key, off_t space) {
+    if (attr != NULL && attr->flags & RL_ATTR_HUGE_PAGES
+            && size <= round_to_page(get_shm_size(NULL))) {
+        rl_open_file *rlo = create_in_arena(shm_name, attr, key, space);
+        /* a full arena falls back to a shared memory object */
+        if (rlo != NULL || errno == EEXIST)
+            return rlo;
+    }
+
+    char tmp_name[NAME_MAX + 1];
+    get_tmp_name(shm_name, tmp_name);
+    int shm_res = shm_open(tmp_name, O_RDWR | O_CREAT | O_EXCL,
+            S_IRWXU | S_IRWXG | S_IRWXO);
+    if (shm_res == -1)
+        return NULL;
+
+    int trunc_res = ftruncate(shm_res, size);
+    if (trunc_res == -1) {
+        close(shm_res);
+    error:
+        shm_unlink(tmp_name);
+        return NULL;
+    }
+
+    rl_open_file *rlo = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            shm_res, 0);
+    close(shm_res);
+    if (rlo == MAP_FAILED)
+        goto error;
+
+    /* the object is zeroed by ftruncate() */
+    if (init_open_file(rlo, size, 0, attr, key, space)) {
+        munmap(rlo, size);
+        goto error;
+    }
+
+    if (publish(RL_SHM_DIR, tmp_name, shm_name) == -1) {
+        munmap(rlo, size);
+        return NULL;
+    }
+    return rlo;
+}
+
+/**
+ * @brief Does the memory projection of the shared memory object `shm_name`,
+ * creating and initializing it with the attributes `attr` if it doesn't exist
+ *
+ * Objects are published once initialized: the process which loses the race
+ * to create one opens the object of the winner instead.
+ *
+ * @param shm_name the name of the shared memory object
+ * @param attr the attributes to create the file with, NULL for the default ones
+ * @param key the key of a named lock space, NULL for a file
+ * @param space the size of the named lock space, 0 if unbounded
+ * @return the projected `rl_open_file` on success, NULL on error
+ */
+static rl_open_file *map_open_file(const char *shm_name,
+        const rl_file_attr *attr, const char *key, off_t space) {
+    size_t size = get_shm_size(attr);
+    if (size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (;;) {
+        rl_open_file *rlo;
+        int shm_res = shm_open(shm_name, O_RDWR, 0);
+        if (shm_res >= 0) {
+            rlo = join_open_file(shm_res, shm_name);
+            if (rlo != NULL || errno != ENOENT)
+                return rlo;
+        } else if (errno != ENOENT)
+            return NULL;
+        else {
+            rlo = create_open_file(shm_name, size, attr, key, space);
+            if (rlo != NULL || errno != EEXIST)
+                return rlo;
+        }
+    }
+}
+
+/**
+ * @brief Opens the file at the given path with the given attributes
+ *
+ * See `rl_open()` and `rl_open_attr()`.
+ *
+ * @param path the relative or absolute path to the file
+ * @param oflag the flags passed to `open()`
+ * @param mode the mode passed to `open()`, only used with O_CREAT
+ * @param attr the attributes of the file, NULL for the default ones
+ * @return the rl_descriptor of the open file, or an rl_descriptor containing
+ *         fd -1 and rl_open_file pointer NULL on error
+ */
+static rl_descriptor open_with_attr(const char *path, int oflag, mode_t mode,
+        const rl_file_attr *attr) {
+    rl_descriptor err_desc = {.fd = -1, .file = NULL};
+
+    if (rla.nb_files >= RL_MAX_FILES) {
+        errno = EMFILE;
+        return err_desc;
+    }
+
+    int open_res;
+    if (oflag & O_CREAT)
+        open_res = open(path, oflag, mode);
+    else
+        open_res = open(path, oflag);
+
+    if (open_res == -1)
+        return err_desc;
+
+    char shm_path[256];
+    if (get_shm_name(open_res, shm_path)) {
+        close(open_res);
+        return err_desc;
+    }
+
+    rl_open_file *rlo = map_open_file(shm_path, attr, NULL, 0);
+    if (rlo == NULL || add_to_rla(rlo) == -1) {
+        close(open_res);
+        return err_desc;
+    }
+    /* the appends restart from the new end of the file */
+    if (oflag & O_TRUNC)
+        atomic_store(&rlo->append_init, 0);
+
+    rl_descriptor desc = {.fd = open_res, .file = rlo};
+    return desc;
+}
+
+/**
+ * @brief Opens the file at the given path
+ *
+ * Opens `path` with the open() system call (identical parameters). Also does
+ * the memory projection of the `rl_open_file` associated with the file at path,
+ * creating the shared memory object if it doesn't exist. Returns the
+ * corresponding `rl_descriptor`.
+ *
+ * @param path the relative or absolute path to the file
+ * @param oflag the flags passed to `open()`
+ * @param ... the mode (permissions) for the new file, required if O_CREAT flag
+ *            is specified
+ * @return the rl_descriptor containing the file descriptor returned by open()
+ *         and a pointer to the rl_open_file associated to the file, or an
+ *         rl_descriptor containing fd -1 and rl_open_file pointer NULL on error
+ */
+rl_descriptor rl_open(const char *path, int oflag, ...) {
+    mode_t mode = 0;
+    if (oflag & O_CREAT) {
+        va_list va;
+        va_start(va, oflag);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+    return open_with_attr(path, oflag, mode, NULL);
+}
+
+/**
+ * @brief Opens the file at the given path, choosing the representation of its
+ * locks
+ *
+ * Behaves like `rl_open()`. If the shared memory object of the file does not
+ * exist yet, it is created with the attributes `attr`, otherwise `attr` is
+ * ignored. With `RL_ATTR_BLOCKS`, the file is seen as an array of
+ * `attr->nb_blocks` blocks of `attr->block_size` bytes: locks must then cover
+ * whole blocks and are taken with atomic operations on per-block reader counts
+ * and a writer bitmap instead of the lock table. Block locks belong to the
+ * descriptor that took them: they are neither shared with its duplicates nor
+ * inherited by the children of `rl_fork()`.
+ *
+ * With `RL_ATTR_LEASES`, unlocking a region locked without contention only
+ * releases it locally: the owner keeps a lease on it and locking it again
+ * with the same type costs a single atomic operation. A lease is revoked as
+ * soon as another request conflicts with it. This flag has no effect with
+ * `RL_ATTR_BLOCKS`, and can't be combined with a positive `attr->lease_ns`,
+ * which takes every request through the lock table: `rl_open_attr()` then
+ * fails with EINVAL.
+ *
+ * With `RL_ATTR_COUNTED_READERS`, the owners of read locks are counted in a
+ * bitmap instead of being listed, so that a read lock can have up to
+ * `RL_MAX_READERS` owners.
+ *
+ * With `RL_ATTR_READER_BIAS`, read locks are granted in hashed biased slots
+ * without looking at any other lock as long as no write lock is requested.
+ * A write request revokes the bias, which then stays off for a while.
+ *
+ * With `RL_ATTR_COHORT`, the exclusive lock on the open file is a cohort lock:
+ * it is handed over to the waiters running on the same NUMA node in batches
+ * before going to the other nodes.
+ *
+ * With `RL_ATTR_COMBINING`, a request that needs the mutex of the open file is
+ * posted for its holder, which applies all the posted requests in one pass.
+ *
+ * With `RL_ATTR_HUGE_PAGES`, the open file is put in a slot of an arena of huge
+ * pages shared by all the processes, so that the locks of many files take a
+ * few TLB entries. The flag is ignored with `RL_ATTR_BLOCKS`, with
+ * `RL_ATTR_COHORT`, when the other attributes make the open file larger than
+ * a slot, or once the arena is full. The arena is removed once all the files
+ * it holds are closed.
+ *
+ * @param path the relative or absolute path to the file
+ * @param oflag the flags passed to `open()`
+ * @param attr the attributes of the file, NULL for the default ones
+ * @param ... the mode (permissions) for the new file, required if O_CREAT flag
+ *            is specified
+ * @return the rl_descriptor of the open file, or an rl_descriptor containing
+ *         fd -1 and rl_open_file pointer NULL on error
+ */
+rl_descriptor rl_open_attr(const char *path, int oflag,
+        const rl_file_attr *attr, ...) {
+    mode_t mode = 0;
+    if (oflag & O_CREAT) {
+        va_list va;
+        va_start(va, attr);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+    return open_with_attr(path, oflag, mode, attr);
+}
+
+/**
+ * @brief Opens the named lock space `key`, which has no backing file
+ *
+ * A named lock space is locked with the same functions as a file, its offsets
+ * being keys of a logical space rather than bytes. If it does not exist yet,
+ * it is created with `space` keys, otherwise `space` is ignored. Locks must
+ * stay within the space, and can be relative to its end with `SEEK_END`, but
+ * not to a current offset. The descriptor refers to the shared memory object
+ * of the space: it can't be used for I/O, nor for append reservations.
+ *
+ * @param key the key of the space, without '/' and shorter than
+ *            `RL_MAX_KEY`
+ * @param space the number of keys of the space, 0 for an unbounded space
+ * @return the rl_descriptor of the space, or an rl_descriptor containing fd -1
+ *         and rl_open_file pointer NULL on error
+ */
+rl_descriptor rl_open_named(const char *key, size_t space) {
+    return rl_open_named_attr(key, space, NULL);
+}
+
+/**
+ * @brief Opens the named lock space `key`, choosing the representation of
+ * its locks
+ *
+ * Behaves like `rl_open_named()`, `attr` is used like in `rl_open_attr()`.
+ *
+ * @param key the key of the space
+ * @param space the number of keys of the space, 0 for an unbounded space
+ * @param attr the attributes to create the space with, NULL for the default
+ *             ones
+ * @return the rl_descriptor of the space, or an rl_descriptor containing fd -1
+ *         and rl_open_file pointer NULL on error
+ */
+rl_descriptor rl_open_named_attr(const char *key, size_t space,
+        const rl_file_attr *attr) {
+    rl_descriptor err_desc = {.fd = -1, .file = NULL};
+
+    if (key == NULL || key[0] == '\0' || strlen(key) >= RL_MAX_KEY
+            || strchr(key, '/') != NULL || (off_t) space < 0) {
+        errno = EINVAL;
+        return err_desc;
+    }
+    if (rla.nb_files >= RL_MAX_FILES) {
+        errno = EMFILE;
+        return err_desc;
+    }
+
+    char shm_path[256];
+    if (get_named_shm_name(key, shm_path))
+        return err_desc;
+    rl_open_file *rlo = map_open_file(shm_path, attr, key, space);
+    if (rlo == NULL)
+        return err_desc;
+
+    /* the descriptor of the shm identifies the owners of the space, or a
+     * descriptor of no file if the space is held by the arena */
+    int fd = rlo->flags & RL_ARENA_FILE ? eventfd(0, EFD_CLOEXEC)
+        : shm_open(shm_path, O_RDWR, 0);
+    if (fd == -1)
+        return err_desc;
+    if (add_to_rla(rlo) == -1) {
+        close(fd);
+        return err_desc;
+    }
+
+    rl_descriptor desc = {.fd = fd, .file = rlo};
+    return desc;
+}
+
+/**
+ * @brief Opens a lock space private to the calling process
+ *
+ * The open file lives in the memory of the process instead of a shared memory
+ * object, so that its mutex is private and the liveness of the owners is never
+ * probed: its locks can only be shared by the threads of the process, each of
+ * which should lock through its own duplicate of the descriptor, see
+ * `rl_dup()`. Apart from that, the space behaves like a named lock space of
+ * `space` keys created with the attributes `attr`, see `rl_open_named()`. It
+ * is freed when its last descriptor is closed, and is not inherited by the
+ * children of `rl_fork()`.
+ *
+ * @param space the number of keys of the space, 0 for an unbounded space
+ * @param attr the attributes of the space, NULL for the default ones
+ * @return the rl_descriptor of the space, or an rl_descriptor containing fd -1
+ *         and rl_open_file pointer NULL on error
+ */
+rl_descriptor rl_open_private(size_t space, const rl_file_attr *attr) {
+    rl_descriptor err_desc = {.fd = -1, .file = NULL};
+
+    size_t size = get_shm_size(attr);
+    if (size == 0 || (off_t) space < 0) {
+        errno = EINVAL;
+        return err_desc;
+    }
+    if (rla.nb_files >= RL_MAX_FILES) {
+        errno = EMFILE;
+        return err_desc;
+    }
+
+    /* the cohorts are laid out on page boundaries, the overflow chunks of the
+     * space end it */
+    size = round_to_page(size + RL_OWNER_CHUNKS * sizeof(rl_owner_chunk));
+    rl_open_file *rlo = aligned_alloc(sysconf(_SC_PAGESIZE), size);
+    if (rlo == NULL)
+        return err_desc;
+    memset(rlo, 0, size);
+
+    /* a descriptor of no file identifies the owners of the space */
+    int fd = eventfd(0, EFD_CLOEXEC);
+    if (fd == -1) {
+        free(rlo);
+        return err_desc;
+    }
+    if (init_open_file(rlo, size, RL_PRIVATE_FILE, attr, NULL, space)
+            || add_to_rla(rlo) == -1) {
+        close(fd);
+        free(rlo);
+        return err_desc;
+    }
+
+    rl_descriptor desc = {.fd = fd, .file = rlo};
+    return desc;
+}
+
+/**
+ * @brief Checks if the segment [s1, s1 + l1[ and [s2, s2 + l2[ overlap
+ *
+ * If l1 or l2 equal 0, the segment is extensible, which would make the segment
+ * as follows: [s*, inf[
+ *
+ * @param s1 the start of the first segment
+ * @param l1 the length of the first segment, 0 if extensible
+ * @param s2 the start of the second segment
+ * @param l2 the length of the second segment, 0 if extensible
+ * @return 1 if the segments overlap, 0 otherwise
+ */
+static int seg_overlap(off_t s1, off_t l1, off_t s2, off_t l2) {
+    if (l1 == 0)
+        return (l2 == 0) || (l2 > 0 && s2 + l2 - 1 >= s1);
+
+    if (s2 >= s1)
+        return s2 < s1 + l1;
+    else
+        return l2 == 0 || s2 + l2 > s1;
+}
+
+/**
+ * @brief Checks if the lock is owned by an rl_owner different than owner
+ * 
+ * This function does not use any locking mechanism to secure the access to
+ * lock, nor tests if owner is in fact an owner of lock.
+ * 
+ * @param file the file that contains the lock
+ * @param lock the lock to check
+ * @param owner the owner to compare the lock owners with
+ * @param other where to put the first different owner found
+ * @return 1 if the lock is owned by a different owner, 0 otherwise
+ */
+static int has_different_owner(const rl_open_file *file, const rl_lock *lock,
+        rl_owner owner, rl_owner *other) {
+    if (has_reader_map(file, lock)) {
+        for (int r = 0; r < RL_MAX_READERS; r++) {
+            if (test_reader(file, lock, r)
+                    && !equals(get_readers(file)[r], owner)) {
+                *other = get_readers(file)[r];
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < get_owner_capacity(lock); i++) {
+        rl_owner cur = *get_lock_owner(file, lock, i);
+        if (!is_owner_free(&cur)) {
+            if (!equals(cur, owner)) {
+                *other = cur;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks if a request of type `type` conflicts with `lock`, held by
+ * another owner
+ * @param lock the held lock
+ * @param type the type of the request, F_RDLCK, RL_UPDLCK or F_WRLCK
+ * @return 1 if they conflict, 0 otherwise
+ */
+static int types_conflict(const rl_lock *lock, short type) {
+    if (lock->type == F_WRLCK || type == F_WRLCK)
+        return 1;
+    if (type == RL_UPDLCK)
+        return lock->type == RL_UPDLCK;
+    return lock->upgrading;
+}
+
+/**
+ * @brief Computes the starting offset of the lock of the file denoted by fd.
+ * @param lck a lock on a region
+ * @param fd the file descriptor of the file to lock
+ * @return the starting offset of the region or -1 if it could not be determined
+ */
+static off_t get_start(struct flock *lck, int fd) {
+    if (lck == NULL)
+        return -1;
+
+    if (lck->l_whence == SEEK_SET) {
+        if (lck->l_start >= 0)
+            return lck->l_start;
+        else
+            return -1; // before beginning of file !
+    } else if (lck->l_whence == SEEK_CUR || lck->l_whence == SEEK_END) {
+        off_t cur = lseek(fd, 0, SEEK_CUR); // current offset
+        if (cur == -1)
+            return -1;
+        off_t pos = lseek(fd, lck->l_start, lck->l_whence); // lock offset
+        if (pos == -1)
+            return -1;
+        if (lseek(fd, cur, SEEK_SET) == -1)
+            return -1;
+        return pos;
+    }
+    return -1;
+}
+
+/**
+ * @brief Checks if the given lock can be put on the given file by `lfd_owner`
+ * 
+ * This function only checks for conflicting locks, it doesn't verify if the
+ * lock table is big enough for the new locks. This is done in other functions.
+ * This function does not use any locking mechanism, so be sure to take the lock
+ * before entering this function in order to verify mutual exclusion.
+ *
+ * @param lck the lock to put, relative to the beginning of the file
+ * @param file the file on which to put the lock
+ * @param lfd_owner the owner of the lock
+ * With `RL_ATTR_INTENTS`, the file-level mode of `lfd_owner` must allow the
+ * lock. When its mode excludes all the conflicting locks of other owners, the
+ * lock is applicable without looking at the lock table.
+ *
+ * @return 1 if the lock is applicable, 0 if it is not, -1 if an error occured,
+ * with errno set to EPERM if the mode of `lfd_owner` doesn't allow the lock.
+ * If the lock is not applicable because of a lock put by a process that has
+ * died and has not removed its locks, returns the pid of that process.
+ */
+static pid_t is_lock_applicable(struct flock *lck, rl_open_file *file,
+        rl_owner lfd_owner) {
+    if (lck == NULL || file == NULL)
+        return -1;
+
+    off_t start = lck->l_start;
+    if (lck->l_type == F_UNLCK)
+        return 1;
+
+    if (file->flags & RL_ATTR_INTENTS) {
+        int mode = get_mode(file, lfd_owner);
+        if (!mode_covers(mode, lck->l_type)) {
+            errno = EPERM;
+            return -1;
+        }
+        /* the other owners hold at most read locks, or no lock at all */
+        if (mode == RL_MODE_X || (lck->l_type == F_RDLCK
+                    && (mode == RL_MODE_S || mode == RL_MODE_SIX)))
+            return 1;
+    }
+
+    if (file->nb_locks < 0 || file->nb_locks > RL_MAX_LOCKS)
+        return -1;
+
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+
+        /* if locks overlap check for conflicts */
+        if (seg_overlap(cur->start, cur->len, start, lck->l_len)) {
+            rl_owner other;
+            if (types_conflict(cur, lck->l_type)
+                    && has_different_owner(file, cur, lfd_owner, &other)) {
+                /* check if owner is still alive */
+                if (!is_owner_dead(file, other)) {
+                    if (!is_lease_expired(file, other))
+                        return 0;
+                    /* the owner is hung, its locks are revoked */
+                    if (revoke_owner(file, other) == -1)
+                        return -1;
+                } else if (!is_group_owner(other))
+                    return other.pid;
+                /* all the members of the group have died */
+                else if (release_group(file, other) == -1)
+                    return -1;
+                i = -1;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks if `mode` can be held on `file` by `lfd_owner`
+ *
+ * Only the counters of the modes are read, unless a conflicting mode is held,
+ * in which case its holders are searched for a dead process. This function
+ * does not use any locking mechanism, take the mutex of `file` before.
+ *
+ * @param file the file created with `RL_ATTR_INTENTS`
+ * @param lfd_owner the owner that requests `mode`
+ * @param mode the `RL_MODE_*` mode
+ * @return 1 if the mode can be held, 0 if it can't. If it can't because of a
+ * mode held by a process that has died, returns the pid of that process.
+ */
+static pid_t is_mode_applicable(rl_open_file *file, rl_owner lfd_owner,
+        int mode) {
+    int own = get_mode(file, lfd_owner);
+    for (int m = 0; m < RL_NB_MODES; m++) {
+        if (rl_compatible[mode][m] || file->nb_modes[m] - (m == own) == 0)
+            continue;
+
+        int released = 0;
+        for (int i = 0; !released && i < RL_MAX_INTENTS; i++) {
+            rl_intent *other = &get_intents(file)[i];
+            if (other->mode != m || equals(other->owner, lfd_owner)
+                    || !is_owner_dead(file, other->owner))
+                continue;
+            if (!is_group_owner(other->owner))
+                return other->owner.pid;
+            /* all the members of the group have died */
+            released = release_group(file, other->owner) == 0;
+        }
+        if (!released)
+            return 0;
+        m = -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks if `ol` and `or` have the same PID
+ * @param ol the left owner
+ * @param or the right owner
+ * @return 1 if `ol` and `or` have the same PID, 0 otherwise
+ */
+static int same_pid(rl_owner ol, rl_owner or) {
+    return ol.pid == or.pid;
+}
+
+/**
+ * @brief Removes the locks owned by the process of given PID in the given
+ * rl_open_file
+ *
+ * This function does not use any locking mechanism, be sure that mutual
+ * exclusion is assured before using it. If after removal a lock is empty, it is
+ * also deleted. The owners of every modified lock are reorganized, so as the
+ * locks of the file.
+ *
+ * @param pid the PID of the process that owns the locks to remove
+ * @param file the file that contains the locks to remove
+ * @return 0 on success, -1 on error
+ */
+static int remove_locks_of(pid_t pid, rl_open_file *file) {
+    if (pid <= 0 || file == NULL || file->nb_locks < 0
+            || file->nb_locks > RL_MAX_LOCKS)
+        return -1;
+
+    rl_owner cmp = {.pid = pid, .fd = 0};
+    if (delete_owner_on_criteria(file, same_pid, cmp) < 0)
+        return -1;
+    if (file->flags & RL_ATTR_INTENTS)
+        drop_intents(file, same_pid, cmp);
+    return 0;
+}
+
+/**
+ * @brief Adds `new` to the owners table of `lck` if possible
+ *
+ * If the owners of `lck` are counted, `new` is registered as a reader of
+ * `file` and counted in the reader map of `lck` instead.
+ *
+ * @param file the file that contains `lck`
+ * @param new the owner to add
+ * @param lck the lock to which to add the new owner
+ * @return 0 if `new` was succesfully added, -1 if it could not be added
+ */
+static int add_owner(rl_open_file *file, rl_owner new, rl_lock *lck) {
+    if ((new.pid < 0 && !is_group_owner(new)) || new.fd < 0 || lck == NULL)
+        return -1;
+
+    if (has_reader_map(file, lck)) {
+        int r = find_reader(file, new, 1);
+        if (r == -1)
+            return -1;
+        set_reader(file, lck, r, 1);
+        return 0;
+    }
+
+    if (lck->nb_owners < 0 || lck->nb_owners + 1 > RL_MAX_OWNERS)
+        return -1;
+    if (lck->nb_owners == get_owner_capacity(lck) && take_chunk(file, lck))
+        return -1;
+    *get_lock_owner(file, lck, lck->nb_owners) = new;
+    lck->nb_owners++;
+    return 0;
+}
+
+/**
+ * @brief Removes `owner` from the owners of `lck`
+ * @param file the file that contains `lck`
+ * @param owner the owner to remove
+ * @param lck the lock from which to remove `owner`
+ * @return the number of owners left, -1 on error
+ */
+static int remove_owner(rl_open_file *file, rl_owner owner, rl_lock *lck) {
+    if (has_reader_map(file, lck)) {
+        int r = find_reader(file, owner, 0);
+        if (r != -1)
+            set_reader(file, lck, r, 0);
+    } else {
+        size_t nb_owners = lck->nb_owners;
+        for (int j = 0; j < lck->nb_owners; j++) {
+            if (equals(owner, *get_lock_owner(file, lck, j))) {
+                erase_owner(get_lock_owner(file, lck, j));
+                nb_owners--;
+            }
+        }
+        lck->nb_owners = nb_owners;
+        if (organize_owners(file, lck) == -1)
+            return -1;
+    }
+    return lck->nb_owners + lck->nb_readers;
+}
+
+/**
+ * @brief Checks if `owner` is an owner of `lck`
+ * @param file the file that contains `lck`
+ * @param owner the owner that might own `lck`
+ * @param lck the lock that might be owned by `owner`
+ * @return 1 if `owner` is an owner of `lck`, 0 if it is not
+ */
+static int is_owner_of(rl_open_file *file, rl_owner owner, rl_lock *lck) {
+    if (has_reader_map(file, lck)) {
+        int r = find_reader(file, owner, 0);
+        return r != -1 && test_reader(file, lck, r);
+    }
+
+    for (int i = 0; i < lck->nb_owners; i++) {
+        if (equals(owner, *get_lock_owner(file, lck, i)))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds `new` to the locks of `file` if possible, where `first` is the
+ * initial owner of `new`
+ *
+ * This function should be use when `new` is not already a lock of `file`. The
+ * owners that might be stored in `new` are erased.
+ *
+ * @param new the lock to add
+ * @param file the file in which to add `new`
+ * @param first the initial owner of `new`
+ */
+static int add_lock(rl_lock *new, rl_open_file *file, rl_owner first) {
+    if (new == NULL || file == NULL || file->nb_locks + 1 > RL_MAX_LOCKS)
+        return -1;
+    file->lock_table[file->nb_locks] = *new;
+    rl_lock *tmp = &file->lock_table[file->nb_locks];
+    tmp->upgrading = 0;
+    tmp->overflow = 0;
+    for (int i = 0; i < RL_INLINE_OWNERS; i++)
+        erase_owner(&tmp->lock_owners[i]);
+    if (file->flags & RL_ATTR_COUNTED_READERS)
+        memset(get_reader_map(file, tmp), 0, RL_MAX_READERS / 8);
+    file->nb_locks++;
+    tmp->nb_owners = 0;
+    tmp->nb_readers = 0;
+    if (add_owner(file, first, tmp) == -1)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Gets the lock in `file` that starts at the same offset, has the same
+ * length and is of the same type than `lck`
+ * @param file the file that might contain `lck`
+ * @param lck the lock to find in `file`
+ * @return A pointer to the corresponding lock in file or NULL if it was not
+ * found
+ */
+static rl_lock *find_lock(rl_open_file *file, rl_lock *lck) {
+    if (file == NULL || lck == NULL)
+        return NULL;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *tmp = &file->lock_table[i];
+        if (tmp->start == lck->start && tmp->len == lck->len
+                && tmp->type == lck->type)
+            return tmp;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks if (s2, l2) is strictly in the middle of (s1, l1)
+ * @param s1 the start of the first segment
+ * @param l1 the length of the first segment, 0 if extensible
+ * @param s2 the start of the second segment
+ * @param l2 the length of the second segment, 0 if extensible
+ * @return 1 if (s2, l2) is strictly in the middle of (s1, l1), 0 otherwise
+ */
+static int strictly_in_middle(off_t s1, off_t l1, off_t s2, off_t l2) {
+    return l2 > 0 && s1 < s2 && (l1 == 0 || s1 + l1 > s2 + l2);
+}
+
+/**
+ * @brief Checks if (s2, l2) covers entirely (s1, l1)
+ * @param s1 the start of the first segment
+ * @param l1 the length of the first segment, 0 if extensible
+ * @param s2 the start of the second segment
+ * @param l2 the length of the second segment, 0 if extensible
+ * @return 1 if (s2, l2) covers entirely (s1, l1), 0 otherwise
+ */
+static int covers_entirely(off_t s1, off_t l1, off_t s2, off_t l2) {
+    return (l1 > 0 && l2 > 0 && s1 >= s2 && s1 + l1 <= s2 + l2)
+        || (l2 == 0 && s2 <= s1);
+}
+
+/**
+ * @brief Checks if (s2, l2) covers the end of (s1, l1)
+ *
+ * (s2, l2) must start strictly after (s1, l1) and may end at the same byte or
+ * after.
+ *
+ * @param s1 the start of the first segment
+ * @param l1 the length of the first segment, 0 if extensible
+ * @param s2 the start of the second segment
+ * @param l2 the length of the second segment, 0 if extensible
+ * @return 1 if (s2, l2) covers the end of (s1, l1), 0 otherwise
+ */
+static int covers_end(off_t s1, off_t l1, off_t s2, off_t l2) {
+    return (l1 > 0 && l2 > 0 && s1 < s2 && s1 + l1 <= s2 + l2)
+        || (l2 == 0 && s1 < s2);
+}
+
+/**
+ * @brief Unlocks for `lfd_owner` the region delimited by `lck` of `file`
+ *
+ * `lck` must be of type `F_UNLCK` and must be relative to the beginning of the
+ * file (`SEEK_SET`). This function does not use any locking mechanism, ensure
+ * mutual exclusion before the call.
+ *
+ * @param file the file to unlock
+ * @param lfd_owner the owner whose locks are removed
+ * @param lck the region to unlock
+ * @return 0 on success, -1 on error
+ */
+static int apply_unlock(rl_open_file *file, rl_owner lfd_owner,
+        struct flock *lck) {
+    if (file == NULL || lck == NULL)
+        return -1;
+
+    off_t lck_start = lck->l_start;
+    int nb_locks = file->nb_locks;
+    size_t nb_new_locks = 0;
+    rl_lock new_locks[2 * nb_locks + 1];
+    size_t nb_locks_to_remove = 0;
+    size_t locks_to_remove[nb_locks + 1];
+    for (int i = 0; i < nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        if (is_owner_of(file, lfd_owner, cur)
+                && seg_overlap(lck_start, lck->l_len, cur->start, cur->len)) {
+            locks_to_remove[nb_locks_to_remove] = i;
+            nb_locks_to_remove++;
+            if (strictly_in_middle(cur->start, cur->len, lck_start,
+                            lck->l_len)) {
+                rl_lock l1, l2;
+                l1.type = cur->type;
+                l1.start = cur->start;
+                l1.len = lck_start - cur->start;
+                new_locks[nb_new_locks] = l1;
+                nb_new_locks++;
+
+                l2.type = cur->type;
+                l2.start = lck_start + lck->l_len;
+                l2.len = (cur->len == 0) ?
+                    0 : (cur->start + cur->len) - (lck_start + lck->l_len);
+                new_locks[nb_new_locks] = l2;
+                nb_new_locks++;
+            } else if (covers_entirely(cur->start, cur->len, lck_start,
+                            lck->l_len))
+                continue;
+            else if (covers_end(cur->start, cur->len, lck_start, lck->l_len)) {
+                rl_lock l1;
+                l1.type = cur->type;
+                l1.start = cur->start;
+                l1.len = lck_start - cur->start;
+                new_locks[nb_new_locks] = l1;
+                nb_new_locks++;
+            } else { /* unlock beginning of cur */
+                rl_lock l1;
+                l1.type = cur->type;
+                l1.start = lck_start + lck->l_len;
+                l1.len = (cur->len == 0) ?
+                    0 : (cur->start + cur->len) - (lck_start + lck->l_len);
+                new_locks[nb_new_locks] = l1;
+                nb_new_locks++;
+            }
+        }
+        if (nb_new_locks + nb_locks > RL_MAX_LOCKS)
+            return -1;
+    }
+    for (int i = 0; i < nb_locks_to_remove; i++) {
+        size_t ind = locks_to_remove[i];
+        rl_lock *rlck = &file->lock_table[ind];
+        int nb_owners = remove_owner(file, lfd_owner, rlck);
+        if (nb_owners == -1)
+            return -1;
+        if (nb_owners == 0) {
+            erase_lock(rlck);
+            file->nb_locks--;
+        }
+    }
+    if (organize_locks(file) == -1)
+        return -1;
+    for (int i = 0; i < nb_new_locks; i++) {
+        rl_lock *tmp = find_lock(file, &new_locks[i]);
+        if (tmp != NULL) {
+            if (add_owner(file, lfd_owner, tmp) == -1)
+                return -1;
+        } else {
+            if (add_lock(&new_locks[i], file, lfd_owner) == -1)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Locks for `lfd_owner` the region specified by `lck` of `file`
+ *
+ * `lck` must be relative to the beginning of the file (`SEEK_SET`). This
+ * function does not use any locking mechanism, ensure mutual exclusion before
+ * the call.
+ *
+ * @param file the file to lock
+ * @param lfd_owner the owner of the lock
+ * @param lck the region to lock
+ * @return 0 on success, -1 on error
+ */
+static int apply_rw_lock(rl_open_file *file, rl_owner lfd_owner,
+        struct flock *lck) {
+    if (file->nb_locks + 2 > RL_MAX_LOCKS)
+        return -1;
+
+    off_t lck_start = lck->l_start;
+    struct flock unlock;
+    unlock.l_type = F_UNLCK;
+    unlock.l_whence = SEEK_SET;
+    unlock.l_start = lck_start;
+    unlock.l_len = lck->l_len;
+    if (apply_unlock(file, lfd_owner, &unlock) == -1)
+        return -1;
+
+    rl_lock *left = NULL;
+    rl_lock *right = NULL;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        if (cur->type != lck->l_type || !is_owner_of(file, lfd_owner, cur))
+            continue;
+        if (cur->start + cur->len == lck_start && cur->len > 0)
+            left = cur;
+        else if (cur->start == lck_start + lck->l_len && lck->l_len > 0)
+            right = cur;
+    }
+
+    int unlock_left = 0;
+    int unlock_right = 0;
+    rl_lock tmp;
+    tmp.type = lck->l_type;
+    tmp.start = lck_start;
+    tmp.len = lck->l_len;
+    if (left != NULL && right != NULL) {
+        if (right->len == 0) tmp.len = 0;
+        else tmp.len += left->len + right->len;
+        tmp.start = left->start;
+        unlock_left = 1;
+        unlock_right = 1;
+    } else if (left != NULL) {
+        if (tmp.len != 0)
+            tmp.len += left->len;
+        tmp.start = left->start;
+        unlock_left = 1;
+    } else if (right != NULL) {
+        if (right->len == 0) tmp.len = 0;
+        else tmp.len += right->len;
+        unlock_right = 1;
+    }
+
+    struct flock left2;
+    if (unlock_left) {
+        rl_lock_to_flock(left, &left2);
+        left2.l_type = F_UNLCK;
+    }
+    struct flock right2;
+    if (unlock_right) {
+        rl_lock_to_flock(right, &right2);
+        right2.l_type = F_UNLCK;
+    }
+
+    if (unlock_left && apply_unlock(file, lfd_owner, &left2) == -1)
+        return -1;
+
+    if (unlock_right && apply_unlock(file, lfd_owner, &right2) == -1)
+        return -1;
+
+    rl_lock *tmp2 = find_lock(file, &tmp);
+    if (tmp2 != NULL) {
+        if (add_owner(file, lfd_owner, tmp2) == -1)
+            return -1;
+    } else {
+        if (add_lock(&tmp, file, lfd_owner) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Moves into the lock table the locks of the slots `slots` of `file`
+ * that overlap the segment (start, len) and either have an owner matching
+ * `crit` or conflict with a lock of type `type`
+ *
+ * This function must be called with the mutex of `file` held. The summary is
+ * extended before a moved slot is freed so that a concurrent fast request sees
+ * either the slot or the new bounds. A pending request is not granted yet and
+ * might conflict with a lock moved before it: it is rejected instead of being
+ * moved, and its requester falls back on the mutex. An idle lease is revoked
+ * when it conflicts with `type` or when its owner matches `crit`.
+ *
+ * @param file the file that contains the slots
+ * @param slots the slots to look at
+ * @param nb_slots the number of slots in `slots`
+ * @param start the start of the segment
+ * @param len the length of the segment, 0 if extensible
+ * @param type the type of the request, F_UNLCK to only move owned locks
+ * @param crit a function that take two lock owners and returns an integer, NULL
+ * to move every overlapping lock
+ * @param owner_crit the owner used as second parameter of `crit`
+ * @return 0 on success, -1 on error
+ */
+static int absorb_slots(rl_open_file *file, rl_fast_slot *slots, int nb_slots,
+        off_t start, off_t len, short type, int (*crit)(rl_owner, rl_owner),
+        rl_owner owner_crit) {
+    for (int i = 0; i < nb_slots; i++) {
+        rl_fast_slot *slot = &slots[i];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) == RL_SLOT_FREE
+                || SLOT_KIND(state) == RL_SLOT_BUSY
+                || !seg_overlap(slot->start, slot->len, start, len))
+            continue;
+
+        if (SLOT_KIND(state) == RL_SLOT_IDLE) {
+            if ((crit == NULL || crit(slot->owner, owner_crit) <= 0)
+                    && (type == F_UNLCK
+                            || (type == F_RDLCK && slot->type == F_RDLCK)))
+                continue;
+        } else if (crit != NULL && crit(slot->owner, owner_crit) <= 0
+                && (type == F_UNLCK
+                        || (type == F_RDLCK && slot->type == F_RDLCK)))
+            continue;
+
+        unsigned int next = SLOT_KIND(state) == RL_SLOT_HELD ?
+            RL_SLOT_BUSY : RL_SLOT_FREE;
+        if (!atomic_compare_exchange_strong(&slot->state, &state,
+                    SLOT_WITH_KIND(state, next))) {
+            i--; /* the slot has changed meanwhile, look at it again */
+            continue;
+        }
+        if (next == RL_SLOT_FREE)
+            continue; /* pending request rejected or lease revoked */
+
+        struct flock lck;
+        lck.l_type = slot->type;
+        lck.l_whence = SEEK_SET;
+        lck.l_start = slot->start;
+        lck.l_len = slot->len;
+        include_in_summary(file, lck.l_start, lck.l_len, lck.l_type);
+        if (apply_rw_lock(file, slot->owner, &lck) == -1) {
+            atomic_store(&slot->state, state);
+            return -1;
+        }
+        atomic_store(&slot->state, SLOT_WITH_KIND(state, RL_SLOT_FREE));
+    }
+    return 0;
+}
+
+/**
+ * @brief Moves into the lock table the fast and biased locks of `file`, see
+ * `absorb_slots()`
+ * @param file the file that contains the fast locks
+ * @param start the start of the segment
+ * @param len the length of the segment, 0 if extensible
+ * @param type the type of the request, F_UNLCK to only move owned locks
+ * @param crit a function that take two lock owners and returns an integer, NULL
+ * to move every overlapping lock
+ * @param owner_crit the owner used as second parameter of `crit`
+ * @return 0 on success, -1 on error
+ */
+static int absorb_fast_locks(rl_open_file *file, off_t start, off_t len,
+        short type, int (*crit)(rl_owner, rl_owner), rl_owner owner_crit) {
+    if (absorb_slots(file, file->fast_slots, RL_FAST_SLOTS, start, len, type,
+                crit, owner_crit) == -1)
+        return -1;
+    return absorb_slots(file, get_bias_slots(file), get_nb_bias_slots(file),
+            start, len, type, crit, owner_crit);
+}
+
+/**
+ * @brief Checks, without the mutex, if the fast locks of `file` other than
+ * `self` might conflict with `lck`
+ * @param file the file that contains the fast locks
+ * @param self the index of the slot of the request
+ * @param lck the request, relative to the beginning of the file
+ * @return 1 if there might be a conflict, 0 otherwise
+ */
+static int fast_locks_conflict(rl_open_file *file, int self,
+        struct flock *lck) {
+    for (int i = 0; i < RL_FAST_SLOTS; i++) {
+        if (i == self)
+            continue;
+        rl_fast_slot *slot = &file->fast_slots[i];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) == RL_SLOT_FREE)
+            continue;
+        if (SLOT_KIND(state) == RL_SLOT_BUSY)
+            return 1;
+
+        short type = slot->type;
+        off_t start = slot->start;
+        off_t len = slot->len;
+        if (atomic_load(&slot->state) != state)
+            return 1;
+        if (seg_overlap(start, len, lck->l_start, lck->l_len)
+                && (type == F_WRLCK || lck->l_type == F_WRLCK))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks, without the mutex, if the lock table of `file` might hold a
+ * lock that overlaps `lck` and conflicts with it
+ * @param file the file to check
+ * @param lck the request, relative to the beginning of the file
+ * @return 1 if there might be a conflict, 0 otherwise
+ */
+static int summary_conflicts(rl_open_file *file, struct flock *lck) {
+    off_t start, len;
+    int writer;
+    read_summary(file, &start, &len, &writer);
+    return len != -1 && seg_overlap(start, len, lck->l_start, lck->l_len)
+        && (writer || lck->l_type != F_RDLCK);
+}
+
+/**
+ * @brief The number of consecutive biased slots an owner may use, starting at
+ * the one given by `get_bias_window()`
+ */
+#define RL_BIAS_WINDOW 4
+
+/**
+ * @brief How many times the duration of a revocation the reader bias stays off
+ * after it
+ */
+#define RL_BIAS_INHIBIT_FACTOR 9
+
+/**
+ * @brief How long in ns the reader bias stays off after an attempt to turn it
+ * on failed because of a write lock
+ */
+#define RL_BIAS_RETRY_DELAY 1000000LL
+
+/**
+ * @brief Gets the current time of CLOCK_MONOTONIC
+ * @return the time in ns
+ */
+static long long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Gets the first biased slot that `owner` may use
+ * @param owner the owner of the biased locks
+ * @return the index of the slot in `bias_slots`
+ */
+static int get_bias_window(rl_owner owner) {
+    return ((unsigned int) owner.pid * 31U + (unsigned int) owner.fd)
+        % RL_BIAS_SLOTS;
+}
+
+/**
+ * @brief Checks if `owner` has a biased lock on `file` that overlaps `lck`
+ * @param file the file that contains the biased locks
+ * @param owner the owner of the biased locks
+ * @param lck the request, relative to the beginning of the file
+ * @return 1 if it has one, 0 otherwise
+ */
+static int overlaps_biased_lock(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    if (!(file->flags & RL_ATTR_READER_BIAS))
+        return 0;
+
+    int first = get_bias_window(owner);
+    for (int n = 0; n < RL_BIAS_WINDOW; n++) {
+        rl_fast_slot *slot = &get_bias_slots(file)[(first + n) % RL_BIAS_SLOTS];
+        if (SLOT_KIND(atomic_load(&slot->state)) != RL_SLOT_FREE
+                && equals(slot->owner, owner)
+                && seg_overlap(slot->start, slot->len, lck->l_start,
+                        lck->l_len))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tries to grant the read lock `lck` to `owner` in a biased slot of
+ * `file`
+ *
+ * The request is published as pending, then granted if the bias is still on:
+ * a write request turns the bias off before moving the biased locks into the
+ * lock table, and rejects the pending ones.
+ *
+ * @param file the file to lock
+ * @param owner the owner of the lock
+ * @param lck the read lock, relative to the beginning of the file
+ * @return 1 if the lock was granted, 0 otherwise
+ */
+static int try_biased_lock(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    int first = get_bias_window(owner);
+    for (int n = 0; n < RL_BIAS_WINDOW; n++) {
+        rl_fast_slot *slot = &get_bias_slots(file)[(first + n) % RL_BIAS_SLOTS];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) != RL_SLOT_FREE
+                || !atomic_compare_exchange_strong(&slot->state, &state,
+                        SLOT_WITH_KIND(state, RL_SLOT_BUSY)))
+            continue;
+
+        slot->type = lck->l_type;
+        slot->start = lck->l_start;
+        slot->len = lck->l_len;
+        slot->owner = owner;
+        unsigned int pending = SLOT_WITH_KIND(state + RL_SLOT_GENERATION,
+                RL_SLOT_PENDING);
+        atomic_store(&slot->state, pending);
+
+        if (atomic_load(&file->bias) != RL_BIAS_ON) {
+            atomic_compare_exchange_strong(&slot->state, &pending,
+                    SLOT_WITH_KIND(pending, RL_SLOT_FREE));
+            return 0;
+        }
+        return atomic_compare_exchange_strong(&slot->state, &pending,
+                SLOT_WITH_KIND(pending, RL_SLOT_HELD));
+    }
+    return 0;
+}
+
+/**
+ * @brief Turns off the reader bias of `file` and moves its biased locks into
+ * the lock table
+ *
+ * This function must be called with the mutex of `file` held. The summary is
+ * extended to the whole file before the bias is turned off, so that no write
+ * lock is granted without the mutex until the biased locks are in the lock
+ * table. The bias then stays off for a time proportional to the duration of
+ * the revocation.
+ *
+ * @param file the file whose bias is revoked
+ * @return 0 on success, -1 on error
+ */
+static int revoke_bias(rl_open_file *file) {
+    if (atomic_load(&file->bias) == RL_BIAS_OFF)
+        return 0;
+
+    long long begin = get_time_ns();
+    include_in_summary(file, 0, 0, F_RDLCK);
+    atomic_store(&file->bias, RL_BIAS_OFF);
+
+    rl_owner any = {.pid = 0, .fd = 0};
+    if (absorb_slots(file, get_bias_slots(file), RL_BIAS_SLOTS, 0, 0, F_WRLCK,
+                NULL, any) == -1) {
+        /* the remaining biased locks are still valid */
+        atomic_store(&file->bias, RL_BIAS_ON);
+        return -1;
+    }
+
+    long long end = get_time_ns();
+    atomic_store(&file->bias_inhibit_until,
+            end + RL_BIAS_INHIBIT_FACTOR * (end - begin));
+    return 0;
+}
+
+/**
+ * @brief Turns on the reader bias of `file` if it is allowed to and if there
+ * is no write lock
+ *
+ * This function must be called with the mutex of `file` held. The bias is
+ * armed before the fast slots are checked, since a fast write request checks
+ * the bias after having published itself: either the request sees the bias,
+ * or this function sees the request.
+ *
+ * @param file the file whose bias is turned on
+ */
+static void try_enable_bias(rl_open_file *file) {
+    if (atomic_load(&file->bias) != RL_BIAS_OFF
+            || get_time_ns() < atomic_load(&file->bias_inhibit_until))
+        return;
+
+    for (int i = 0; i < file->nb_locks; i++) {
+        if (file->lock_table[i].type == F_WRLCK)
+            goto retry_later;
+    }
+
+    atomic_store(&file->bias, RL_BIAS_ARMING);
+    for (int i = 0; i < RL_FAST_SLOTS; i++) {
+        rl_fast_slot *slot = &file->fast_slots[i];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) == RL_SLOT_FREE
+                || SLOT_KIND(state) == RL_SLOT_BUSY || slot->type != F_WRLCK)
+            continue;
+        if (SLOT_KIND(state) == RL_SLOT_HELD) {
+            atomic_store(&file->bias, RL_BIAS_OFF);
+            goto retry_later;
+        }
+        /* reject the pending request or revoke the lease */
+        if (!atomic_compare_exchange_strong(&slot->state, &state,
+                    SLOT_WITH_KIND(state, RL_SLOT_FREE)))
+            i--;
+    }
+    atomic_store(&file->bias, RL_BIAS_ON);
+    return;
+
+retry_later:
+    atomic_store(&file->bias_inhibit_until,
+            get_time_ns() + RL_BIAS_RETRY_DELAY);
+}
+
+/**
+ * @brief Tries to grant `lck` to `owner` without taking the mutex of `file`
+ *
+ * The request is published as pending in a free fast slot, then checked
+ * against the other fast slots and the summary of the lock table, in this order
+ * since the mutex path extends the summary before freeing a slot it moves. A
+ * request that might conflict with anything, that overlaps a fast lock of the
+ * same owner or that the mutex path has rejected meanwhile is withdrawn and
+ * left to the mutex path.
+ *
+ * A request that matches exactly a lease of its owner retakes it with a single
+ * atomic operation on the slot: the lease has stayed visible to every other
+ * request since it was taken, so nothing conflicting can have been granted.
+ * Other leases of the owner that overlap the request are dropped.
+ *
+ * With `RL_ATTR_READER_BIAS`, a read request is first tried in a biased slot,
+ * and a write request is withdrawn while the bias is not off. When the bias
+ * is off and allowed to be turned on again, read requests are left to the
+ * mutex path which does it.
+ *
+ * @param file the file to lock
+ * @param owner the owner of the lock
+ * @param lck the lock (F_RDLCK or F_WRLCK), relative to the beginning of the
+ * file
+ * @return 1 if the lock was granted, 0 if the mutex path must be taken
+ */
+static int try_fast_lock(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    for (int i = 0; i < RL_FAST_SLOTS; i++) {
+        rl_fast_slot *slot = &file->fast_slots[i];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) == RL_SLOT_FREE || !equals(slot->owner, owner)
+                || !seg_overlap(slot->start, slot->len, lck->l_start,
+                        lck->l_len))
+            continue;
+        if (SLOT_KIND(state) != RL_SLOT_IDLE)
+            return 0;
+
+        if (slot->type == lck->l_type && slot->start == lck->l_start
+                && slot->len == lck->l_len) {
+            if (atomic_compare_exchange_strong(&slot->state, &state,
+                        SLOT_WITH_KIND(state, RL_SLOT_HELD)))
+                return 1;
+            continue; /* revoked meanwhile */
+        }
+        atomic_compare_exchange_strong(&slot->state, &state,
+                SLOT_WITH_KIND(state, RL_SLOT_FREE));
+    }
+
+    int biased = file->flags & RL_ATTR_READER_BIAS;
+    if (biased && overlaps_biased_lock(file, owner, lck))
+        return 0;
+    if (biased && lck->l_type == F_RDLCK) {
+        int bias = atomic_load(&file->bias);
+        if (bias == RL_BIAS_ON && try_biased_lock(file, owner, lck))
+            return 1;
+        if (bias == RL_BIAS_OFF
+                && get_time_ns() >= atomic_load(&file->bias_inhibit_until))
+            return 0;
+    }
+
+    int first = (unsigned int) (owner.pid ^ owner.fd) % RL_FAST_SLOTS;
+    for (int n = 0; n < RL_FAST_SLOTS; n++) {
+        int i = (first + n) % RL_FAST_SLOTS;
+        rl_fast_slot *slot = &file->fast_slots[i];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) != RL_SLOT_FREE
+                || !atomic_compare_exchange_strong(&slot->state, &state,
+                        SLOT_WITH_KIND(state, RL_SLOT_BUSY)))
+            continue;
+
+        slot->type = lck->l_type;
+        slot->start = lck->l_start;
+        slot->len = lck->l_len;
+        slot->owner = owner;
+        unsigned int pending = SLOT_WITH_KIND(state + RL_SLOT_GENERATION,
+                RL_SLOT_PENDING);
+        atomic_store(&slot->state, pending);
+
+        if ((biased && lck->l_type == F_WRLCK
+                    && atomic_load(&file->bias) != RL_BIAS_OFF)
+                || fast_locks_conflict(file, i, lck)
+                || summary_conflicts(file, lck)) {
+            atomic_compare_exchange_strong(&slot->state, &pending,
+                    SLOT_WITH_KIND(pending, RL_SLOT_FREE));
+            return 0;
+        }
+        /* fails if the mutex path has rejected the request meanwhile */
+        return atomic_compare_exchange_strong(&slot->state, &pending,
+                SLOT_WITH_KIND(pending, RL_SLOT_HELD));
+    }
+    return 0;
+}
+
+/**
+ * @brief Tries to unlock `lck` for `owner` without taking the mutex of `file`
+ *
+ * This succeeds when the region is exactly a fast lock of `owner`, or when it
+ * overlaps neither a fast lock of `owner` nor the lock table. On a file created
+ * with `RL_ATTR_LEASES`, the released fast lock stays recorded as an idle lease
+ * of `owner` until another request conflicting with it revokes it. A biased
+ * lock is only released here if the region is exactly this lock.
+ *
+ * @param file the file to unlock
+ * @param owner the owner of the locks
+ * @param lck the region to unlock, relative to the beginning of the file
+ * @return 1 if the region was unlocked, 0 if the mutex path must be taken
+ */
+static int try_fast_unlock(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    int first = get_bias_window(owner);
+    for (int n = 0; (file->flags & RL_ATTR_READER_BIAS)
+            && n < RL_BIAS_WINDOW; n++) {
+        rl_fast_slot *slot = &get_bias_slots(file)[(first + n) % RL_BIAS_SLOTS];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) == RL_SLOT_FREE || !equals(slot->owner, owner)
+                || !seg_overlap(slot->start, slot->len, lck->l_start,
+                        lck->l_len))
+            continue;
+        /* fails if a write request has moved the lock meanwhile */
+        return SLOT_KIND(state) == RL_SLOT_HELD
+            && slot->start == lck->l_start && slot->len == lck->l_len
+            && atomic_compare_exchange_strong(&slot->state, &state,
+                    SLOT_WITH_KIND(state, RL_SLOT_FREE));
+    }
+
+    rl_fast_slot *found = NULL;
+    unsigned int found_state = 0;
+    for (int i = 0; i < RL_FAST_SLOTS; i++) {
+        rl_fast_slot *slot = &file->fast_slots[i];
+        unsigned int state = atomic_load(&slot->state);
+        if (SLOT_KIND(state) == RL_SLOT_FREE
+                || SLOT_KIND(state) == RL_SLOT_IDLE
+                || !equals(slot->owner, owner)
+                || !seg_overlap(slot->start, slot->len, lck->l_start,
+                        lck->l_len))
+            continue;
+        if (SLOT_KIND(state) == RL_SLOT_BUSY || found != NULL
+                || slot->start != lck->l_start || slot->len != lck->l_len)
+            return 0;
+        found = slot;
+        found_state = state;
+    }
+
+    struct flock any = *lck;
+    any.l_type = F_WRLCK;
+    if (summary_conflicts(file, &any))
+        return 0;
+    if (found == NULL)
+        return 1;
+    int kind = file->flags & RL_ATTR_LEASES ? RL_SLOT_IDLE : RL_SLOT_FREE;
+    return atomic_compare_exchange_strong(&found->state, &found_state,
+            SLOT_WITH_KIND(found_state, kind));
+}
+
+/**
+ * @brief Checks if `owner` can extend its locks of type `type` over the
+ * segment (start, len)
+ *
+ * This function must be called with the mutex of `file` held. The extension is
+ * prevented by the locks of other owners that conflict with `type` and by the
+ * locks of `owner` of another type.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner of the locks
+ * @param start the start of the segment
+ * @param len the length of the segment, 0 if extensible
+ * @param type the type of the locks
+ * @return 1 if it can, 0 otherwise
+ */
+static int can_extend_over(rl_open_file *file, rl_owner owner, off_t start,
+        off_t len, short type) {
+    rl_owner any = {.pid = 0, .fd = 0};
+    if (absorb_fast_locks(file, start, len, type, NULL, any) == -1)
+        return 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        if (cur->type != type && seg_overlap(cur->start, cur->len, start, len)
+                && is_owner_of(file, owner, cur))
+            return 0;
+    }
+
+    struct flock gap = {.l_type = type, .l_whence = SEEK_SET, .l_start = start,
+                        .l_len = len};
+    pid_t pid;
+    while ((pid = is_lock_applicable(&gap, file, owner)) > 1) {
+        if (remove_locks_of(pid, file) == -1)
+            return 0;
+    }
+    return pid == 1;
+}
+
+/**
+ * @brief Checks if only `owner` holds locks on `file`
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file to check
+ * @param owner the owner of the locks
+ * @return 1 if it does, 0 otherwise
+ */
+static int is_uncontended(rl_open_file *file, rl_owner owner) {
+    rl_owner any = {.pid = 0, .fd = 0};
+    if (absorb_fast_locks(file, 0, 0, F_WRLCK, NULL, any) == -1)
+        return 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_owner other;
+        if (has_different_owner(file, &file->lock_table[i], owner, &other))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Replaces the locks of `owner` in the segment (start, len) by one lock
+ * of type `type` on the segment
+ *
+ * This function must be called with the mutex of `file` held, and the segment
+ * must contain entirely the locks of `owner` it overlaps.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner of the locks
+ * @param start the start of the segment
+ * @param len the length of the segment, 0 if extensible
+ * @param type the type of the locks
+ * @return 0 on success, -1 on error
+ */
+static int cover_locks(rl_open_file *file, rl_owner owner, off_t start,
+        off_t len, short type) {
+    struct flock unlock = {.l_type = F_UNLCK, .l_whence = SEEK_SET,
+                           .l_start = start, .l_len = len};
+    if (apply_unlock(file, owner, &unlock) == -1)
+        return -1;
+
+    rl_lock cover = {.start = start, .len = len, .type = type};
+    rl_lock *same = find_lock(file, &cover);
+    if (same != NULL)
+        return add_owner(file, owner, same);
+    return add_lock(&cover, file, owner);
+}
+
+/**
+ * @brief Counts the locks of type `type` held by `owner` in the lock table
+ * @param file the file that contains the locks
+ * @param owner the owner of the locks
+ * @param type the type of the locks, -1 for every type
+ * @return the number of locks
+ */
+static int count_owned_locks(rl_open_file *file, rl_owner owner, short type) {
+    int nb = 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        if ((type == -1 || cur->type == type) && is_owner_of(file, owner, cur))
+            nb++;
+    }
+    return nb;
+}
+
+/**
+ * @brief Coalesces the locks of type `type` held by `owner`
+ *
+ * This function must be called with the mutex of `file` held. The fast locks
+ * of `owner` are moved into the lock table first; nothing is escalated if the
+ * table has no room for them. Consecutive locks are merged when `owner` could lock the gap between
+ * them. With `RL_ATTR_ESCALATE_FILE`, all the locks are replaced by a lock on
+ * the whole file instead if no other owner holds locks on the file.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner of the locks
+ * @param type the type of the locks
+ * @return 0 on success, -1 on error
+ */
+static int escalate_locks(rl_open_file *file, rl_owner owner, short type) {
+    if (absorb_fast_locks(file, 0, 0, F_UNLCK, equals, owner) == -1)
+        return -1;
+
+    off_t starts[RL_MAX_LOCKS];
+    off_t lens[RL_MAX_LOCKS];
+    int nb = 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        if (cur->type != type || !is_owner_of(file, owner, cur))
+            continue;
+        int j = nb++;
+        for (; j > 0 && starts[j - 1] > cur->start; j--) {
+            starts[j] = starts[j - 1];
+            lens[j] = lens[j - 1];
+        }
+        starts[j] = cur->start;
+        lens[j] = cur->len;
+    }
+    if (nb < 2)
+        return 0;
+
+    if (file->flags & RL_ATTR_ESCALATE_FILE && is_uncontended(file, owner)
+            && can_extend_over(file, owner, 0, 0, type))
+        return cover_locks(file, owner, 0, 0, type);
+
+    int first = 0;
+    for (int i = 1; i <= nb; i++) {
+        off_t end = starts[i - 1] + lens[i - 1];
+        if (i < nb && lens[i - 1] != 0 && (starts[i] == end
+                    || can_extend_over(file, owner, end, starts[i] - end,
+                        type)))
+            continue;
+
+        if (i - first > 1 && cover_locks(file, owner, starts[first],
+                    lens[i - 1] == 0 ? 0 : end - starts[first], type) == -1)
+            return -1;
+        first = i;
+    }
+    return 0;
+}
+
+/**
+ * @brief Counts the locks `owner` would hold in the lock table once `lck` is
+ * applied with `apply_rw_lock()`
+ *
+ * The locks of `owner` that `lck` overlaps are cut around it, and the pieces
+ * of its type that end up next to it are merged with it.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner of the locks
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return the number of locks
+ */
+static int count_locks_after(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    off_t start = lck->l_start;
+    off_t len = lck->l_len;
+    int nb = 1;
+    int left = 0;
+    int right = 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        if (!is_owner_of(file, owner, cur))
+            continue;
+        int same = cur->type == lck->l_type;
+        if (!seg_overlap(start, len, cur->start, cur->len)) {
+            nb++;
+            if (same && cur->len > 0 && cur->start + cur->len == start)
+                left = 1;
+            else if (same && len > 0 && cur->start == start + len)
+                right = 1;
+            continue;
+        }
+        if (cur->start < start) {
+            nb++;
+            left |= same;
+        }
+        if (len > 0 && (cur->len == 0 || cur->start + cur->len > start + len)) {
+            nb++;
+            right |= same;
+        }
+    }
+    return nb - left - right;
+}
+
+/**
+ * @brief Applies the read, update or write lock `lck` with `apply_rw_lock()`,
+ * as long as `owner` stays within its quota
+ *
+ * The locks `owner` would hold are counted before the request is applied.
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file on which to apply `lck`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return 0 on success, -1 on failure with errno set to EDQUOT if `owner`
+ *         would exceed its quota
+ */
+static int apply_quota_lock(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    int quota = is_group_owner(owner) ? file->group_quota : file->quota;
+    if (quota > 0 && count_locks_after(file, owner, lck) > quota) {
+        errno = EDQUOT;
+        return -1;
+    }
+    return apply_rw_lock(file, owner, lck);
+}
+
+/**
+ * @brief Applies `lck` for `owner` on `file` if possible
+ *
+ * This function must be called with the mutex of `file` held. With
+ * `RL_ATTR_READER_BIAS`, a write request first revokes the reader bias and a
+ * read request tries to turn it on. Fast locks that overlap the request are
+ * then moved into the lock table, then the locks of dead processes that
+ * prevent the request are removed. With leases, the request renews the lease
+ * of `owner`, unless its locks were revoked.
+ *
+ * @param file the file on which to apply `lck`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return 0 on success, -1 on failure with errno set to EAGAIN if a
+ * conflicting lock is held by another owner, EKEYEXPIRED if the locks of
+ * `owner` were revoked since its last request, ENOLCK if all the leases are
+ * held or EDQUOT if `owner` would exceed its quota
+ */
+static int apply_request(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    if (file->lease_ns > 0) {
+        if (take_revoked(file, owner)) {
+            errno = EKEYEXPIRED;
+            return -1;
+        }
+        if (renew_lease(file, owner) == -1)
+            return -1;
+    }
+
+    if (file->flags & RL_ATTR_READER_BIAS) {
+        if (lck->l_type == F_WRLCK && revoke_bias(file) == -1)
+            return -1;
+        if (lck->l_type == F_RDLCK)
+            try_enable_bias(file);
+    }
+
+    if (lck->l_type != F_UNLCK)
+        include_in_summary(file, lck->l_start, lck->l_len, lck->l_type);
+    if (absorb_fast_locks(file, lck->l_start, lck->l_len, lck->l_type, equals,
+                owner) == -1)
+        return -1;
+
+    pid_t pid;
+    while ((pid = is_lock_applicable(lck, file, owner)) > 1) {
+        if (remove_locks_of(pid, file) == -1)
+            return -1;
+    }
+
+    if (pid == -1)
+        return -1;
+
+    if (pid == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    switch (lck->l_type) {
+      case F_UNLCK:
+        return apply_unlock(file, owner, lck);
+      case F_RDLCK:
+      case RL_UPDLCK:
+      case F_WRLCK:
+        break;
+      default:
+        return -1;
+    }
+
+    /* coalesce the locks of the owner when it holds too many of them or
+     * when the table or its quota is full */
+    int res = apply_quota_lock(file, owner, lck);
+    if (file->escalation > 0 && (res == -1 ?
+                errno == EDQUOT || file->nb_locks + 2 > RL_MAX_LOCKS
+                : count_owned_locks(file, owner, lck->l_type)
+                    > file->escalation)) {
+        int err = errno;
+        if (escalate_locks(file, owner, lck->l_type) == -1) {
+            /* the lock is applied, or refused, without escalation */
+            errno = err;
+            return res;
+        }
+        if (res == -1)
+            res = apply_quota_lock(file, owner, lck);
+    }
+    return res;
+}
+
+/**
+ * @brief Applies `lck` under the mutex of `file`
+ * @param file the file on which to apply `lck`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return 0 on success, -1 on failure
+ */
+static int lock_and_apply(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    if (lock_open_file(file) != 0)
+        return -1;
+
+    int res = apply_request(file, owner, lck);
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    errno = err;
+    return res;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief The state of a free request slot
+ */
+#define RL_REQUEST_FREE 0
+
+/**
+ * @brief The state of a request slot being filled by its requester
+ */
+#define RL_REQUEST_CLAIMED 1
+
+/**
+ * @brief The state of a request slot waiting to be applied
+ */
+#define RL_REQUEST_POSTED 2
+
+/**
+ * @brief The state of a request slot being applied by the holder of the mutex
+ */
+#define RL_REQUEST_APPLYING 3
+
+/**
+ * @brief The state of a request slot whose result is ready
+ */
+#define RL_REQUEST_DONE 4
+
+/**
+ * @brief Posts `lck` in a free request slot of `file`
+ * @param file the file created with `RL_ATTR_COMBINING`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return the index of the slot, -1 if all the slots are used
+ */
+static int post_request(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    int first = ((unsigned int) owner.pid * 31 + owner.fd) % RL_REQUEST_SLOTS;
+    for (int n = 0; n < RL_REQUEST_SLOTS; n++) {
+        rl_request_slot *slot =
+            &get_requests(file)[(first + n) % RL_REQUEST_SLOTS];
+        int expected = RL_REQUEST_FREE;
+        if (atomic_load(&slot->state) != RL_REQUEST_FREE
+                || !atomic_compare_exchange_strong(&slot->state, &expected,
+                    RL_REQUEST_CLAIMED))
+            continue;
+
+        slot->owner = owner;
+        slot->pid = getpid();
+        slot->type = lck->l_type;
+        slot->start = lck->l_start;
+        slot->len = lck->l_len;
+        atomic_store(&slot->state, RL_REQUEST_POSTED);
+        return (first + n) % RL_REQUEST_SLOTS;
+    }
+    return -1;
+}
+
+/**
+ * @brief Applies all the requests posted in `file`, in the order of the slots
+ *
+ * This function must be called with the mutex of `file` held. The results
+ * left by dead processes are freed. Each request is claimed before it is
+ * applied, so that its requester can't withdraw it meanwhile.
+ *
+ * @param file the file created with `RL_ATTR_COMBINING`
+ */
+static void combine_requests(rl_open_file *file) {
+    for (int r = 0; r < RL_REQUEST_SLOTS; r++) {
+        rl_request_slot *slot = &get_requests(file)[r];
+        int state = atomic_load(&slot->state);
+        /* a slot is only being applied here if its holder died */
+        if ((state == RL_REQUEST_DONE || state == RL_REQUEST_APPLYING)
+                && is_process_dead(file, slot->pid)) {
+            atomic_store(&slot->state, RL_REQUEST_FREE);
+            continue;
+        }
+        /* the requester may withdraw its request meanwhile */
+        if (state != RL_REQUEST_POSTED
+                || !atomic_compare_exchange_strong(&slot->state, &state,
+                    RL_REQUEST_APPLYING))
+            continue;
+
+        struct flock lck = {.l_type = slot->type, .l_whence = SEEK_SET,
+                            .l_start = slot->start, .l_len = slot->len};
+        errno = 0;
+        slot->result = apply_request(file, slot->owner, &lck);
+        slot->error = errno;
+        atomic_store(&slot->state, RL_REQUEST_DONE);
+    }
+}
+
+/**
+ * @brief Waits until the holder of the mutex of `file` has applied the request
+ * in `slot`
+ *
+ * The holder applies the request under the mutex, so the request is done once
+ * the caller can take it, unless the holder died while applying it, in which
+ * case the request fails with ENOLCK.
+ *
+ * @param file the file created with `RL_ATTR_COMBINING`
+ * @param slot the request slot, being applied or done
+ */
+static void wait_request(rl_open_file *file, rl_request_slot *slot) {
+    while (atomic_load(&slot->state) != RL_REQUEST_DONE) {
+        if (try_lock_open_file(file) != 0) {
+            sched_yield();
+            continue;
+        }
+        if (atomic_load(&slot->state) != RL_REQUEST_DONE) {
+            slot->result = -1;
+            slot->error = ENOLCK;
+            atomic_store(&slot->state, RL_REQUEST_DONE);
+        }
+        unlock_open_file(file);
+    }
+}
+
+/**
+ * @brief Applies `lck` on a file created with `RL_ATTR_COMBINING`
+ *
+ * The request is posted in a request slot. If the mutex of `file` is free,
+ * the caller takes it and applies all the posted requests in one pass.
+ * Otherwise it spins on its slot for a while, hoping for the current holder to
+ * apply its request, then waits for the mutex like any other request and
+ * applies the requests still posted. When all the slots are used, `lck` is
+ * applied under the mutex without being posted. If the mutex can't be taken,
+ * the request is withdrawn, unless the holder is already applying it, in
+ * which case its result is awaited.
+ *
+ * @param file the file on which to apply `lck`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return 0 on success, -1 on failure
+ */
+static int combine_request(rl_open_file *file, rl_owner owner,
+        struct flock *lck) {
+    int r = post_request(file, owner, lck);
+    if (r == -1)
+        return lock_and_apply(file, owner, lck);
+    rl_request_slot *slot = &get_requests(file)[r];
+
+    int locked = try_lock_open_file(file) == 0;
+    for (int i = 0; !locked && i < RL_MCS_SPIN; i++) {
+        if (atomic_load(&slot->state) == RL_REQUEST_DONE)
+            break;
+    }
+    if (!locked && atomic_load(&slot->state) != RL_REQUEST_DONE)
+        locked = lock_open_file(file) == 0;
+
+    int res = 0;
+    if (locked) {
+        combine_requests(file);
+        res = unlock_open_file(file);
+    } else {
+        int expected = RL_REQUEST_POSTED;
+        if (atomic_compare_exchange_strong(&slot->state, &expected,
+                    RL_REQUEST_FREE))
+            return -1; /* the mutex could not be taken */
+        wait_request(file, slot);
+    }
+
+    int result = slot->result;
+    int err = slot->error;
+    atomic_store(&slot->state, RL_REQUEST_FREE);
+    if (res == -1)
+        return -1;
+    errno = err;
+    return result;
+}
+
+/**
+ * @brief The time a waiter spins at least before parking, in ns
+ */
+#define RL_SPIN_MIN_NS 2000LL
+
+/**
+ * @brief The average wait above which a waiter parks after `RL_SPIN_MIN_NS`
+ */
+#define RL_SPIN_MAX_NS 100000LL
+
+/**
+ * @brief The weight of the past waits in the moving average of the waits
+ */
+#define RL_WAIT_WEIGHT 8
+
+/**
+ * @brief The largest backoff before a waiter retries its request, in loads
+ */
+#define RL_BACKOFF_MAX 4096U
+
+/**
+ * @brief The longest time a waiter stays parked before retrying its request,
+ * in ns, so that the locks of dead processes are eventually removed
+ */
+#define RL_PARK_MAX_NS 50000000L
+
+/**
+ * @brief Gets the number of online processors, computed once per process
+ * @return the number of online processors
+ */
+static long get_nb_cpus() {
+    static long nb_cpus = 0;
+    if (nb_cpus == 0) {
+        nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nb_cpus < 1)
+            nb_cpus = 1;
+    }
+    return nb_cpus;
+}
+
+/**
+ * @brief Waits until some locks of `file` are released after the release
+ * sequence `seq` was read
+ *
+ * The waiter spins on the release sequence for a budget derived from the
+ * recent waits on the file: twice the average wait when it is short, the
+ * minimal budget when it is long, nothing on a uniprocessor. Then it parks on
+ * the release sequence for at most `RL_PARK_MAX_NS`. Once a release has been
+ * seen, it backs off for a random time that doubles with `nb_failures`, so
+ * that the waiters woken by the same release don't retry all at once.
+ *
+ * @param file the open file
+ * @param seq the release sequence read before the last failed attempt
+ * @param nb_failures the number of failed attempts of the waiter
+ * @param deadline the CLOCK_MONOTONIC time in ns after which the waiter stops
+ *                 waiting, -1 for none
+ * @return 0 on success, -1 if a signal interrupted the wait
+ */
+static int wait_for_release(rl_open_file *file, int seq,
+        unsigned int nb_failures, long long deadline) {
+    long long begin = get_time_ns();
+    long long avg = atomic_load(&file->wait_ns);
+    long long budget = RL_SPIN_MIN_NS;
+    if (get_nb_cpus() == 1)
+        budget = 0;
+    else if (avg <= RL_SPIN_MAX_NS && 2 * avg > budget)
+        budget = 2 * avg;
+    if (deadline >= 0 && deadline - begin < budget)
+        budget = deadline - begin;
+
+    int released = 0;
+    while (!released && get_time_ns() - begin < budget) {
+        for (int i = 0; i < 64 && !released; i++)
+            released = atomic_load(&file->release_seq) != seq;
+    }
+
+    long long park = RL_PARK_MAX_NS;
+    if (deadline >= 0 && deadline - get_time_ns() < park)
+        park = deadline - get_time_ns();
+    if (!released && park > 0) {
+        struct timespec timeout = {.tv_sec = 0, .tv_nsec = park};
+        int interrupted = 0;
+        atomic_fetch_add(&file->nb_parked, 1);
+        while (atomic_load(&file->release_seq) == seq) {
+            if (futex_wait(&file->release_seq, seq, &timeout) == -1
+                    && (errno == EINTR || errno == ETIMEDOUT)) {
+                interrupted = errno == EINTR;
+                break;
+            }
+        }
+        atomic_fetch_sub(&file->nb_parked, 1);
+        if (interrupted) {
+            errno = EINTR;
+            return -1;
+        }
+    }
+
+    long long wait = get_time_ns() - begin;
+    atomic_store(&file->wait_ns, avg + (wait - avg) / RL_WAIT_WEIGHT);
+
+    unsigned int window = nb_failures < 12 ? 1U << nb_failures : RL_BACKOFF_MAX;
+    unsigned int rnd = (unsigned int) getpid() ^ (unsigned int) begin;
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    for (unsigned int i = rnd % window; i > 0; i--)
+        atomic_load(&file->release_seq);
+    return 0;
+}
+
+/**
+ * @brief The state of a free pending request
+ */
+#define RL_PENDING_FREE 0
+
+/**
+ * @brief The state of a pending request being filled by its requester
+ */
+#define RL_PENDING_CLAIMED 1
+
+/**
+ * @brief The state of a pending request being applied
+ */
+#define RL_PENDING_BUSY 2
+
+/**
+ * @brief The state of a pending request waiting for a release
+ */
+#define RL_PENDING_WAITING 3
+
+/**
+ * @brief The state of a granted pending request
+ */
+#define RL_PENDING_GRANTED 4
+
+/**
+ * @brief The state of a pending request which failed with `error`
+ */
+#define RL_PENDING_FAILED 5
+
+/**
+ * @brief The state of a pending request cancelled by `rl_close()`
+ */
+#define RL_PENDING_CANCELLED 6
+
+/**
+ * @brief Gets the address of the socket signalled when the pending request
+ * `id` of the process `pid` is completed
+ * @param pid the PID of the requester
+ * @param id the number of the request in its process
+ * @param addr the address to fill
+ * @return the length of the address
+ */
+static socklen_t get_pending_address(pid_t pid, unsigned int id,
+        struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    /* abstract name: leading null byte, not nul-terminated */
+    int len = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+            "rl-async-%ld-%u", (long) pid, id);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+/**
+ * @brief Completes the pending request `req` and signals its owner
+ * @param req the pending request
+ * @param state the final state of the request
+ */
+static void complete_pending(rl_pending_request *req, int state) {
+    static int sock = -1;
+    if (sock == -1)
+        sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    struct sockaddr_un addr;
+    socklen_t len = get_pending_address(req->pid, req->id, &addr);
+    atomic_store(&req->state, state);
+    if (sock != -1)
+        sendto(sock, "", 1, MSG_DONTWAIT, (struct sockaddr *) &addr, len);
+}
+
+/**
+ * @brief Applies the requests waiting in `file` that can be granted
+ *
+ * This function must be called with the mutex of `file` held. The requests of
+ * dead processes are freed.
+ *
+ * @param file the open file
+ */
+static void grant_pending_locked(rl_open_file *file) {
+    for (int p = 0; p < RL_MAX_PENDING; p++) {
+        rl_pending_request *req = &get_pending(file)[p];
+        int expected = RL_PENDING_WAITING;
+        if (atomic_load(&req->state) != RL_PENDING_WAITING
+                || !atomic_compare_exchange_strong(&req->state, &expected,
+                    RL_PENDING_BUSY))
+            continue;
+
+        if (is_process_dead(file, req->pid)) {
+            atomic_fetch_sub(&file->nb_pending, 1);
+            atomic_fetch_sub(&file->nb_waiters, 1);
+            atomic_store(&req->state, RL_PENDING_FREE);
+            continue;
+        }
+
+        struct flock lck = {.l_type = req->type, .l_whence = SEEK_SET,
+                            .l_start = req->start, .l_len = req->len};
+        if (apply_request(file, req->owner, &lck) == 0)
+            complete_pending(req, RL_PENDING_GRANTED);
+        else if (errno == EAGAIN)
+            atomic_store(&req->state, RL_PENDING_WAITING);
+        else {
+            req->error = errno;
+            complete_pending(req, RL_PENDING_FAILED);
+        }
+    }
+}
+
+/**
+ * @brief Applies the requests waiting in `file` that can be granted, if any
+ * @param file the open file
+ */
+static void grant_pending(rl_open_file *file) {
+    if (atomic_load(&file->nb_pending) == 0)
+        return;
+    if (lock_open_file(file) != 0)
+        return;
+    grant_pending_locked(file);
+    unlock_open_file(file);
+}
+
+/**
+ * @brief Cancels the requests of `owner` waiting in `file`
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the open file
+ * @param owner the owner whose requests are cancelled
+ */
+static void cancel_pending(rl_open_file *file, rl_owner owner) {
+    for (int p = 0; atomic_load(&file->nb_pending) > 0 && p < RL_MAX_PENDING;
+            p++) {
+        rl_pending_request *req = &get_pending(file)[p];
+        int expected = RL_PENDING_WAITING;
+        if (equals(req->owner, owner)
+                && atomic_compare_exchange_strong(&req->state, &expected,
+                    RL_PENDING_BUSY))
+            complete_pending(req, RL_PENDING_CANCELLED);
+    }
+}
+
+/**
+ * @brief Finds the I/O policy of the descriptor `fd`
+ * @param fd the descriptor
+ * @return the policy of `fd`, NULL if it has none
+ */
+static rl_fd_policy *find_policy(int fd) {
+    for (int i = 0; i < rla.nb_policies; i++) {
+        if (rla.policies[i].fd == fd)
+            return &rla.policies[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Extends the segment (*start, *len) so that it also covers (s, l)
+ * @param start the start of the segment to extend
+ * @param len the length of the segment to extend, 0 if extensible, -1 if
+ *            empty
+ * @param s the start of the segment to cover
+ * @param l the length of the segment to cover, 0 if extensible
+ */
+static void extend_segment(off_t *start, off_t *len, off_t s, off_t l) {
+    if (*len == -1) {
+        *start = s;
+        *len = l;
+        return;
+    }
+    off_t new_start = s < *start ? s : *start;
+    if (*len != 0 && l != 0) {
+        off_t end = s + l > *start + *len ? s + l : *start + *len;
+        *len = end - new_start;
+    } else
+        *len = 0;
+    *start = new_start;
+}
+
+/**
+ * @brief Syncs the segment released by the write-unlocks of `policy`
+ * @param policy the policy of the descriptor
+ */
+static void sync_policy(rl_fd_policy *policy) {
+    if (policy->dirty_len != -1) {
+        if ((policy->flags & RL_POLICY_SYNC_RANGE)
+                && sync_file_range(policy->fd, policy->dirty_start,
+                    policy->dirty_len, SYNC_FILE_RANGE_WAIT_BEFORE
+                    | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER)
+                    == -1)
+            policy->error = errno;
+        if ((policy->flags & RL_POLICY_FDATASYNC)
+                && fdatasync(policy->fd) == -1)
+            policy->error = errno;
+    }
+    policy->nb_unlocks = 0;
+    policy->dirty_len = -1;
+}
+
+/**
+ * @brief Applies the I/O policy of the descriptor `fd` after the request
+ * `lck` has been applied
+ *
+ * A read lock is followed by a readahead of its segment. An unlock that
+ * overlaps the segment write-locked since the last sync is a write-unlock:
+ * its segment is added to the segment to sync, which is synced every
+ * `batch` write-unlocks. Errors of the syncs are kept for `rl_flush()`.
+ *
+ * @param fd the descriptor
+ * @param lck the request, relative to the beginning of the file
+ */
+static void apply_policy(int fd, struct flock *lck) {
+    rl_fd_policy *policy = find_policy(fd);
+    if (policy == NULL)
+        return;
+
+    switch (lck->l_type) {
+      case F_RDLCK:
+        if (policy->flags & RL_POLICY_WILLNEED)
+            posix_fadvise(fd, lck->l_start, lck->l_len, POSIX_FADV_WILLNEED);
+        break;
+      case F_WRLCK:
+        extend_segment(&policy->written_start, &policy->written_len,
+                lck->l_start, lck->l_len);
+        break;
+      case F_UNLCK:
+        if (policy->written_len == -1
+                || !seg_overlap(lck->l_start, lck->l_len,
+                    policy->written_start, policy->written_len))
+            break;
+        /* only dirty pages are written, syncing more than needed is cheap */
+        extend_segment(&policy->dirty_start, &policy->dirty_len,
+                lck->l_start, lck->l_len);
+        if (covers_entirely(policy->written_start, policy->written_len,
+                    lck->l_start, lck->l_len))
+            policy->written_len = -1;
+        if (++policy->nb_unlocks >= policy->batch)
+            sync_policy(policy);
+        break;
+    }
+}
+
+/**
+ * @brief Checks if a request of type `type` of `owner` may be applied in the
+ * fast slots of `file`
+ *
+ * The fast slots are not used by the features that need every lock of an
+ * owner in the lock table.
+ *
+ * @param file the file of the request
+ * @param owner the owner of the request
+ * @param type the type of the request
+ * @return 1 if it may, 0 otherwise
+ */
+static int uses_fast_slots(const rl_open_file *file, rl_owner owner,
+        short type) {
+    return !(file->flags & RL_ATTR_INTENTS) && file->lease_ns == 0
+        && file->quota == 0 && file->group_quota == 0 && type != RL_UPDLCK
+        && !is_group_owner(owner);
+}
+
+/**
+ * @brief Applies `lck` once, without waiting
+ * @param file the file on which to apply `lck`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @return 0 on success, -1 on failure with errno set to EAGAIN if a
+ * conflicting lock is held by another owner
+ */
+static int set_lock(rl_open_file *file, rl_owner owner, struct flock *lck) {
+    int res;
+    if (file->flags & RL_ATTR_BLOCKS)
+        res = apply_block_lock(file, owner, lck);
+    else if (uses_fast_slots(file, owner, lck->l_type)
+            && (lck->l_type == F_UNLCK ? try_fast_unlock(file, owner, lck)
+                : try_fast_lock(file, owner, lck)) == 1)
+        res = 0;
+    else if (file->flags & RL_ATTR_COMBINING)
+        res = combine_request(file, owner, lck);
+    else
+        res = lock_and_apply(file, owner, lck);
+
+    /* an unlock or a conversion to a read lock may let waiters in */
+    if (res == 0 && lck->l_type != F_WRLCK) {
+        notify_release(file);
+        grant_pending(file);
+    }
+    int fd = rla.nb_policies > 0 ? get_owner_fd(file, owner) : -1;
+    if (res == 0 && fd != -1)
+        apply_policy(fd, lck);
+    return res;
+}
+
+/**
+ * @brief Applies `lck`, waiting for the conflicting locks to be released
+ *
+ * The waiter is counted in `file` before each attempt, so that every release
+ * that happens after an attempt failed bumps the release sequence.
+ *
+ * @param file the file on which to apply `lck`
+ * @param owner the owner of the lock
+ * @param lck the lock to apply, relative to the beginning of the file
+ * @param deadline the CLOCK_MONOTONIC time in ns after which the waiter gives
+ *                 up, -1 for none
+ * @return 0 on success, -1 on failure with errno set to EINTR if a signal
+ *         interrupted the wait or ETIMEDOUT if `deadline` has passed
+ */
+static int set_lock_wait(rl_open_file *file, rl_owner owner,
+        struct flock *lck, long long deadline) {
+    atomic_fetch_add(&file->nb_waiters, 1);
+    int res;
+    for (unsigned int nb_failures = 0; ; nb_failures++) {
+        int seq = atomic_load(&file->release_seq);
+        res = set_lock(file, owner, lck);
+        if (res == 0 || errno != EAGAIN)
+            break;
+        if (deadline >= 0 && get_time_ns() >= deadline) {
+            errno = ETIMEDOUT;
+            break;
+        }
+        if (wait_for_release(file, seq, nb_failures, deadline) == -1)
+            break;
+    }
+
+    int err = errno;
+    atomic_fetch_sub(&file->nb_waiters, 1);
+    errno = err;
+    return res;
+}
+
+/**
+ * @brief Checks the request `lck` on `lfd` and makes it relative to the
+ * beginning of the file
+ * @param lfd the descriptor on which `lck` will be applied
+ * @param lck the lock to apply
+ * @param req the request to fill
+ * @return 0 on success, -1 if `lck` is invalid or `lfd` is not open with the
+ *         access mode it requires
+ */
+static int get_request(rl_descriptor lfd, struct flock *lck,
+        struct flock *req) {
+    if (lfd.fd < 0 || lfd.file == NULL || lck == NULL
+            || lck->l_len < 0
+            || (lck->l_type != F_RDLCK && lck->l_type != F_WRLCK
+                    && lck->l_type != F_UNLCK && lck->l_type != RL_UPDLCK)
+            || (lck->l_type == RL_UPDLCK && lfd.file->flags & RL_ATTR_BLOCKS)
+            || (lck->l_whence != SEEK_SET && lck->l_whence != SEEK_CUR
+                    && lck->l_whence != SEEK_END))
+        return -1;
+
+    int flags = fcntl(lfd.fd, F_GETFL);
+    if (flags == -1)
+        return -1;
+    if (lck->l_type == F_RDLCK && !(flags & O_RDONLY) && !(flags & O_RDWR))
+        return -1;
+    if ((lck->l_type == F_WRLCK || lck->l_type == RL_UPDLCK)
+            && !(flags & O_WRONLY) && !(flags & O_RDWR))
+        return -1;
+
+    *req = *lck;
+    req->l_whence = SEEK_SET;
+    if (has_backing_file(lfd.file)) {
+        req->l_start = get_start(lck, lfd.fd);
+        return req->l_start == -1 ? -1 : 0;
+    }
+
+    /* the offsets of a lock space are relative to its beginning or its end */
+    off_t space = lfd.file->space;
+    if (lck->l_whence == SEEK_END && space > 0)
+        req->l_start += space;
+    else if (lck->l_whence != SEEK_SET)
+        req->l_start = -1;
+    if (req->l_start < 0 || (space > 0 && (req->l_len == 0 ?
+                    req->l_start >= space : req->l_len > space - req->l_start))) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Applies the lock or unlock described by `lck` if possible
+ *
+ * When `cmd` is F_SETLK, a non-blocking attempt to apply `lck` is made. When
+ * `cmd` is F_SETLKW, the caller waits until `lck` can be applied or a signal
+ * interrupts the wait: it spins for a while, adapted to the recent waits on
+ * the file, then sleeps until some locks are released. Deadlocks are not
+ * detected. If attempting to apply a read lock, the file must be open for
+ * reading. If attempting to apply a write lock, the file must be open for
+ * writing.
+ *
+ * Requests that conflict with no lock at all are granted with a few atomic
+ * operations in the fast slots of the open file, the others take its mutex.
+ * 
+ * @param lfd the descriptor on which `lck` will be applied
+ * @param cmd the action to perform, F_SETLK or F_SETLKW
+ * @param lck the lock to apply
+ * @return 0 on success, -1 on failure
+ */
+int rl_fcntl(rl_descriptor lfd, int cmd, struct flock *lck) {
+    if (cmd != F_SETLK && cmd != F_SETLKW)
+        return -1;
+
+    struct flock req;
+    if (get_request(lfd, lck, &req) == -1)
+        return -1;
+
+    rl_owner lfd_owner = get_owner(lfd);
+    if (cmd == F_SETLKW)
+        return set_lock_wait(lfd.file, lfd_owner, &req, -1);
+    return set_lock(lfd.file, lfd_owner, &req);
+}
+
+/**
+ * @brief Applies the lock or unlock described by `lck`, waiting at most until
+ * `deadline`
+ *
+ * Behaves like `rl_fcntl()` with F_SETLKW, except that the wait stops when
+ * the CLOCK_MONOTONIC clock reaches `deadline`.
+ *
+ * @param lfd the descriptor on which `lck` will be applied
+ * @param lck the lock to apply
+ * @param deadline the absolute CLOCK_MONOTONIC time at which to give up, NULL
+ *                 to wait without limit
+ * @return 0 on success, -1 on failure with errno set to ETIMEDOUT if
+ *         `deadline` passed before `lck` could be applied
+ */
+int rl_fcntl_timed(rl_descriptor lfd, struct flock *lck,
+        const struct timespec *deadline) {
+    if (deadline != NULL
+            && (deadline->tv_nsec < 0 || deadline->tv_nsec >= 1000000000L)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct flock req;
+    if (get_request(lfd, lck, &req) == -1)
+        return -1;
+
+    long long limit = -1;
+    if (deadline != NULL && deadline->tv_sec < LLONG_MAX / 1000000000LL)
+        limit = deadline->tv_sec < 0 ? 0
+            : deadline->tv_sec * 1000000000LL + deadline->tv_nsec;
+    rl_owner lfd_owner = get_owner(lfd);
+    return set_lock_wait(lfd.file, lfd_owner, &req, limit);
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Checks if `owner` holds a range lock that `mode` doesn't allow
+ * @param file the file created with `RL_ATTR_INTENTS`
+ * @param owner the owner of the locks
+ * @param mode the `RL_MODE_*` mode, or `RL_MODE_NONE`
+ * @return 1 if it does, 0 otherwise
+ */
+static int holds_uncovered_lock(rl_open_file *file, rl_owner owner, int mode) {
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *lck = &file->lock_table[i];
+        if (!mode_covers(mode, lck->type) && is_owner_of(file, owner, lck))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sets the file-level mode of `owner` to `mode` if possible
+ * @param file the file created with `RL_ATTR_INTENTS`
+ * @param owner the owner of the mode
+ * @param mode the `RL_MODE_*` mode, `RL_MODE_NONE` to release the mode held
+ * @return 0 on success, -1 on failure with errno set to EAGAIN if another
+ *         owner holds a conflicting mode, EBUSY if `owner` holds range locks
+ *         that `mode` doesn't allow or ENOLCK if too many modes are held
+ */
+static int set_mode(rl_open_file *file, rl_owner owner, int mode) {
+    if (lock_open_file(file) != 0)
+        return -1;
+
+    int res = -1;
+    pid_t pid = 1;
+    while (mode != RL_MODE_NONE
+            && (pid = is_mode_applicable(file, owner, mode)) > 1) {
+        if (remove_locks_of(pid, file) == -1)
+            goto unlock;
+    }
+
+    int i = find_intent(file, owner);
+    if (pid == 0)
+        errno = EAGAIN;
+    else if (holds_uncovered_lock(file, owner, mode))
+        errno = EBUSY;
+    else if (mode == RL_MODE_NONE) {
+        if (i != -1)
+            drop_intents(file, equals, owner);
+        res = 0;
+    } else {
+        if (i == -1) {
+            rl_owner free_owner = {.pid = RL_FREE_OWNER, .fd = RL_FREE_OWNER};
+            i = find_intent(file, free_owner);
+        } else
+            file->nb_modes[get_intents(file)[i].mode]--;
+        if (i == -1)
+            errno = ENOLCK;
+        else {
+            get_intents(file)[i].owner = owner;
+            get_intents(file)[i].mode = mode;
+            file->nb_modes[mode]++;
+            res = 0;
+        }
+    }
+
+unlock: ;
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    errno = err;
+    return res;
+}
+
+/**
+ * @brief Takes, converts or releases the file-level mode of `lfd`
+ *
+ * On a file created with `RL_ATTR_INTENTS`, owners lock the whole file in one
+ * of the modes `RL_MODE_IS`, `RL_MODE_IX`, `RL_MODE_S`, `RL_MODE_SIX` and
+ * `RL_MODE_X`, and may only lock ranges as their mode allows: read locks need
+ * any mode, write locks need `RL_MODE_IX`, `RL_MODE_SIX` or `RL_MODE_X`, other
+ * requests fail with EPERM. A whole-file request is thus checked against the
+ * number of holders of each mode instead of the range locks. A descriptor
+ * holds one mode at a time, requesting another mode converts it. The modes are
+ * not copied by `rl_dup()` and `rl_fork()`.
+ *
+ * When `cmd` is F_SETLKW, the caller waits like with `rl_fcntl()` until the
+ * mode can be held or a signal interrupts the wait.
+ *
+ * @param lfd the descriptor of a file created with `RL_ATTR_INTENTS`
+ * @param cmd F_SETLK or F_SETLKW
+ * @param mode the `RL_MODE_*` mode, `RL_MODE_NONE` to release the mode held
+ * @return 0 on success, -1 on failure with errno set to EAGAIN if another
+ *         owner holds a conflicting mode, EBUSY if `lfd` holds range locks
+ *         that `mode` doesn't allow, EBADF if `lfd` is not open with the
+ *         access mode `mode` requires
+ */
+int rl_lock_file(rl_descriptor lfd, int cmd, int mode) {
+    if (lfd.fd < 0 || lfd.file == NULL
+            || !(lfd.file->flags & RL_ATTR_INTENTS)
+            || (cmd != F_SETLK && cmd != F_SETLKW)
+            || mode < RL_MODE_NONE || mode >= RL_NB_MODES) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int flags = fcntl(lfd.fd, F_GETFL);
+    if (flags == -1)
+        return -1;
+    if ((mode == RL_MODE_IS || mode == RL_MODE_S)
+            && (flags & O_ACCMODE) == O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    if ((mode == RL_MODE_IX || mode == RL_MODE_SIX || mode == RL_MODE_X)
+            && (flags & O_ACCMODE) == O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    rl_owner lfd_owner = get_owner(lfd);
+    rl_open_file *file = lfd.file;
+    if (cmd == F_SETLK) {
+        int res = set_mode(file, lfd_owner, mode);
+        if (res == 0)
+            notify_release(file);
+        return res;
+    }
+
+    atomic_fetch_add(&file->nb_waiters, 1);
+    int res;
+    for (unsigned int nb_failures = 0; ; nb_failures++) {
+        int seq = atomic_load(&file->release_seq);
+        res = set_mode(file, lfd_owner, mode);
+        if (res == 0 || errno != EAGAIN
+                || wait_for_release(file, seq, nb_failures, -1) == -1)
+            break;
+    }
+    int err = errno;
+    atomic_fetch_sub(&file->nb_waiters, 1);
+    if (res == 0)
+        notify_release(file);
+    errno = err;
+    return res;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Gets the strength of a lock type
+ * @param type F_RDLCK, RL_UPDLCK or F_WRLCK
+ * @return 0 for F_RDLCK, 1 for RL_UPDLCK, 2 for F_WRLCK
+ */
+static int get_strength(short type) {
+    return type == F_RDLCK ? 0 : type == RL_UPDLCK ? 1 : 2;
+}
+
+/**
+ * @brief Finds the locks of `owner` in the segment of `req` whose strength is
+ * between `min` and `max`
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner of the locks
+ * @param req the segment, relative to the beginning of the file
+ * @param min the lowest strength to look for
+ * @param max the highest strength to look for
+ * @param found where to put the locks found, at least `RL_MAX_LOCKS` cells
+ * @return the number of locks found, -1 with errno set to EINVAL if none was
+ *         found or if one of them is not entirely in the segment
+ */
+static int find_owned_locks(rl_open_file *file, rl_owner owner,
+        struct flock *req, int min, int max, rl_lock **found) {
+    int nb_found = 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        int strength = get_strength(cur->type);
+        if (strength < min || strength > max
+                || !seg_overlap(cur->start, cur->len, req->l_start, req->l_len)
+                || !is_owner_of(file, owner, cur))
+            continue;
+        if (!covers_entirely(cur->start, cur->len, req->l_start, req->l_len)) {
+            errno = EINVAL;
+            return -1;
+        }
+        found[nb_found++] = cur;
+    }
+    if (nb_found == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return nb_found;
+}
+
+/**
+ * @brief Changes the type of `lck` in place
+ *
+ * This function must be called with the mutex of `file` held. On a file
+ * created with `RL_ATTR_COUNTED_READERS`, the owners of a lock converted to a
+ * read lock are moved into its reader map.
+ *
+ * @param file the file that contains `lck`
+ * @param lck the lock to convert
+ * @param type the new type of `lck`
+ * @return 0 on success, -1 on error
+ */
+static int convert_lock(rl_open_file *file, rl_lock *lck, short type) {
+    lck->upgrading = 0;
+    if (type != F_RDLCK || !(file->flags & RL_ATTR_COUNTED_READERS)) {
+        lck->type = type;
+        return 0;
+    }
+
+    rl_owner owners[RL_MAX_OWNERS];
+    size_t nb_owners = lck->nb_owners;
+    for (size_t i = 0; i < nb_owners; i++) {
+        owners[i] = *get_lock_owner(file, lck, i);
+        erase_owner(get_lock_owner(file, lck, i));
+    }
+    lck->nb_owners = 0;
+    give_back_chunk(file, lck);
+    lck->type = type;
+    for (size_t i = 0; i < nb_owners; i++) {
+        if (add_owner(file, owners[i], lck) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tries to upgrade the update locks of `owner` in the segment of `req`
+ * to write locks
+ *
+ * The locks are marked as being upgraded first, so that new read requests on
+ * their segment are refused, even in the fast and biased slots.
+ *
+ * @param file the file that contains the locks
+ * @param owner the owner of the locks
+ * @param req the segment, relative to the beginning of the file
+ * @param give_up whether to clear the marks instead of upgrading the locks
+ * @return 0 if the locks were upgraded, 1 if read locks of other owners are
+ *         still held on the segment, -1 on error
+ */
+static int try_upgrade(rl_open_file *file, rl_owner owner, struct flock *req,
+        int give_up) {
+    if (lock_open_file(file) != 0)
+        return -1;
+
+    rl_lock *found[RL_MAX_LOCKS];
+    int res = -1;
+    int nb_found = find_owned_locks(file, owner, req, 1, 1, found);
+    if (nb_found == -1 || give_up)
+        goto unlock;
+
+    for (int i = 0; i < nb_found; i++)
+        found[i]->upgrading = 1;
+    if (file->flags & RL_ATTR_READER_BIAS && revoke_bias(file) == -1)
+        goto unlock;
+    include_in_summary(file, req->l_start, req->l_len, F_WRLCK);
+    rl_owner any = {.pid = 0, .fd = 0};
+    if (absorb_fast_locks(file, req->l_start, req->l_len, F_WRLCK, NULL, any)
+            == -1)
+        goto unlock;
+
+    pid_t pid;
+    while ((pid = is_lock_applicable(req, file, owner)) > 1) {
+        if (remove_locks_of(pid, file) == -1)
+            goto unlock;
+    }
+    if (pid == 0)
+        res = 1;
+    else if (pid == 1) {
+        res = 0;
+        for (int i = 0; i < nb_found; i++)
+            convert_lock(file, found[i], F_WRLCK);
+    }
+
+unlock:
+    for (int i = 0; res != 1 && i < nb_found; i++)
+        found[i]->upgrading = 0;
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    errno = err;
+    return res;
+}
+
+/**
+ * @brief Upgrades update locks to write locks in place
+ *
+ * The update locks of `lfd` in the segment of `lck` become write locks once
+ * the read locks of the other owners on the segment are released. Since a
+ * segment has at most one update lock, the upgrade can't be prevented by
+ * another upgrade: the caller waits like with F_SETLKW, and meanwhile new read
+ * requests on the segment are refused, so that it gets the write lock first.
+ * The segment must contain entirely the update locks it overlaps.
+ *
+ * @param lfd the descriptor that holds the update locks
+ * @param lck the segment to upgrade, of type F_WRLCK
+ * @return 0 on success, -1 on failure with errno set to EINVAL if `lfd` holds
+ *         no update lock in the segment or EINTR if a signal interrupted the
+ *         wait, in which case the update locks are kept
+ */
+int rl_upgrade(rl_descriptor lfd, struct flock *lck) {
+    struct flock req;
+    if (get_request(lfd, lck, &req) == -1 || req.l_type != F_WRLCK) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rl_open_file *file = lfd.file;
+    rl_owner lfd_owner = get_owner(lfd);
+    atomic_fetch_add(&file->nb_waiters, 1);
+    int res;
+    for (unsigned int nb_failures = 0; ; nb_failures++) {
+        int seq = atomic_load(&file->release_seq);
+        res = try_upgrade(file, lfd_owner, &req, 0);
+        if (res != 1)
+            break;
+        if (wait_for_release(file, seq, nb_failures, -1) == -1) {
+            int err = errno;
+            try_upgrade(file, lfd_owner, &req, 1);
+            errno = err;
+            res = -1;
+            break;
+        }
+    }
+    int err = errno;
+    atomic_fetch_sub(&file->nb_waiters, 1);
+    errno = err;
+    return res;
+}
+
+/**
+ * @brief Downgrades write or update locks in place
+ *
+ * The locks of `lfd` in the segment of `lck` that are stronger than the type
+ * of `lck` become locks of that type, which never waits. The segment must
+ * contain entirely the locks it converts.
+ *
+ * @param lfd the descriptor that holds the locks
+ * @param lck the segment to downgrade, of type F_RDLCK or RL_UPDLCK
+ * @return 0 on success, -1 on failure with errno set to EINVAL if `lfd` holds
+ *         no lock to downgrade in the segment
+ */
+int rl_downgrade(rl_descriptor lfd, struct flock *lck) {
+    struct flock req;
+    if (get_request(lfd, lck, &req) == -1
+            || (req.l_type != F_RDLCK && req.l_type != RL_UPDLCK)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rl_open_file *file = lfd.file;
+    rl_owner lfd_owner = get_owner(lfd);
+    if (lock_open_file(file) != 0)
+        return -1;
+
+    int res = -1;
+    rl_lock *found[RL_MAX_LOCKS];
+    int nb_found = -1;
+    if (absorb_fast_locks(file, req.l_start, req.l_len, F_UNLCK, equals,
+                lfd_owner) == 0)
+        nb_found = find_owned_locks(file, lfd_owner, &req,
+                get_strength(req.l_type) + 1, 2, found);
+    if (nb_found != -1) {
+        res = 0;
+        for (int i = 0; res == 0 && i < nb_found; i++)
+            res = convert_lock(file, found[i], req.l_type);
+    }
+
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    if (res == 0) {
+        notify_release(file);
+        grant_pending(file);
+    }
+    errno = err;
+    return res;
+}
+
+/**
+ * @brief Gets the owner on behalf of which `lfd` locks, which identifies it
+ * as the target of `rl_transfer()` in another process
+ * @param lfd the descriptor
+ * @return the owner of the locks of `lfd`
+ */
+rl_owner rl_get_owner(rl_descriptor lfd) {
+    return get_owner(lfd);
+}
+
+/**
+ * @brief Checks if `target` may receive locks on `file`
+ *
+ * This function must be called with the mutex of `file` held.
+ *
+ * @param file the file of the locks
+ * @param target the owner that receives the locks
+ * @return 0 if it may, -1 with errno set to ESRCH if its process has died or
+ *         EINVAL if it does not have `file` open
+ */
+static int check_target(rl_open_file *file, rl_owner target) {
+    if (is_group_owner(target)) {
+        int g = get_group(target);
+        if (file->flags & RL_ATTR_GROUPS && g < RL_MAX_GROUPS
+                && get_groups(file)[g].name[0] != '\0' && target.fd == 0)
+            return 0;
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (target.pid <= 0 || target.fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (is_process_dead(file, target.pid)) {
+        errno = ESRCH;
+        return -1;
+    }
+    for (int i = 0; i < file->nb_map_entries; i++) {
+        if (get_pid_map(file)[i].pid == target.pid)
+            return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+/**
+ * @brief Checks that `target` may receive the locks of `found`
+ *
+ * This function must be called with the mutex of `file` held. On a file
+ * created with `RL_ATTR_INTENTS`, the mode of `target` must allow every lock,
+ * and `target` must not exceed its quota with the locks it doesn't own yet.
+ *
+ * @param file the file that contains the locks
+ * @param target the owner that receives the locks
+ * @param found the locks to hand over
+ * @param nb_found the number of locks in `found`
+ * @return 0 if it may, -1 otherwise with errno set to EPERM if the mode of
+ *         `target` doesn't allow a lock, or EDQUOT if it would exceed its
+ *         quota
+ */
+static int check_transfer(rl_open_file *file, rl_owner target,
+        rl_lock **found, int nb_found) {
+    int intents = file->flags & RL_ATTR_INTENTS;
+    int mode = intents ? get_mode(file, target) : RL_MODE_NONE;
+    int nb_new = 0;
+    for (int i = 0; i < nb_found; i++) {
+        if (intents && !mode_covers(mode, found[i]->type)) {
+            errno = EPERM;
+            return -1;
+        }
+        if (!is_owner_of(file, target, found[i]))
+            nb_new++;
+    }
+
+    int quota = is_group_owner(target) ? file->group_quota : file->quota;
+    if (quota > 0 && count_owned_locks(file, target, -1) + nb_new > quota) {
+        errno = EDQUOT;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Hands over locks to another owner without releasing them
+ *
+ * The locks of `lfd` in the segment of `lck`, whatever their type, become
+ * locks of `target` in a single critical section, so that no other owner can
+ * take the segment in between. `target` is the result of `rl_get_owner()` on
+ * a descriptor of the file, usually sent by its process over a pipe or a
+ * unix socket. The segment must contain entirely the locks it overlaps. The
+ * type of `lck` is ignored.
+ *
+ * @param lfd the descriptor that holds the locks
+ * @param lck the segment of the locks to hand over
+ * @param target the owner that receives the locks
+ * @return 0 on success, -1 on failure with errno set to EINVAL if `lfd` holds
+ *         no lock in the segment or `target` is not an owner of the file,
+ *         ESRCH if the process of `target` has died, ENOLCK if `target`
+ *         can't be registered as a reader, EPERM if the file-level mode of
+ *         `target` doesn't allow one of the locks, or EDQUOT if `target`
+ *         would exceed its quota
+ */
+int rl_transfer(rl_descriptor lfd, struct flock *lck, rl_owner target) {
+    struct flock req;
+    if (lck == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct flock segment = *lck;
+    segment.l_type = F_UNLCK;
+    if (get_request(lfd, &segment, &req) == -1
+            || lfd.file->flags & RL_ATTR_BLOCKS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rl_open_file *file = lfd.file;
+    rl_owner lfd_owner = get_owner(lfd);
+    if (equals(lfd_owner, target)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (lock_open_file(file) != 0)
+        return -1;
+
+    rl_lock *found[RL_MAX_LOCKS];
+    int nb_found = -1;
+    if (check_target(file, target) == 0
+            && absorb_fast_locks(file, req.l_start, req.l_len, F_UNLCK, equals,
+                lfd_owner) == 0)
+        nb_found = find_owned_locks(file, lfd_owner, &req, 0, 2, found);
+
+    /* registered first, so that the owners are rewritten without failure */
+    int res = nb_found == -1 ? -1 : check_transfer(file, target, found,
+            nb_found);
+    for (int i = 0; res == 0 && i < nb_found; i++) {
+        if (has_reader_map(file, found[i])
+                && find_reader(file, target, 1) == -1) {
+            errno = ENOLCK;
+            res = -1;
+        }
+    }
+
+    for (int i = 0; res == 0 && i < nb_found; i++) {
+        rl_lock *cur = found[i];
+        if (is_owner_of(file, target, cur)) {
+            remove_owner(file, lfd_owner, cur);
+            continue;
+        }
+        if (has_reader_map(file, cur)) {
+            remove_owner(file, lfd_owner, cur);
+            add_owner(file, target, cur);
+            continue;
+        }
+        for (int j = 0; j < cur->nb_owners; j++) {
+            if (equals(*get_lock_owner(file, cur, j), lfd_owner))
+                *get_lock_owner(file, cur, j) = target;
+        }
+    }
+
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    /* the target may be waiting for its own locks */
+    if (res == 0) {
+        notify_release(file);
+        grant_pending(file);
+    }
+    errno = err;
+    return res;
+}
+
+/**
+ * @brief Renews the lease of `lfd` on its locks
+ *
+ * The lease is also renewed by every lock request of `lfd`.
+ *
+ * @param lfd the descriptor that holds the locks
+ * @return 0 on success, -1 on failure with errno set to EKEYEXPIRED if the
+ *         locks of `lfd` were revoked since its last request, ENOLCK if all
+ *         the leases of the file are held, or EINVAL if the file was not
+ *         created with leases
+ */
+int rl_renew(rl_descriptor lfd) {
+    if (lfd.fd < 0 || lfd.file == NULL || lfd.file->lease_ns == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rl_open_file *file = lfd.file;
+    rl_owner lfd_owner = get_owner(lfd);
+    if (lock_open_file(file) != 0)
+        return -1;
+    int res = 0;
+    if (take_revoked(file, lfd_owner)) {
+        errno = EKEYEXPIRED;
+        res = -1;
+    } else
+        res = renew_lease(file, lfd_owner);
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    errno = err;
+    return res;
+}
+
+/**
+ * @brief Puts `owner` in `usage` if it is among the `max` owners that own the
+ * most locks of the lock table of `file`
+ *
+ * An owner is only counted at the first lock it owns, the `i`-th one of the
+ * table. This function must be called with the mutex of `file` held.
+ *
+ * @param file the file that contains the locks
+ * @param i the index of a lock owned by `owner`
+ * @param owner the owner of the lock
+ * @param usage the owners that own the most locks, by decreasing number
+ * @param nb_kept the number of owners in `usage`, updated
+ * @param max the number of cells of `usage`
+ * @return 1 if `owner` was counted, 0 if it owns an earlier lock
+ */
+static int report_usage(rl_open_file *file, int i, rl_owner owner,
+        rl_usage *usage, int *nb_kept, int max) {
+    for (int k = 0; k < i; k++) {
+        if (is_owner_of(file, owner, &file->lock_table[k]))
+            return 0;
+    }
+
+    int nb_locks = count_owned_locks(file, owner, -1);
+    int j = *nb_kept < max ? (*nb_kept)++ : max;
+    for (; j > 0 && usage[j - 1].nb_locks < nb_locks; j--) {
+        if (j < max)
+            usage[j] = usage[j - 1];
+    }
+    if (j < max) {
+        usage[j].owner = owner;
+        usage[j].nb_locks = nb_locks;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reports the owners that use the lock table of the file of `lfd`
+ *
+ * The owners are sorted by decreasing number of locks. The locks in the fast
+ * slots are not counted, since they don't use the lock table.
+ *
+ * @param lfd a descriptor of the file
+ * @param usage where to put the `max` owners that own the most locks
+ * @param max the number of cells of `usage`
+ * @return the number of owners of the locks of the table, which may be more
+ *         than `max`, -1 on error
+ */
+int rl_lock_usage(rl_descriptor lfd, rl_usage *usage, int max) {
+    if (lfd.fd < 0 || lfd.file == NULL || (usage == NULL && max > 0)
+            || max < 0 || lfd.file->flags & RL_ATTR_BLOCKS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rl_open_file *file = lfd.file;
+    if (lock_open_file(file) != 0)
+        return -1;
+    int nb = 0;
+    int nb_kept = 0;
+    for (int i = 0; i < file->nb_locks; i++) {
+        rl_lock *cur = &file->lock_table[i];
+        for (int j = 0; j < cur->nb_owners; j++)
+            nb += report_usage(file, i, *get_lock_owner(file, cur, j), usage,
+                    &nb_kept, max);
+        for (int r = 0; has_reader_map(file, cur) && r < RL_MAX_READERS; r++) {
+            if (test_reader(file, cur, r))
+                nb += report_usage(file, i, get_readers(file)[r], usage,
+                        &nb_kept, max);
+        }
+    }
+    if (unlock_open_file(file) != 0)
+        return -1;
+    return nb;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Frees the pending request of `async` and closes its descriptor
+ * @param async the handle of the request
+ */
+static void free_pending(rl_async_request *async) {
+    rl_open_file *file = async->file;
+    atomic_fetch_sub(&file->nb_pending, 1);
+    atomic_fetch_sub(&file->nb_waiters, 1);
+    atomic_store(&get_pending(file)[async->slot].state, RL_PENDING_FREE);
+    if (async->fd != -1)
+        close(async->fd);
+    async->fd = -1;
+}
+
+/**
+ * @brief Applies the lock described by `lck` asynchronously
+ *
+ * If `lck` can be applied at once, it is applied and `async->fd` is set to -1.
+ * Otherwise the request is registered in the open file and `async->fd` is set
+ * to a descriptor which becomes readable once the request is granted by the
+ * process releasing the conflicting locks, has failed, or has been cancelled
+ * by `rl_close()`. The outcome is then given by `rl_async_result()`. The
+ * descriptor must not be closed by the caller.
+ *
+ * @param lfd the descriptor on which `lck` will be applied
+ * @param lck the lock to apply, of type F_RDLCK or F_WRLCK
+ * @param async the handle of the request to fill
+ * @return 0 if `lck` was applied at once, 1 if the request is pending, -1 on
+ *         failure with errno set to ENOLCK if too many requests are pending,
+ *         or EINVAL if the file was not created with `RL_ATTR_ASYNC`
+ */
+int rl_fcntl_async(rl_descriptor lfd, struct flock *lck,
+        rl_async_request *async) {
+    static unsigned int next_id = 0;
+
+    struct flock req;
+    if (async == NULL || get_request(lfd, lck, &req) == -1)
+        return -1;
+    if (req.l_type == F_UNLCK || !(lfd.file->flags & RL_ATTR_ASYNC)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rl_open_file *file = lfd.file;
+    rl_owner lfd_owner = get_owner(lfd);
+    int slot = -1;
+    for (int p = 0; slot == -1 && p < RL_MAX_PENDING; p++) {
+        int expected = RL_PENDING_FREE;
+        if (atomic_compare_exchange_strong(&get_pending(file)[p].state,
+                    &expected, RL_PENDING_CLAIMED))
+            slot = p;
+    }
+    if (slot == -1) {
+        errno = ENOLCK;
+        return -1;
+    }
+
+    rl_pending_request *pending = &get_pending(file)[slot];
+    pending->owner = lfd_owner;
+    pending->pid = getpid();
+    pending->id = next_id++;
+    pending->type = req.l_type;
+    pending->start = req.l_start;
+    pending->len = req.l_len;
+    pending->error = 0;
+
+    struct sockaddr_un addr;
+    socklen_t len = get_pending_address(pending->pid, pending->id, &addr);
+    async->file = file;
+    async->slot = slot;
+    async->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (async->fd == -1
+            || bind(async->fd, (struct sockaddr *) &addr, len) == -1) {
+        int err = errno;
+        if (async->fd != -1)
+            close(async->fd);
+        atomic_store(&pending->state, RL_PENDING_FREE);
+        errno = err;
+        return -1;
+    }
+
+    /* registered before the first attempt, so that a release after a failed
+     * attempt either bumps the release sequence or finds the request */
+    atomic_fetch_add(&file->nb_waiters, 1);
+    atomic_fetch_add(&file->nb_pending, 1);
+    atomic_store(&pending->state, RL_PENDING_BUSY);
+    for (;;) {
+        int seq = atomic_load(&file->release_seq);
+        if (set_lock(file, lfd_owner, &req) == 0) {
+            free_pending(async);
+            return 0;
+        }
+        if (errno != EAGAIN) {
+            int err = errno;
+            free_pending(async);
+            errno = err;
+            return -1;
+        }
+
+        atomic_store(&pending->state, RL_PENDING_WAITING);
+        if (atomic_load(&file->release_seq) == seq)
+            return 1;
+        int expected = RL_PENDING_WAITING;
+        if (!atomic_compare_exchange_strong(&pending->state, &expected,
+                    RL_PENDING_BUSY))
+            return 1; /* taken by a releasing process */
+    }
+}
+
+/**
+ * @brief Gets the outcome of the asynchronous request `async`, once its
+ * descriptor is readable
+ *
+ * On success or failure, the request is freed and its descriptor is closed.
+ *
+ * @param async the handle filled by `rl_fcntl_async()`
+ * @return 0 if the lock was granted, -1 on failure with errno set to EAGAIN
+ *         if the request is still pending, ECANCELED if it was cancelled, or
+ *         the error of the request if it failed
+ */
+int rl_async_result(rl_async_request *async) {
+    if (async == NULL || async->fd == -1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char c;
+    if (recv(async->fd, &c, 1, MSG_DONTWAIT) == -1)
+        return -1;
+
+    rl_pending_request *req = &get_pending(async->file)[async->slot];
+    int state = atomic_load(&req->state);
+    int err = state == RL_PENDING_FAILED ? req->error : ECANCELED;
+    free_pending(async);
+    if (state == RL_PENDING_GRANTED)
+        return 0;
+    errno = err;
+    return -1;
+}
+
+/**
+ * @brief Cancels the asynchronous request `async`
  *
- * If l1 or l2 equal 0, the segment is extensible, which would make the segment
- * as follows: [s*, inf[
+ * The request is freed and its descriptor is closed. If the request had been
+ * granted meanwhile, the lock is held by the caller, who has to release it.
  *
- * @param s1 the start of the first segment
- * @param l1 the length of the first segment, 0 if extensible
- * @param s2 the start of the second segment
- * @param l2 the length of the second segment, 0 if extensible
- * @return 1 if the segments overlap, 0 otherwise
+ * @param async the handle filled by `rl_fcntl_async()`
+ * @return 0 if the request was cancelled before being granted, 1 if it had
+ *         been granted, -1 on error
  */
-static int seg_overlap(off_t s1, off_t l1, off_t s2, off_t l2) {
-    if (l1 == 0)
-        return (l2 == 0) || (l2 > 0 && s2 + l2 - 1 >= s1);
+int rl_async_cancel(rl_async_request *async) {
+    if (async == NULL || async->fd == -1) {
+        errno = EINVAL;
+        return -1;
+    }
 
-    if (s2 >= s1)
-        return s2 < s1 + l1;
-    else
-        return l2 == 0 || s2 + l2 > s1;
+    rl_pending_request *req = &get_pending(async->file)[async->slot];
+    int state;
+    for (;;) {
+        state = atomic_load(&req->state);
+        int expected = RL_PENDING_WAITING;
+        if (state == RL_PENDING_BUSY)
+            sched_yield(); /* a releasing process is applying it */
+        else if (state != RL_PENDING_WAITING
+                || atomic_compare_exchange_strong(&req->state, &expected,
+                    RL_PENDING_CANCELLED))
+            break;
+    }
+
+    free_pending(async);
+    return state == RL_PENDING_GRANTED;
 }
 
+/******************************************************************************/
+
 /**
- * @brief Checks if the lock is owned by an rl_owner different than owner
- * 
- * This function does not use any locking mechanism to secure the access to
- * lock, nor tests if owner is in fact an owner of lock.
- * 
- * @param lock the lock to check
- * @param owner the owner to compare the lock owners with
- * @return 1 if the lock is owned by a different owner, 0 otherwise
+ * @brief The maximal number of segments of a range an owner can hold locks on,
+ * see `get_held_segments()`
  */
-static int has_different_owner(const rl_lock *lock, rl_owner owner) {
-    for (int i = 0; i < RL_MAX_OWNERS; i++) {
-        rl_owner other = lock->lock_owners[i];
-        if (!is_owner_free(&other)) {
-            if (!equals(other, owner))
-                return 1;
+#define RL_MAX_HELD (RL_MAX_LOCKS + RL_FAST_SLOTS + RL_BIAS_SLOTS)
+
+/**
+ * @brief A segment of a range on which an owner holds a lock
+ */
+typedef struct {
+    off_t start; /**< The beginning of the segment */
+    off_t end; /**< The end of the segment, excluded */
+    short type; /**< The type of the lock held on the segment */
+} rl_held_segment;
+
+/**
+ * @brief Adds to `held` the part of the lock (start, len) of type `type` that
+ * is in [first; last[
+ * @param held the segments found so far
+ * @param nb_held the number of segments in `held`
+ * @param start the start of the lock
+ * @param len the length of the lock, 0 if extensible
+ * @param type the type of the lock
+ * @param first the start of the range
+ * @param last the end of the range, excluded
+ * @return the new number of segments, -1 with errno set to ENOLCK if `held`
+ *         is full
+ */
+static int add_held_segment(rl_held_segment *held, int nb_held, off_t start,
+        off_t len, short type, off_t first, off_t last) {
+    if (!seg_overlap(start, len, first, last - first))
+        return nb_held;
+    if (nb_held == RL_MAX_HELD) {
+        errno = ENOLCK;
+        return -1;
+    }
+
+    rl_held_segment seg = {.start = start > first ? start : first,
+                           .end = len != 0 && start + len < last ?
+                               start + len : last,
+                           .type = type};
+    int i = nb_held;
+    while (i > 0 && held[i - 1].start > seg.start) {
+        held[i] = held[i - 1];
+        i--;
+    }
+    held[i] = seg;
+    return nb_held + 1;
+}
+
+/**
+ * @brief Adds to `held` the locks of `owner` in the slots `slots` that overlap
+ * [first; last[
+ * @param slots the slots to look at
+ * @param nb_slots the number of slots in `slots`
+ * @param owner the owner of the locks
+ * @param held the segments found so far
+ * @param nb_held the number of segments in `held`
+ * @param first the start of the range
+ * @param last the end of the range, excluded
+ * @return the new number of segments, -1 on error
+ */
+static int add_held_slots(rl_fast_slot *slots, int nb_slots, rl_owner owner,
+        rl_held_segment *held, int nb_held, off_t first, off_t last) {
+    for (int i = 0; i < nb_slots && nb_held != -1; i++) {
+        rl_fast_slot *slot = &slots[i];
+        if (SLOT_KIND(atomic_load(&slot->state)) == RL_SLOT_HELD
+                && equals(slot->owner, owner))
+            nb_held = add_held_segment(held, nb_held, slot->start, slot->len,
+                    slot->type, first, last);
+    }
+    return nb_held;
+}
+
+/**
+ * @brief Finds the segments of [first; last[ on which `owner` holds locks
+ *
+ * The locks of `owner` only change through its own requests. Its fast locks
+ * are looked at without the mutex, then the summary tells if the lock table
+ * may hold some of its locks too: the fast locks that are moved into the lock
+ * table extend the summary before leaving their slot, so none is missed. Only
+ * in that case is the mutex taken.
+ *
+ * @param file the locked file
+ * @param owner the owner of the locks
+ * @param first the start of the range
+ * @param last the end of the range, excluded
+ * @param held where to put the segments, sorted by start, at least
+ *        `RL_MAX_HELD` cells
+ * @return the number of segments, -1 on error
+ */
+static int get_held_segments(rl_open_file *file, rl_owner owner, off_t first,
+        off_t last, rl_held_segment *held) {
+    int nb_held = 0;
+    if (file->flags & RL_ATTR_BLOCKS) {
+        rl_block_area area;
+        get_block_area((char *) file + file->blocks_offset, file->nb_blocks,
+                &area);
+        unsigned long long self = pack_owner(owner);
+        int holder = find_block_holder(&area, file->nb_blocks, self, 0);
+        atomic_ulong *own_map = holder >= 0 ? &area.holder_maps[holder
+            * block_map_words(file->nb_blocks)] : NULL;
+        size_t bs = file->block_size;
+        for (size_t b = first / bs; b < file->nb_blocks
+                && (off_t) (b * bs) < last && nb_held != -1; b++) {
+            short type = atomic_load(&area.writers[b]) == self ? F_WRLCK
+                : test_block_bit(own_map, b) ? F_RDLCK : F_UNLCK;
+            if (type == F_UNLCK)
+                continue;
+            if (nb_held > 0 && held[nb_held - 1].end == (off_t) (b * bs)
+                    && held[nb_held - 1].type == type)
+                held[nb_held - 1].end += bs;
+            else
+                nb_held = add_held_segment(held, nb_held, b * bs, bs, type,
+                        first, last);
         }
+        return nb_held;
     }
-    return 0;
+
+    nb_held = add_held_slots(file->fast_slots, RL_FAST_SLOTS, owner, held, 0,
+            first, last);
+    nb_held = add_held_slots(get_bias_slots(file), get_nb_bias_slots(file),
+            owner, held, nb_held, first, last);
+    off_t s_start, s_len;
+    int writer;
+    read_summary(file, &s_start, &s_len, &writer);
+    if (nb_held == -1 || s_len == -1
+            || !seg_overlap(s_start, s_len, first, last - first))
+        return nb_held;
+
+    if (lock_open_file(file) != 0)
+        return -1;
+    nb_held = add_held_slots(file->fast_slots, RL_FAST_SLOTS, owner, held, 0,
+            first, last);
+    nb_held = add_held_slots(get_bias_slots(file), get_nb_bias_slots(file),
+            owner, held, nb_held, first, last);
+    for (int i = 0; i < file->nb_locks && nb_held != -1; i++) {
+        rl_lock *lck = &file->lock_table[i];
+        if (is_owner_of(file, owner, lck))
+            nb_held = add_held_segment(held, nb_held, lck->start, lck->len,
+                    lck->type, first, last);
+    }
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    errno = err;
+    return nb_held;
 }
 
 /**
- * @brief Computes the starting offset of the lock of the file denoted by fd.
- * @param lck a lock on a region
- * @param fd the file descriptor of the file to lock
- * @return the starting offset of the region or -1 if it could not be determined
+ * @brief Applies a lock of type `type` on [start; end[ without waiting
+ *
+ * With `locked` set, the request is applied under the mutex of `file`, which
+ * the caller holds.
+ *
+ * @param file the locked file
+ * @param owner the owner of the lock
+ * @param type the type of the lock
+ * @param start the start of the segment
+ * @param end the end of the segment, excluded
+ * @param locked whether the caller holds the mutex of `file`
+ * @return 0 on success, -1 on error
  */
-static off_t get_start(struct flock *lck, int fd) {
-    if (lck == NULL)
+static int set_segment(rl_open_file *file, rl_owner owner, short type,
+        off_t start, off_t end, int locked) {
+    struct flock lck = {.l_type = type, .l_whence = SEEK_SET,
+                        .l_start = start, .l_len = end - start};
+    return locked ? apply_request(file, owner, &lck)
+        : set_lock(file, owner, &lck);
+}
+
+/**
+ * @brief Gives back to `owner` the locks it held on [first; last[ before it was
+ * locked with the type `type`
+ *
+ * The range is walked from its start: the gaps between the segments it held
+ * are unlocked and the segments are converted back to their type, so that
+ * the lock on the rest of the range is only trimmed. The requests are applied
+ * in a single mutex section, except on a file created with `RL_ATTR_BLOCKS`,
+ * whose locks don't use the mutex, and when `owner` held nothing on the
+ * range, in which case the range is unlocked by one request. As `owner` holds
+ * the whole range, none of these requests waits, but they fail with ENOLCK
+ * if the lock table has no room for the segments: the rest of the range then
+ * stays locked with the type `type`.
+ *
+ * @param file the locked file
+ * @param owner the owner of the locks
+ * @param type the type of the lock on the range
+ * @param first the start of the range
+ * @param last the end of the range, excluded
+ * @param held the segments of the range `owner` held, sorted by start
+ * @param nb_held the number of segments in `held`
+ * @return 0 on success, -1 on error
+ */
+static int restore_held_segments(rl_open_file *file, rl_owner owner,
+        short type, off_t first, off_t last, rl_held_segment *held,
+        int nb_held) {
+    if (nb_held == 0)
+        return set_segment(file, owner, F_UNLCK, first, last, 0);
+
+    int locked = !(file->flags & RL_ATTR_BLOCKS);
+    if (locked && lock_open_file(file) != 0)
         return -1;
+    int res = 0;
+    off_t pos = first;
+    for (int i = 0; i <= nb_held && res == 0; i++) {
+        off_t end = i < nb_held ? held[i].start : last;
+        if (end > pos)
+            res = set_segment(file, owner, F_UNLCK, pos, end, locked);
+        if (res == 0 && i < nb_held && held[i].type != type)
+            res = set_segment(file, owner, held[i].type, held[i].start,
+                    held[i].end, locked);
+        if (i < nb_held && held[i].end > pos)
+            pos = held[i].end;
+    }
+    if (!locked)
+        return res;
 
-    if (lck->l_whence == SEEK_SET) {
-        if (lck->l_start >= 0)
-            return lck->l_start;
-        else
-            return -1; // before beginning of file !
-    } else if (lck->l_whence == SEEK_CUR || lck->l_whence == SEEK_END) {
-        off_t cur = lseek(fd, 0, SEEK_CUR); // current offset
-        if (cur == -1)
-            return -1;
-        off_t pos = lseek(fd, lck->l_start, lck->l_whence); // lock offset
-        if (pos == -1)
-            return -1;
-        if (lseek(fd, cur, SEEK_SET) == -1)
-            return -1;
-        return pos;
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    notify_release(file);
+    grant_pending(file);
+
+    /* the unlocked gaps go through the policy as with set_lock() */
+    int fd = rla.nb_policies > 0 ? get_owner_fd(file, owner) : -1;
+    pos = first;
+    for (int i = 0; fd != -1 && i <= nb_held; i++) {
+        off_t end = i < nb_held ? held[i].start : last;
+        struct flock gap = {.l_type = F_UNLCK, .l_whence = SEEK_SET,
+                            .l_start = pos, .l_len = end - pos};
+        if (end > pos)
+            apply_policy(fd, &gap);
+        if (i < nb_held && held[i].end > pos)
+            pos = held[i].end;
     }
-    return -1;
+    errno = err;
+    return res;
 }
 
 /**
- * @brief Checks if the given lock can be put on the given descriptor
- * 
- * This function only checks for conflicting locks, it doesn't verify if the
- * lock table is big enough for the new locks. This is done in other functions.
- * This function does not use any locking mechanism, so be sure to take the lock
- * before entering this function in order to verify mutual exclusion.
+ * @brief Does positional I/O on `iov` under a lock on the range it covers
  *
- * @param lck the lock to put
- * @param lfd the file on which to put the lock
- * @return 1 if the lock is applicable, 0 if it is not, -1 if an error occured.
- * If the lock is not applicable because of a lock put by a process that has
- * died and has not removed its locks, returns the pid of that process.
+ * The lock is taken as with F_SETLKW, then released once the I/O is done. The
+ * uncontended case costs no mutex section, as both operations go through the
+ * fast slots, and the I/O is a single system call.
+ *
+ * The locks the owner already held on the range are kept: if they cover it
+ * with a strong enough type, no lock is taken. Otherwise, the range is locked
+ * with the strongest of `type` and their types, and they are given back after
+ * the I/O instead of being unlocked, see `restore_held_segments()`. The result
+ * of the I/O is returned even if they can't be given back.
+ *
+ * @param lfd the descriptor on which to do the I/O
+ * @param iov the buffers to read into or write from
+ * @param iovcnt the number of buffers
+ * @param offset the offset in the file at which the I/O starts
+ * @param type F_RDLCK to read, F_WRLCK to write
+ * @return the number of bytes read or written, -1 on error, with errno set to
+ *         EINVAL for a named lock space
  */
-static pid_t is_lock_applicable(struct flock *lck, rl_descriptor lfd) {
-    if (lck == NULL || lfd.file == NULL)
+static ssize_t locked_io(rl_descriptor lfd, const struct iovec *iov,
+        int iovcnt, off_t offset, short type) {
+    if (lfd.fd < 0 || lfd.file == NULL || iov == NULL || iovcnt < 0
+            || offset < 0 || !has_backing_file(lfd.file)) {
+        errno = EINVAL;
         return -1;
+    }
 
-    off_t start = get_start(lck, lfd.fd);
-    if (start == -1)
+    size_t count = 0;
+    for (int i = 0; i < iovcnt; i++)
+        count += iov[i].iov_len;
+    if (count == 0) /* a length of 0 would lock up to the end of the file */
+        return 0;
+
+    rl_owner lfd_owner = get_owner(lfd);
+    off_t last = offset + count;
+    rl_held_segment held[RL_MAX_HELD];
+    int nb_held = get_held_segments(lfd.file, lfd_owner, offset, last, held);
+    if (nb_held == -1)
         return -1;
 
-    if (lck->l_type == F_UNLCK)
-        return 1;
+    int strength = get_strength(type);
+    int covered = 1;
+    off_t pos = offset;
+    for (int i = 0; i < nb_held; i++) {
+        if (held[i].start > pos || get_strength(held[i].type) < strength)
+            covered = 0;
+        if (get_strength(held[i].type) > strength)
+            strength = get_strength(held[i].type);
+        pos = held[i].end;
+    }
+    covered = covered && pos >= last;
 
-    rl_open_file *file = lfd.file;
-    if (file->nb_locks < 0 || file->nb_locks > RL_MAX_LOCKS)
+    struct flock lck = {.l_type = strength == 0 ? F_RDLCK
+                            : strength == 1 ? RL_UPDLCK : F_WRLCK,
+                        .l_whence = SEEK_SET, .l_start = offset,
+                        .l_len = count};
+    if (!covered && set_lock_wait(lfd.file, lfd_owner, &lck, -1) == -1)
         return -1;
 
-    rl_owner lfd_owner = {.pid = getpid(), .fd = lfd.fd};
+    ssize_t res = type == F_RDLCK ? preadv(lfd.fd, iov, iovcnt, offset)
+        : pwritev(lfd.fd, iov, iovcnt, offset);
+    int err = errno;
 
-    for (int i = 0; i < file->nb_locks; i++) {
-        rl_lock *cur = &file->lock_table[i];
+    /* the I/O is done: its result stands even if the locks are not restored */
+    if (!covered && restore_held_segments(lfd.file, lfd_owner, lck.l_type,
+                offset, last, held, nb_held) == -1 && res == -1)
+        return -1;
+    errno = err;
+    return res;
+}
 
-        /* if locks overlap check for conflicts */
-        if (seg_overlap(cur->start, cur->len, start, lck->l_len)) {
-            if (cur->type == F_WRLCK || lck->l_type == F_WRLCK) {
-                if (has_different_owner(cur, lfd_owner)) {
-                    /* check if owner is still alive */
-                    for (int j = 0; j < cur->nb_owners; j++) {
-                        if (!equals(lfd_owner, cur->lock_owners[j])) {
-                            if (kill(cur->lock_owners[j].pid, 0) == -1
-                                    && errno == ESRCH) {
-                                return cur->lock_owners[j].pid;
-                            } else {
-                                return 0;
-                            }
-                        }
-                    }
+/**
+ * @brief Reads `count` bytes at `offset` under a read lock on them
+ *
+ * The range is read-locked, waiting for the conflicting locks to be released,
+ * read with `pread()` and unlocked. The locks `lfd` held on the range before
+ * the call are kept as they were: no lock is taken if they already cover it.
+ *
+ * @param lfd the descriptor to read from
+ * @param buf the buffer to read into
+ * @param count the number of bytes to read
+ * @param offset the offset in the file at which to read
+ * @return the number of bytes read, -1 on error
+ */
+ssize_t rl_pread_locked(rl_descriptor lfd, void *buf, size_t count,
+        off_t offset) {
+    struct iovec iov = {.iov_base = buf, .iov_len = count};
+    return locked_io(lfd, &iov, 1, offset, F_RDLCK);
+}
 
-                    /* there is a different owner that has not been found */
-                    return -1;
-                }
-            }
-        }
-    }
-    return 1;
+/**
+ * @brief Writes `count` bytes at `offset` under a write lock on them
+ *
+ * See `rl_pread_locked()`.
+ *
+ * @param lfd the descriptor to write to
+ * @param buf the bytes to write
+ * @param count the number of bytes to write
+ * @param offset the offset in the file at which to write
+ * @return the number of bytes written, -1 on error
+ */
+ssize_t rl_pwrite_locked(rl_descriptor lfd, const void *buf, size_t count,
+        off_t offset) {
+    struct iovec iov = {.iov_base = (void *) buf, .iov_len = count};
+    return locked_io(lfd, &iov, 1, offset, F_WRLCK);
 }
 
 /**
- * @brief Checks if `ol` and `or` have the same PID
- * @param ol the left owner
- * @param or the right owner
- * @return 1 if `ol` and `or` have the same PID, 0 otherwise
+ * @brief Reads into the buffers of `iov` at `offset` under a read lock on the
+ * range they cover
+ *
+ * See `rl_pread_locked()`.
+ *
+ * @param lfd the descriptor to read from
+ * @param iov the buffers to read into
+ * @param iovcnt the number of buffers
+ * @param offset the offset in the file at which to read
+ * @return the number of bytes read, -1 on error
  */
-static int same_pid(rl_owner ol, rl_owner or) {
-    return ol.pid == or.pid;
+ssize_t rl_preadv_locked(rl_descriptor lfd, const struct iovec *iov,
+        int iovcnt, off_t offset) {
+    return locked_io(lfd, iov, iovcnt, offset, F_RDLCK);
 }
 
 /**
- * @brief Removes the locks owned by the process of given PID in the given
- * rl_open_file
+ * @brief Writes the buffers of `iov` at `offset` under a write lock on the
+ * range they cover
  *
- * This function does not use any locking mechanism, be sure that mutual
- * exclusion is assured before using it. If after removal a lock is empty, it is
- * also deleted. The owners of every modified lock are reorganized, so as the
- * locks of the file.
+ * See `rl_pread_locked()`.
  *
- * @param pid the PID of the process that owns the locks to remove
- * @param file the file that contains the locks to remove
+ * @param lfd the descriptor to write to
+ * @param iov the buffers to write
+ * @param iovcnt the number of buffers
+ * @param offset the offset in the file at which to write
+ * @return the number of bytes written, -1 on error
+ */
+ssize_t rl_pwritev_locked(rl_descriptor lfd, const struct iovec *iov,
+        int iovcnt, off_t offset) {
+    return locked_io(lfd, iov, iovcnt, offset, F_WRLCK);
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Sets the I/O policy applied by `rl_fcntl()` and the locked I/O
+ * helpers on `lfd`
+ *
+ * With `RL_POLICY_SYNC_RANGE`, the segments released by write-unlocks are
+ * written back with `sync_file_range()`, and with `RL_POLICY_FDATASYNC` the
+ * file is synced with `fdatasync()`, once every `batch` write-unlocks. With
+ * `RL_POLICY_WILLNEED`, a readahead of the segment of each read lock is
+ * requested with `posix_fadvise()`. The policy belongs to the descriptor: it
+ * is neither copied by `rl_dup()` nor applied by other processes. Setting new
+ * flags first syncs what the previous policy had batched, and flags 0 remove
+ * the policy.
+ *
+ * @param lfd the descriptor
+ * @param flags a bitwise OR of `RL_POLICY_*` flags
+ * @param batch the number of write-unlocks per sync, at least 1
  * @return 0 on success, -1 on error
  */
-static int remove_locks_of(pid_t pid, rl_open_file *file) {
-    if (pid <= 0 || file == NULL || file->nb_locks < 0
-            || file->nb_locks > RL_MAX_LOCKS)
+int rl_set_policy(rl_descriptor lfd, int flags, int batch) {
+    if (lfd.fd < 0 || lfd.file == NULL || batch < 1
+            || (flags & ~(RL_POLICY_SYNC_RANGE | RL_POLICY_FDATASYNC
+                    | RL_POLICY_WILLNEED))) {
+        errno = EINVAL;
         return -1;
+    }
 
-    rl_owner cmp = {.pid = pid, .fd = 0};
-    if (delete_owner_on_criteria(file, same_pid, cmp) < 0)
-        return -1;
+    rl_fd_policy *policy = find_policy(lfd.fd);
+    if (policy != NULL) {
+        sync_policy(policy);
+        if (flags == 0) {
+            *policy = rla.policies[rla.nb_policies - 1];
+            rla.policies[rla.nb_policies - 1].fd = -1;
+            rla.nb_policies--;
+            return 0;
+        }
+    } else if (flags != 0) {
+        if (rla.nb_policies >= RL_MAX_FILES) {
+            errno = ENOMEM;
+            return -1;
+        }
+        policy = &rla.policies[rla.nb_policies++];
+        policy->fd = lfd.fd;
+        policy->error = 0;
+        policy->written_len = -1;
+        policy->dirty_len = -1;
+    } else
+        return 0;
+
+    policy->flags = flags;
+    policy->batch = batch;
+    policy->nb_unlocks = 0;
     return 0;
 }
 
 /**
- * @brief Adds `new` to the owners table of `lck` if possible
- * @param new the owner to add
- * @param lck the lock to which to add the new owner
- * @return 0 if `new` was succesfully added, -1 if it could not be added
+ * @brief Syncs at once what the I/O policy of `lfd` has batched
+ * @param lfd the descriptor
+ * @return 0 on success, -1 if this sync or a previous batched sync failed,
+ *         with errno set to the error of the last failure
  */
-static int add_owner(rl_owner new, rl_lock *lck) {
-    if (new.pid < 0 || new.fd < 0 || lck == NULL || lck->nb_owners < 0
-            || lck->nb_owners + 1 > RL_MAX_OWNERS)
+int rl_flush(rl_descriptor lfd) {
+    rl_fd_policy *policy = find_policy(lfd.fd);
+    if (policy == NULL)
+        return 0;
+
+    sync_policy(policy);
+    if (policy->error != 0) {
+        errno = policy->error;
+        policy->error = 0;
         return -1;
-    lck->lock_owners[lck->nb_owners] = new;
-    lck->nb_owners++;
+    }
     return 0;
 }
 
+/******************************************************************************/
+
 /**
- * @brief Checks if `owner` is an owner of `lck`
- * @param owner the owner that might own `lck`
- * @param lck the lock that might be owned by `owner`
- * @return 1 if `owner` is an owner of `lck`, 0 if it is not
+ * @brief The state of a free append slot
  */
-static int is_owner_of(rl_owner owner, rl_lock *lck) {
-    for (int i = 0; i < lck->nb_owners; i++) {
-        if (equals(owner, lck->lock_owners[i]))
-            return 1;
-    }
-    return 0;
-}
+#define RL_APPEND_FREE 0
 
 /**
- * @brief Adds `new` to the locks of `file` if possible, where `first` is the
- * initial owner of `new`
- *
- * This function should be use when `new` is not already a lock of `file`. The
- * owners that might be stored in `new` are erased.
- *
- * @param new the lock to add
- * @param file the file in which to add `new`
- * @param first the initial owner of `new`
+ * @brief The state of an append slot being filled by its reserver
  */
-static int add_lock(rl_lock *new, rl_open_file *file, rl_owner first) {
-    if (new == NULL || file == NULL || file->nb_locks + 1 > RL_MAX_LOCKS)
-        return -1;
-    file->lock_table[file->nb_locks] = *new;
-    rl_lock *tmp = &file->lock_table[file->nb_locks];
-    for (int i = 0; i < RL_MAX_OWNERS; i++)
-        erase_owner(&tmp->lock_owners[i]);
-    file->nb_locks++;
-    tmp->nb_owners = 0;
-    if (add_owner(first, tmp) == -1)
-        return -1;
-    return 0;
-}
+#define RL_APPEND_CLAIMED 1
 
 /**
- * @brief Gets the lock in `file` that starts at the same offset, has the same
- * length and is of the same type than `lck`
- * @param file the file that might contain `lck`
- * @param lck the lock to find in `file`
- * @return A pointer to the corresponding lock in file or NULL if it was not
- * found
+ * @brief The state of a reserved range being written
  */
-static rl_lock *find_lock(rl_open_file *file, rl_lock *lck) {
-    if (file == NULL || lck == NULL)
-        return NULL;
-    for (int i = 0; i < file->nb_locks; i++) {
-        rl_lock *tmp = &file->lock_table[i];
-        if (tmp->start == lck->start && tmp->len == lck->len
-                && tmp->type == lck->type)
-            return tmp;
+#define RL_APPEND_RESERVED 2
+
+/**
+ * @brief The state of a reserved range whose record is written
+ */
+#define RL_APPEND_COMMITTED 3
+
+/**
+ * @brief Initializes the append tail of `file` with the size of the file at
+ * the first reservation
+ * @param file the open file
+ * @param fd a descriptor of the file
+ * @return 0 on success, -1 on error, with errno set to EINVAL for a named lock
+ *         space
+ */
+static int init_append_tail(rl_open_file *file, int fd) {
+    if (!has_backing_file(file)) {
+        errno = EINVAL;
+        return -1;
     }
-    return NULL;
+    if (atomic_load(&file->append_init))
+        return 0;
+    if (lock_open_file(file) != 0)
+        return -1;
+
+    int res = 0;
+    if (!atomic_load(&file->append_init)) {
+        struct stat st;
+        res = fstat(fd, &st);
+        if (res == 0) {
+            atomic_store(&file->append_tail, st.st_size);
+            atomic_store(&file->append_committed, st.st_size);
+            atomic_store(&file->append_init, 1);
+        }
+    }
+    int err = errno;
+    if (unlock_open_file(file) != 0)
+        return -1;
+    errno = err;
+    return res;
 }
 
 /**
- * @brief Checks if (s2, l2) is strictly in the middle of (s1, l1)
- * @param s1 the start of the first segment
- * @param l1 the length of the first segment, 0 if extensible
- * @param s2 the start of the second segment
- * @param l2 the length of the second segment, 0 if extensible
- * @return 1 if (s2, l2) is strictly in the middle of (s1, l1), 0 otherwise
+ * @brief Extends the committed prefix of `file` over the committed ranges
+ * which follow it, and wakes up the processes waiting for it
+ *
+ * The ranges of dead processes are considered committed, so that readers
+ * don't wait for them forever.
+ *
+ * @param file the open file
  */
-static int strictly_in_middle(off_t s1, off_t l1, off_t s2, off_t l2) {
-    return l2 > 0 && s1 < s2 && (l1 == 0 || s1 + l1 > s2 + l2);
+static void advance_committed(rl_open_file *file) {
+    int me = acquire_mcs(&file->append_lock, get_mcs_nodes(file), RL_MCS_NODES);
+    if (me == -1)
+        return;
+    int advanced = 0;
+    for (int a = 0; a < RL_MAX_APPENDS; a++) {
+        rl_append_slot *slot = &get_appends(file)[a];
+        int state = atomic_load(&slot->state);
+        if ((state != RL_APPEND_COMMITTED && state != RL_APPEND_RESERVED)
+                || slot->start != atomic_load(&file->append_committed))
+            continue;
+        if (state == RL_APPEND_RESERVED && !is_process_dead(file, slot->pid))
+            continue;
+
+        atomic_store(&file->append_committed, slot->start + slot->len);
+        atomic_store(&slot->state, RL_APPEND_FREE);
+        advanced = 1;
+        a = -1; /* the next range may be in any slot */
+    }
+    release_mcs(&file->append_lock, get_mcs_nodes(file), RL_MCS_NODES, me);
+
+    if (advanced) {
+        atomic_fetch_add(&file->commit_seq, 1);
+        futex_wake(&file->commit_seq, INT_MAX);
+    }
 }
 
 /**
- * @brief Checks if (s2, l2) covers entirely (s1, l1)
- * @param s1 the start of the first segment
- * @param l1 the length of the first segment, 0 if extensible
- * @param s2 the start of the second segment
- * @param l2 the length of the second segment, 0 if extensible
- * @return 1 if (s2, l2) covers entirely (s1, l1), 0 otherwise
+ * @brief Claims a free append slot of `file`
+ * @param file the open file
+ * @return the index of the slot, -1 if there is none, -2 if all the slots
+ *         are reserved by the calling process
  */
-static int covers_entirely(off_t s1, off_t l1, off_t s2, off_t l2) {
-    return (l1 > 0 && l2 > 0 && s1 >= s2 && s1 + l1 <= s2 + l2)
-        || (l2 == 0 && s2 <= s1);
+static int claim_append_slot(rl_open_file *file) {
+    pid_t pid = getpid();
+    int nb_mine = 0;
+    for (int a = 0; a < RL_MAX_APPENDS; a++) {
+        rl_append_slot *slot = &get_appends(file)[a];
+        int expected = RL_APPEND_FREE;
+        if (atomic_compare_exchange_strong(&slot->state, &expected,
+                    RL_APPEND_CLAIMED))
+            return a;
+        if (expected == RL_APPEND_RESERVED && slot->pid == pid)
+            nb_mine++;
+    }
+    return nb_mine == RL_MAX_APPENDS ? -2 : -1;
 }
 
 /**
- * @brief Checks if (s2, l2) covers the end of (s1, l1)
- *
- * (s2, l2) must start strictly after (s1, l1) and may end at the same byte or
- * after.
- *
- * @param s1 the start of the first segment
- * @param l1 the length of the first segment, 0 if extensible
- * @param s2 the start of the second segment
- * @param l2 the length of the second segment, 0 if extensible
- * @return 1 if (s2, l2) covers the end of (s1, l1), 0 otherwise
+ * @brief Waits until the committed prefix of `file` grows, for at most
+ * RL_PARK_MAX_NS
+ * @param file the open file
+ * @param limit the CLOCK_MONOTONIC time in nanoseconds at which to give up, -1
+ *              to wait without limit
+ * @return 0 on success, -1 on failure with errno set to ETIMEDOUT if `limit`
+ *         passed or EINTR if a signal interrupted the wait
  */
-static int covers_end(off_t s1, off_t l1, off_t s2, off_t l2) {
-    return (l1 > 0 && l2 > 0 && s1 < s2 && s1 + l1 <= s2 + l2)
-        || (l2 == 0 && s1 < s2);
+static int wait_for_commit(rl_open_file *file, long long limit) {
+    int seq = atomic_load(&file->commit_seq);
+
+    /* the reserver of the next range may have died */
+    advance_committed(file);
+    if (atomic_load(&file->commit_seq) != seq)
+        return 0;
+
+    long long left = RL_PARK_MAX_NS;
+    if (limit >= 0 && limit - get_time_ns() < left)
+        left = limit - get_time_ns();
+    if (left <= 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    struct timespec timeout = {.tv_sec = 0, .tv_nsec = left};
+    if (futex_wait(&file->commit_seq, seq, &timeout) == -1 && errno == EINTR)
+        return -1;
+    return 0;
 }
 
 /**
- * @brief Unlocks the region delimited by `lck` of the open file pointed by
- * `lfd`
+ * @brief Reserves `len` bytes at the end of the file and write-locks them
  *
- * `lck` must be of type `F_UNLCK` and must start at or after the beginning of
- * the file. This function does not use any locking mechanism, ensure mutual
- * exclusion before the call.
+ * Reservations are handed out by an atomic counter, so that appenders write
+ * their records in parallel in disjoint ranges. The counter starts at the
+ * size of the file at the first reservation: bytes appended to the file
+ * without a reservation are ignored. The range is write-locked as with
+ * F_SETLKW. Once the record is written, the range must be passed to
+ * `rl_append_commit()`. While RL_MAX_APPENDS ranges are reserved beyond the
+ * committed prefix, the call waits for the prefix to grow. If the range can't
+ * be locked, it is committed as is, leaving a hole in the file.
  *
- * @param lfd the file descriptor to unlock
- * @param lck the region to unlock
- * @return 0 on success, -1 on error
+ * @param lfd the descriptor of the file, open for writing
+ * @param len the length of the range, greater than 0
+ * @param append the handle of the reservation to fill
+ * @return 0 on success, -1 on failure with errno set to EDEADLK if all the
+ *         ranges are reserved by the calling process, or EINVAL if the file
+ *         was not created with `RL_ATTR_APPENDS`
  */
-static int apply_unlock(rl_descriptor lfd, struct flock *lck) {
-    if (lfd.file == NULL || lck == NULL)
+int rl_append_reserve(rl_descriptor lfd, off_t len, rl_append *append) {
+    if (lfd.fd < 0 || lfd.file == NULL || len <= 0 || append == NULL
+            || !(lfd.file->flags & RL_ATTR_APPENDS)) {
+        errno = EINVAL;
         return -1;
-
-    off_t lck_start = get_start(lck, lfd.fd);
-    if (lck_start == -1)
+    }
+    rl_open_file *file = lfd.file;
+    if (init_append_tail(file, lfd.fd) == -1)
         return -1;
 
-    int nb_locks = lfd.file->nb_locks;
-    size_t nb_new_locks = 0;
-    rl_lock new_locks[2 * nb_locks];
-    size_t nb_locks_to_remove = 0;
-    size_t locks_to_remove[nb_locks];
-    rl_owner lfd_owner = {.pid = getpid(), .fd = lfd.fd};
-    for (int i = 0; i < nb_locks; i++) {
-        rl_lock *cur = &lfd.file->lock_table[i];
-        if (is_owner_of(lfd_owner, cur)
-                && seg_overlap(lck_start, lck->l_len, cur->start, cur->len)) {
-            locks_to_remove[nb_locks_to_remove] = i;
-            nb_locks_to_remove++;
-            if (strictly_in_middle(cur->start, cur->len, lck_start,
-                            lck->l_len)) {
-                rl_lock l1, l2;
-                l1.type = cur->type;
-                l1.start = cur->start;
-                l1.len = lck_start - cur->start;
-                new_locks[nb_new_locks] = l1;
-                nb_new_locks++;
-
-                l2.type = cur->type;
-                l2.start = lck_start + lck->l_len;
-                l2.len = (cur->len == 0) ?
-                    0 : (cur->start + cur->len) - (lck_start + lck->l_len);
-                new_locks[nb_new_locks] = l2;
-                nb_new_locks++;
-            } else if (covers_entirely(cur->start, cur->len, lck_start,
-                            lck->l_len))
-                continue;
-            else if (covers_end(cur->start, cur->len, lck_start, lck->l_len)) {
-                rl_lock l1;
-                l1.type = cur->type;
-                l1.start = cur->start;
-                l1.len = lck_start - cur->start;
-                new_locks[nb_new_locks] = l1;
-                nb_new_locks++;
-            } else { /* unlock beginning of cur */
-                rl_lock l1;
-                l1.type = cur->type;
-                l1.start = lck_start + lck->l_len;
-                l1.len = (cur->len == 0) ?
-                    0 : (cur->start + cur->len) - (lck_start + lck->l_len);
-                new_locks[nb_new_locks] = l1;
-                nb_new_locks++;
-            }
-        }
-        if (nb_new_locks + nb_locks > RL_MAX_LOCKS)
+    int slot;
+    while ((slot = claim_append_slot(file)) < 0) {
+        if (slot == -2) {
+            errno = EDEADLK;
             return -1;
-    }
-    for (int i = 0; i < nb_locks_to_remove; i++) {
-        size_t ind = locks_to_remove[i];
-        rl_lock *rlck = &lfd.file->lock_table[ind];
-        if (rlck->nb_owners == 1) {
-            erase_lock(rlck);
-            lfd.file->nb_locks--;
-        } else {
-            size_t nb_owners = rlck->nb_owners;
-            for (int j = 0; j < rlck->nb_owners; j++) {
-                if (equals(lfd_owner, rlck->lock_owners[j])) {
-                    erase_owner(&rlck->lock_owners[j]);
-                    nb_owners--;
-                }
-            }
-            rlck->nb_owners = nb_owners;
-            if (organize_owners(rlck) == -1)
-                return -1;
         }
+        if (wait_for_commit(file, -1) == -1)
+            return -1;
     }
-    if (organize_locks(lfd.file) == -1)
+
+    rl_append_slot *reserved = &get_appends(file)[slot];
+    reserved->pid = getpid();
+    reserved->len = len;
+    reserved->start = atomic_fetch_add(&file->append_tail, len);
+    atomic_store(&reserved->state, RL_APPEND_RESERVED);
+    append->offset = reserved->start;
+    append->len = len;
+    append->slot = slot;
+
+    struct flock lck = {.l_type = F_WRLCK, .l_whence = SEEK_SET,
+                        .l_start = append->offset, .l_len = len};
+    rl_owner lfd_owner = get_owner(lfd);
+    if (set_lock_wait(file, lfd_owner, &lck, -1) == -1) {
+        int err = errno;
+        atomic_store(&reserved->state, RL_APPEND_COMMITTED);
+        advance_committed(file);
+        errno = err;
         return -1;
-    for (int i = 0; i < nb_new_locks; i++) {
-        rl_lock *tmp = find_lock(lfd.file, &new_locks[i]);
-        if (tmp != NULL) {
-            if (add_owner(lfd_owner, tmp) == -1)
-                return -1;
-        } else {
-            if (add_lock(&new_locks[i], lfd.file, lfd_owner) == -1)
-                return -1;
-        }
     }
     return 0;
 }
 
 /**
- * @brief Locks the region specified by `lck` of the open file pointed by
- * `lfd`
+ * @brief Commits a range reserved by `rl_append_reserve()`
  *
- * The region to lock must start at or after the beginning of the file. This
- * function does not use any locking mechanism, ensure mutual exclusion before
- * the call.
+ * The range is unlocked and becomes part of the committed prefix of the file
+ * once all the ranges reserved before it are committed too.
  *
- * @param lfd the file descriptor to lock
- * @param lck the region to lock
+ * @param lfd the descriptor with which the range was reserved
+ * @param append the handle of the reservation
  * @return 0 on success, -1 on error
  */
-static int apply_rw_lock(rl_descriptor lfd, struct flock *lck) {
-    if (lfd.file->nb_locks + 2 > RL_MAX_LOCKS)
-        return -1;
-
-    off_t lck_start = get_start(lck, lfd.fd);
-    if (lck_start == -1)
+int rl_append_commit(rl_descriptor lfd, rl_append *append) {
+    if (lfd.fd < 0 || lfd.file == NULL || append == NULL
+            || !(lfd.file->flags & RL_ATTR_APPENDS)
+            || append->slot < 0 || append->slot >= RL_MAX_APPENDS) {
+        errno = EINVAL;
         return -1;
-
-    struct flock unlock;
-    unlock.l_type = F_UNLCK;
-    unlock.l_whence = SEEK_SET;
-    unlock.l_start = lck_start;
-    unlock.l_len = lck->l_len;
-    if (apply_unlock(lfd, &unlock) == -1)
-        return -1;
-
-    rl_owner lfd_owner = {.pid = getpid(), .fd = lfd.fd};
-    rl_lock *left = NULL;
-    rl_lock *right = NULL;
-    for (int i = 0; i < lfd.file->nb_locks; i++) {
-        rl_lock *cur = &lfd.file->lock_table[i];
-        if (cur->type != lck->l_type || !is_owner_of(lfd_owner, cur))
-            continue;
-        if (cur->start + cur->len == lck_start && cur->len > 0)
-            left = cur;
-        else if (cur->start == lck_start + lck->l_len && lck->l_len > 0)
-            right = cur;
-    }
-
-    int unlock_left = 0;
-    int unlock_right = 0;
-    rl_lock tmp;
-    tmp.type = lck->l_type;
-    tmp.start = lck_start;
-    tmp.len = lck->l_len;
-    if (left != NULL && right != NULL) {
-        if (right->len == 0) tmp.len = 0;
-        else tmp.len += left->len + right->len;
-        tmp.start = left->start;
-        unlock_left = 1;
-        unlock_right = 1;
-    } else if (left != NULL) {
-        if (tmp.len != 0)
-            tmp.len += left->len;
-        tmp.start = left->start;
-        unlock_left = 1;
-    } else if (right != NULL) {
-        if (right->len == 0) tmp.len = 0;
-        else tmp.len += right->len;
-        unlock_right = 1;
     }
 
-    struct flock left2;
-    if (unlock_left) {
-        rl_lock_to_flock(left, &left2);
-        left2.l_type = F_UNLCK;
-    }
-    struct flock right2;
-    if (unlock_right) {
-        rl_lock_to_flock(right, &right2);
-        right2.l_type = F_UNLCK;
-    }
+    struct flock lck = {.l_type = F_UNLCK, .l_whence = SEEK_SET,
+                        .l_start = append->offset, .l_len = append->len};
+    rl_owner lfd_owner = get_owner(lfd);
+    int res = set_lock(lfd.file, lfd_owner, &lck);
+    int err = errno;
+
+    atomic_store(&get_appends(lfd.file)[append->slot].state,
+            RL_APPEND_COMMITTED);
+    advance_committed(lfd.file);
+    append->slot = -1;
+    errno = err;
+    return res;
+}
 
-    if (unlock_left && apply_unlock(lfd, &left2) == -1)
+/**
+ * @brief Waits until all the ranges reserved before `end` are committed
+ * @param lfd the descriptor of the file
+ * @param end the end of the prefix to wait for
+ * @param deadline the absolute CLOCK_MONOTONIC time at which to give up, NULL
+ *                 to wait without limit
+ * @return 0 on success, -1 on failure with errno set to ETIMEDOUT if
+ *         `deadline` passed, EINTR if a signal interrupted the wait, or EINVAL
+ *         if `end` or `deadline` is negative, `deadline` has a number of
+ *         nanoseconds out of [0; 1e9[ or the file was not created with
+ *         `RL_ATTR_APPENDS`
+ */
+int rl_append_wait(rl_descriptor lfd, off_t end,
+        const struct timespec *deadline) {
+    if (lfd.fd < 0 || lfd.file == NULL || end < 0
+            || !(lfd.file->flags & RL_ATTR_APPENDS)
+            || (deadline != NULL && (deadline->tv_sec < 0
+                    || deadline->tv_nsec < 0
+                    || deadline->tv_nsec >= 1000000000L))) {
+        errno = EINVAL;
         return -1;
-
-    if (unlock_right && apply_unlock(lfd, &right2) == -1)
+    }
+    rl_open_file *file = lfd.file;
+    if (init_append_tail(file, lfd.fd) == -1)
         return -1;
 
-    rl_lock *tmp2 = find_lock(lfd.file, &tmp);
-    if (tmp2 != NULL) {
-        if (add_owner(lfd_owner, tmp2) == -1)
-            return -1;
-    } else {
-        if (add_lock(&tmp, lfd.file, lfd_owner) == -1)
+    long long limit = -1;
+    if (deadline != NULL && deadline->tv_sec < LLONG_MAX / 1000000000LL)
+        limit = deadline->tv_sec * 1000000000LL + deadline->tv_nsec;
+    while (atomic_load(&file->append_committed) < end) {
+        if (wait_for_commit(file, limit) == -1)
             return -1;
     }
     return 0;
 }
 
+/******************************************************************************/
+
 /**
- * @brief Applies the lock or unlock described by `lck` if possible
+ * @brief Makes `lfd` a member of the lock group `name` of its file, creating
+ * the group if it does not exist
  *
- * When `cmd` is F_SETLK, a non-blocking attempt to apply `lck` is made. If
- * attempting to apply a read lock, the file must be open for reading. If
- * attempting to apply a write lock, the file must be open for writing.
- * 
- * @param lfd the descriptor on which `lck` will be applied
- * @param cmd the action to perform, only F_SETLK is supported
- * @param lck the lock to apply
- * @return 0 on success, -1 on failure
+ * Until it leaves the group, `lfd` locks on behalf of the group: the locks
+ * and modes of the group never conflict with the requests of its members, and
+ * any member can release them. The group keeps its locks while it has
+ * members, even after they have died; they are released when the last member
+ * leaves it, or when they get in the way of another owner once all the
+ * members have died. The locks `lfd` took before joining stay its own.
+ * Children created by `rl_fork()` are members of the groups of their parent,
+ * descriptors created by `rl_dup()` are not.
+ *
+ * @param lfd the descriptor that joins the group
+ * @param name the name of the group
+ * @return 0 on success, -1 on failure with errno set to EBUSY if `lfd` is
+ *         already in a group, ENAMETOOLONG if `name` has more than
+ *         `RL_GROUP_NAME_MAX - 1` characters, ENOLCK if there is no room for
+ *         the group or the member, or EINVAL if `name` is empty or the file
+ *         was not created with `RL_ATTR_GROUPS`, or with `RL_ATTR_BLOCKS`
  */
-int rl_fcntl(rl_descriptor lfd, int cmd, struct flock *lck) {
-    if (lfd.fd < 0 || lfd.file == NULL || cmd != F_SETLK || lck == NULL
-            || lck->l_len < 0
-            || (lck->l_type != F_RDLCK && lck->l_type != F_WRLCK
-                    && lck->l_type != F_UNLCK)
-            || (lck->l_whence != SEEK_SET && lck->l_whence != SEEK_CUR
-                    && lck->l_whence != SEEK_END))
+int rl_join_group(rl_descriptor lfd, const char *name) {
+    if (lfd.fd < 0 || lfd.file == NULL || name == NULL || name[0] == '\0'
+            || !(lfd.file->flags & RL_ATTR_GROUPS)
+            || lfd.file->flags & RL_ATTR_BLOCKS) {
+        errno = EINVAL;
         return -1;
-
-    int flags = fcntl(lfd.fd, F_GETFL);
-    if (flags == -1)
+    }
+    if (strlen(name) >= RL_GROUP_NAME_MAX) {
+        errno = ENAMETOOLONG;
         return -1;
-    if (lck->l_type == F_RDLCK && !(flags & O_RDONLY) && !(flags & O_RDWR))
+    }
+    if (find_membership(lfd.fd) != NULL) {
+        errno = EBUSY;
         return -1;
-    if (lck->l_type == F_WRLCK && !(flags & O_WRONLY) && !(flags & O_RDWR))
+    }
+    rl_fd_group *membership = NULL;
+    for (int i = 0; membership == NULL && i < RL_MAX_FILES; i++) {
+        if (rla.groups[i].fd == -1)
+            membership = &rla.groups[i];
+    }
+    if (membership == NULL) {
+        errno = ENOLCK;
         return -1;
+    }
 
-    if (pthread_mutex_lock(&lfd.file->mutex) != 0)
+    rl_open_file *file = lfd.file;
+    if (lock_open_file(file) != 0)
         return -1;
 
-    pid_t pid;
-    while ((pid = is_lock_applicable(lck, lfd)) > 1) {
-        if (remove_locks_of(pid, lfd.file) == -1)
-            goto error;
+    int g = -1;
+    for (int i = 0; g == -1 && i < RL_MAX_GROUPS; i++) {
+        if (strcmp(get_groups(file)[i].name, name) == 0)
+            g = i;
+    }
+    for (int i = 0; g == -1 && i < RL_MAX_GROUPS; i++) {
+        if (get_groups(file)[i].name[0] == '\0') {
+            strcpy(get_groups(file)[i].name, name);
+            get_groups(file)[i].nb_members = 0;
+            for (int m = 0; m < RL_MAX_MEMBERS; m++)
+                erase_owner(&get_groups(file)[i].members[m]);
+            g = i;
+        }
     }
 
-    if (pid == -1)
-        goto error;
-
-    if (pid == 0) {
-        msync(lfd.file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE);
-        errno = EAGAIN;
-        pthread_mutex_unlock(&lfd.file->mutex);
-        return -1;
+    /* the entries of dead members are reused */
+    int m = -1;
+    for (int i = 0; g != -1 && m == -1 && i < RL_MAX_MEMBERS; i++) {
+        rl_owner *member = &get_groups(file)[g].members[i];
+        if (is_owner_free(member)) {
+            get_groups(file)[g].nb_members++;
+            m = i;
+        } else if (is_process_dead(file, member->pid))
+            m = i;
     }
 
-    switch (lck->l_type) {
-      case F_UNLCK:
-        if (apply_unlock(lfd, lck) == -1)
-            goto error;
-        break;
-      case F_RDLCK:
-      case F_WRLCK:
-        if (apply_rw_lock(lfd, lck) == -1)
-            goto error;
-        break;
-      default:
-        goto error;
+    if (m != -1) {
+        rl_owner member = {.pid = getpid(), .fd = lfd.fd};
+        get_groups(file)[g].members[m] = member;
+        membership->fd = lfd.fd;
+        membership->file = file;
+        membership->group = g;
+        rla.nb_groups++;
     }
 
-    if (msync(lfd.file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE) == -1)
+    if (unlock_open_file(file) != 0)
         return -1;
-    if (pthread_mutex_unlock(&lfd.file->mutex) != 0)
+    if (m == -1) {
+        errno = ENOLCK;
         return -1;
+    }
     return 0;
+}
 
- error:
-    msync(lfd.file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE);
-    pthread_mutex_unlock(&lfd.file->mutex);
-    return -1;
+/**
+ * @brief Removes `lfd` from its lock group
+ *
+ * The locks of the group are released if `lfd` was its last member.
+ *
+ * @param lfd the member of the group
+ * @return 0 on success, -1 on failure with errno set to EINVAL if `lfd` is not
+ *         in a group
+ */
+int rl_leave_group(rl_descriptor lfd) {
+    rl_fd_group *membership = find_membership(lfd.fd);
+    if (lfd.file == NULL || membership == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (lock_open_file(lfd.file) != 0)
+        return -1;
+    int res = leave_group(membership);
+    if (unlock_open_file(lfd.file) != 0)
+        return -1;
+    notify_release(lfd.file);
+    grant_pending(lfd.file);
+    return res;
 }
 
 /******************************************************************************/
@@ -1140,13 +7404,15 @@ int rl_fcntl(rl_descriptor lfd, int cmd, struct flock *lck) {
  */
 static int dup_owner(rl_descriptor lfd, rl_owner new_owner) {
     rl_owner lfd_owner = {.pid = getpid(), .fd = lfd.fd};
+    if (absorb_fast_locks(lfd.file, 0, 0, F_UNLCK, equals, lfd_owner) == -1)
+        return -1;
     for (int i = 0; i < lfd.file->nb_locks; i++) {
         rl_lock *tmp = &lfd.file->lock_table[i];
-        int code = is_owner_of(lfd_owner, tmp);
+        int code = is_owner_of(lfd.file, lfd_owner, tmp);
         if (code == -1)
             return -1;
         if (code) {
-            if (add_owner(new_owner, tmp) == -1)
+            if (add_owner(lfd.file, new_owner, tmp) == -1)
                 return -1;
         }
     }
@@ -1168,7 +7434,7 @@ rl_descriptor rl_dup(rl_descriptor lfd) {
     if (new_fd == -1)
         return err;
     
-    if (pthread_mutex_lock(&lfd.file->mutex) != 0)
+    if (lock_open_file(lfd.file) != 0)
         return err;
 
     rl_owner new_owner = {.pid = getpid(), .fd = new_fd};
@@ -1180,9 +7446,7 @@ rl_descriptor rl_dup(rl_descriptor lfd) {
     if (map_increment(lfd.file, getpid()))
         return err;
 
-    if (msync(lfd.file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE) == -1)
-        return err;
-    if (pthread_mutex_unlock(&lfd.file->mutex) != 0)
+    if (unlock_open_file(lfd.file) != 0)
         return err;
 
     rl_descriptor res = {.fd = new_fd, .file = lfd.file};
@@ -1208,7 +7472,7 @@ rl_descriptor rl_dup2(rl_descriptor lfd, int new_fd) {
     if (dup2(lfd.fd, new_fd) == -1)
         return err;
     
-    if (pthread_mutex_lock(&lfd.file->mutex) != 0)
+    if (lock_open_file(lfd.file) != 0)
         return err;
 
     rl_owner new_owner = {.pid = getpid(), .fd = new_fd};
@@ -1220,9 +7484,7 @@ rl_descriptor rl_dup2(rl_descriptor lfd, int new_fd) {
     if (map_increment(lfd.file, getpid()))
         return err;
 
-    if (msync(lfd.file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE) == -1)
-        return err;
-    if (pthread_mutex_unlock(&lfd.file->mutex) != 0)
+    if (unlock_open_file(lfd.file) != 0)
         return err;
 
     rl_descriptor res = {.fd = new_fd, .file = lfd.file};
@@ -1248,44 +7510,80 @@ pid_t rl_fork() {
         pid_t child = getpid();
         for (int i = 0; i < rla.nb_files; i++) {
             rl_open_file *file = rla.open_files[i];
+            /* the child has a copy of the private files, not shared with the
+             * parent */
+            if (file->flags & RL_PRIVATE_FILE)
+                continue;
+
+            if (lock_open_file(file) != 0)
+                return err;
 
-            if (pthread_mutex_lock(&file->mutex) != 0)
+            rl_owner parent_owner = {.pid = parent, .fd = 0};
+            if (absorb_fast_locks(file, 0, 0, F_UNLCK, same_pid, parent_owner)
+                    == -1)
                 return err;
 
             for (int j = 0; j < file->nb_locks; j++) {
                 rl_lock *lck = &file->lock_table[j];
                 int nb_owners = lck->nb_owners;
                 for (int k = 0; k < nb_owners; k++) {
-                    if (lck->lock_owners[k].pid == parent) {
+                    rl_owner *owner = get_lock_owner(file, lck, k);
+                    if (owner->pid == parent) {
                         rl_owner child_owner = {.pid = child,
-                                                .fd = lck->lock_owners[k].fd};
-                        if (add_owner(child_owner, lck) == -1)
+                                                .fd = owner->fd};
+                        if (add_owner(file, child_owner, lck) == -1)
+                            return err;
+                    }
+                }
+                for (int r = 0; has_reader_map(file, lck)
+                        && r < RL_MAX_READERS; r++) {
+                    if (test_reader(file, lck, r)
+                            && get_readers(file)[r].pid == parent) {
+                        rl_owner child_owner = {.pid = child,
+                                                .fd = get_readers(file)[r].fd};
+                        if (add_owner(file, child_owner, lck) == -1)
                             return err;
                     }
                 }
             }
 
+            /* the child is a member of the lock groups of the parent */
+            for (int g = 0; g < RL_MAX_GROUPS; g++) {
+                rl_group *group = &get_groups(file)[g];
+                for (int m = 0; group->name[0] != '\0'
+                        && m < RL_MAX_MEMBERS; m++) {
+                    if (group->members[m].pid != parent)
+                        continue;
+                    int n = 0;
+                    while (n < RL_MAX_MEMBERS
+                            && !is_owner_free(&group->members[n]))
+                        n++;
+                    if (n == RL_MAX_MEMBERS)
+                        return err;
+                    group->members[n].pid = child;
+                    group->members[n].fd = group->members[m].fd;
+                    group->nb_members++;
+                }
+            }
+
             // Clone the fd count of the parent
             rl_pid_fd_count *parent_entry = NULL;
             for (int z = 0; z < file->nb_map_entries; z++)
-                if (file->pid_map[z].pid == parent)
-                    parent_entry = &file->pid_map[z];
+                if (get_pid_map(file)[z].pid == parent)
+                    parent_entry = &get_pid_map(file)[z];
 
             if (parent_entry != NULL) {
                 if (file->nb_map_entries >= RL_MAX_MAP_ENTRIES)
                     return err;
                 // TODO: An entry with key == child could very rarely already
                 // exist if the system reuses a PID
-                file->pid_map[file->nb_map_entries].pid = child;
-                file->pid_map[file->nb_map_entries].fd_count
+                get_pid_map(file)[file->nb_map_entries].pid = child;
+                get_pid_map(file)[file->nb_map_entries].fd_count
                         = parent_entry->fd_count;
                 file->nb_map_entries++;
             }
 
-            if (msync(file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE)
-                    == -1)
-                return err;
-            if (pthread_mutex_unlock(&file->mutex) != 0)
+            if (unlock_open_file(file) != 0)
                 return err;
         }
         return 0;
@@ -1306,6 +7604,30 @@ int rl_print_open_file(rl_open_file *file, int display_pids) {
     char buffer[16384] = "";
     int len = 0;
 
+    if (file->flags & RL_ATTR_BLOCKS) {
+        rl_block_area area;
+        get_block_area((char *) file + file->blocks_offset, file->nb_blocks,
+                &area);
+        for (size_t b = 0; b < file->nb_blocks && len < 16000; b++) {
+            unsigned int readers = atomic_load(&area.readers[b]);
+            unsigned long long writer = atomic_load(&area.writers[b]);
+            if (readers > 0)
+                len += sprintf(buffer + len, "Block %lu: %u reader(s)\n", b,
+                        readers);
+            else if (writer != 0 && display_pids)
+                len += sprintf(buffer + len,
+                        "Block %lu: written by fd = %u, pid = %llu\n", b,
+                        (unsigned int) writer, writer >> 32);
+            else if (writer != 0)
+                len += sprintf(buffer + len, "Block %lu: written by fd = %u\n",
+                        b, (unsigned int) writer);
+        }
+        printf("%s", buffer);
+        return 0;
+    }
+
+    if (attach_chunk_pool(file) == -1)
+        return -1;
     len += sprintf(buffer + len, "Number of locks: %d\n",
             file->nb_locks);
 
@@ -1316,18 +7638,29 @@ int rl_print_open_file(rl_open_file *file, int display_pids) {
 
         if (lck->type == F_RDLCK)
             len += sprintf(buffer + len, "Type: read\n");
+        else if (lck->type == RL_UPDLCK)
+            len += sprintf(buffer + len, "Type: update\n");
         else
             len += sprintf(buffer + len, "Type: write\n");
 
         len += sprintf(buffer + len, "Start: %ld\n", lck->start);
         len += sprintf(buffer + len, "Length: %ld\n", lck->len);
 
+        if (has_reader_map(file, lck)) {
+            len += sprintf(buffer + len, "Number of readers: %lu\n",
+                    lck->nb_readers);
+            continue;
+        }
+
         len += sprintf(buffer + len, "Number of owners: %lu\n",
                 lck->nb_owners);
         for (int j = 0; j < lck->nb_owners; j++) {
-            rl_owner *owner = &lck->lock_owners[j];
+            rl_owner *owner = get_lock_owner(file, lck, j);
 
-            if (display_pids)
+            if (is_group_owner(*owner))
+                len += sprintf(buffer + len, "Owner %d: group %s\n", j,
+                        get_groups(file)[get_group(*owner)].name);
+            else if (display_pids)
                 len += sprintf(buffer + len, "Owner %d: fd = %d, pid = %d\n", j,
                         owner->fd, owner->pid);
             else
@@ -1336,6 +7669,52 @@ int rl_print_open_file(rl_open_file *file, int display_pids) {
         }
     }
 
+    static const char *mode_names[RL_NB_MODES] = {"IS", "IX", "S", "SIX",
+                                                  "X"};
+    for (int i = 0; i < RL_MAX_INTENTS && file->flags & RL_ATTR_INTENTS;
+            i++) {
+        rl_intent *intent = &get_intents(file)[i];
+        if (is_owner_free(&intent->owner))
+            continue;
+        len += sprintf(buffer + len, "===== File mode: %s\n",
+                mode_names[intent->mode]);
+        if (display_pids)
+            len += sprintf(buffer + len, "Owner: fd = %d, pid = %d\n",
+                    intent->owner.fd, intent->owner.pid);
+        else
+            len += sprintf(buffer + len, "Owner: fd = %d\n", intent->owner.fd);
+    }
+
+    for (int g = 0; g < RL_MAX_GROUPS && file->flags & RL_ATTR_GROUPS; g++) {
+        if (get_groups(file)[g].name[0] != '\0')
+            len += sprintf(buffer + len, "===== Group %s: %d member(s)\n",
+                    get_groups(file)[g].name, get_groups(file)[g].nb_members);
+    }
+
+    for (int i = 0; i < RL_FAST_SLOTS + get_nb_bias_slots(file); i++) {
+        rl_fast_slot *slot = i < RL_FAST_SLOTS ?
+            &file->fast_slots[i] : &get_bias_slots(file)[i - RL_FAST_SLOTS];
+        unsigned int kind = SLOT_KIND(atomic_load(&slot->state));
+        if (kind == RL_SLOT_HELD && i < RL_FAST_SLOTS)
+            len += sprintf(buffer + len, "===== Fast lock %d:\n", i);
+        else if (kind == RL_SLOT_HELD)
+            len += sprintf(buffer + len, "===== Biased lock %d:\n",
+                    i - RL_FAST_SLOTS);
+        else if (kind == RL_SLOT_IDLE)
+            len += sprintf(buffer + len, "===== Lease %d:\n", i);
+        else
+            continue;
+        len += sprintf(buffer + len, "Type: %s\n",
+                slot->type == F_RDLCK ? "read" : "write");
+        len += sprintf(buffer + len, "Start: %ld\n", slot->start);
+        len += sprintf(buffer + len, "Length: %ld\n", slot->len);
+        if (display_pids)
+            len += sprintf(buffer + len, "Owner: fd = %d, pid = %d\n",
+                    slot->owner.fd, slot->owner.pid);
+        else
+            len += sprintf(buffer + len, "Owner: fd = %d\n", slot->owner.fd);
+    }
+
     printf("%s", buffer);
     return 0;
 }
@@ -1344,22 +7723,26 @@ int rl_print_open_file(rl_open_file *file, int display_pids) {
  * @brief Prints an `rl_open_file` to standard output
  *
  * In order to print, this function takes the lock on the open file in order to
- * guarantee mutual exclusion during the print.
+ * guarantee mutual exclusion during the print. The fast locks are moved into
+ * the lock table first, so that they are printed merged with the others, while
+ * the leases are kept.
  *
  * @param file the open file to print
  * @param display_pids whether to print owner PIDs
  * @return 0 on success, -1 on error
  */
 int rl_print_open_file_safe(rl_open_file *file, int display_pids) {
-    if (pthread_mutex_lock(&file->mutex) != 0)
+    if (lock_open_file(file) != 0)
+        return -1;
+
+    rl_owner any = {.pid = 0, .fd = 0};
+    if (absorb_fast_locks(file, 0, 0, F_UNLCK, NULL, any) == -1)
         return -1;
     
     if (rl_print_open_file(file, display_pids) < 0)
         return -1;
 
-    if (msync(file, sizeof(rl_open_file), MS_SYNC | MS_INVALIDATE) == -1)
-        return -1;
-    if (pthread_mutex_unlock(&file->mutex) != 0)
+    if (unlock_open_file(file) != 0)
         return -1;
 
     return 0;
@@ -4,8 +4,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/uio.h>
 
-#define RL_MAX_MAP_ENTRIES 256
+#define RL_MAX_MAP_ENTRIES 128
 #define RL_MAX_OWNERS 32
 #define RL_MAX_LOCKS 32
 #define RL_MAX_FILES 256
@@ -13,13 +16,87 @@
 #define RL_FREE_FILE NULL
 #define RL_FREE_LOCK -2
 #define SHM_PREFIX "f"
+#define SHM_NAMED_PREFIX "n"
+#define SHM_ARENA_NAME "/a_huge"
+#define SHM_POOL_NAME "/c_pool"
+#define RL_HUGETLBFS_DIR "/dev/hugepages"
+#define RL_SHM_DIR "/dev/shm"
+#define RL_MAX_BLOCK_HOLDERS 64
+#define RL_FAST_SLOTS 16
+#define RL_MAX_READERS 512
+#define RL_BIAS_SLOTS 64
+#define RL_MCS_NODES 32
+#define RL_MAX_COHORTS 8
+#define RL_COHORT_NODES 32
+#define RL_REQUEST_SLOTS 64
+#define RL_MAX_PENDING 64
+#define RL_MAX_APPENDS 64
+#define RL_MAX_INTENTS 64
+#define RL_MAX_GROUPS 16
+#define RL_MAX_MEMBERS 64
+#define RL_GROUP_NAME_MAX 32
+#define RL_MAX_LEASES (RL_MAX_LOCKS * RL_MAX_OWNERS + RL_MAX_READERS \
+        + RL_MAX_INTENTS)
+#define RL_MAX_KEY 128
+#define RL_INLINE_OWNERS 4
+#define RL_OWNER_CHUNKS 32
+#define RL_POOL_CHUNKS 1024
+#define RL_ARENA_SLOTS 128
+#define RL_SHM_NAME_MAX (RL_MAX_KEY + 8)
+#define RL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#define RL_ATTR_BLOCKS 0x1
+#define RL_ATTR_LEASES 0x2
+#define RL_ATTR_COUNTED_READERS 0x4
+#define RL_ATTR_READER_BIAS 0x8
+#define RL_ATTR_COHORT 0x10
+#define RL_ATTR_COMBINING 0x20
+#define RL_ATTR_INTENTS 0x40
+#define RL_ATTR_ESCALATE_FILE 0x80
+#define RL_ATTR_HUGE_PAGES 0x100
+#define RL_ATTR_ASYNC 0x200
+#define RL_ATTR_APPENDS 0x400
+#define RL_ATTR_GROUPS 0x800
+
+#define RL_MODE_NONE -1
+#define RL_MODE_IS 0
+#define RL_MODE_IX 1
+#define RL_MODE_S 2
+#define RL_MODE_SIX 3
+#define RL_MODE_X 4
+#define RL_NB_MODES 5
+
+#define RL_UPDLCK 8
+
+#define RL_POLICY_SYNC_RANGE 0x1
+#define RL_POLICY_FDATASYNC 0x2
+#define RL_POLICY_WILLNEED 0x4
 
 typedef struct rl_pid_fd_count rl_pid_fd_count;
 typedef struct rl_owner rl_owner;
 typedef struct rl_lock rl_lock;
+typedef struct rl_owner_chunk rl_owner_chunk;
 typedef struct rl_open_file rl_open_file;
 typedef struct rl_descriptor rl_descriptor;
 typedef struct rl_all_files rl_all_files;
+typedef struct rl_fd_policy rl_fd_policy;
+typedef struct rl_file_attr rl_file_attr;
+typedef struct rl_fast_slot rl_fast_slot;
+typedef struct rl_mcs_node rl_mcs_node;
+typedef struct rl_cohort rl_cohort;
+typedef struct rl_request_slot rl_request_slot;
+typedef struct rl_pending_request rl_pending_request;
+typedef struct rl_async_request rl_async_request;
+typedef struct rl_append_slot rl_append_slot;
+typedef struct rl_append rl_append;
+typedef struct rl_intent rl_intent;
+typedef struct rl_lease rl_lease;
+typedef struct rl_group rl_group;
+typedef struct rl_fd_group rl_fd_group;
+typedef struct rl_usage rl_usage;
+typedef struct rl_arena_slot rl_arena_slot;
+typedef struct rl_arena rl_arena;
+typedef struct rl_chunk_pool rl_chunk_pool;
 
 /**
  * @brief A map entry with key = PID and value = fd count
@@ -37,29 +114,408 @@ struct rl_owner {
     int fd; /**< The file descriptor of the locked file */
 };
 
+/**
+ * @brief The owners of a lock beyond its inline owners, see `rl_chunk_pool`
+ */
+struct rl_owner_chunk {
+    rl_owner owners[RL_MAX_OWNERS - RL_INLINE_OWNERS]; /**< The owners */
+};
+
 /**
  * @brief The locked segment of a file
+ *
+ * On a file created with `RL_ATTR_COUNTED_READERS`, the owners of a read lock
+ * are not stored in `lock_owners` but counted in the reader map of the lock,
+ * kept by the file at the index of the lock in `lock_table`, whose bit `r`
+ * stands for the entry `r` of the reader registry of the file.
+ *
+ * The first `RL_INLINE_OWNERS` owners are stored in `lock_owners`, the
+ * following ones in an overflow chunk taken from the shared pool while
+ * the lock has more owners.
+ *
+ * An update lock (`RL_UPDLCK`) is compatible with read locks but not with
+ * other update or write locks. While its owner waits in `rl_upgrade()`,
+ * `upgrading` is set and new read locks on the segment are refused.
  */
 struct rl_lock {
     off_t start; /**< The beginning of the segment */
     off_t len; /**< The length of the segment */
-    short type; /**< The type (F_RDLCK, F_WRLCK) of the lock */
+    short type; /**< The type (F_RDLCK, RL_UPDLCK, F_WRLCK) of the lock */
+    short upgrading; /**< Whether the update lock is being upgraded */
     size_t nb_owners; /**< The number of owners of the lock */
-    rl_owner lock_owners[RL_MAX_OWNERS]; /**< The owners of the lock */
+    rl_owner lock_owners[RL_INLINE_OWNERS]; /**< The first owners of the
+                                             * lock
+                                             */
+    int overflow; /**< The index + 1 of the chunk of the owners beyond
+                   * `lock_owners`, 0 if there is none
+                   */
+    size_t nb_readers; /**< The number of owners counted in the reader map of
+                        * the lock, with `RL_ATTR_COUNTED_READERS`
+                        */
+};
+
+/**
+ * @brief A lock granted without taking the mutex of the open file
+ *
+ * The fields other than `state` are only meaningful while the slot is used and
+ * are written before the slot is published. On a file created with
+ * `RL_ATTR_LEASES`, a released slot stays used as a lease of its owner.
+ */
+struct rl_fast_slot {
+    _Alignas(64) atomic_uint state; /**< The state of the slot in the three
+                                     * low bits and a generation in the others
+                                     */
+    short type; /**< The type (F_RDLCK, F_WRLCK) of the lock */
+    off_t start; /**< The beginning of the segment */
+    off_t len; /**< The length of the segment */
+    rl_owner owner; /**< The owner of the lock */
+};
+
+/**
+ * @brief A node of the queue of processes waiting for the exclusive lock on an
+ * open file
+ *
+ * Each waiter spins on the `wait` word of its own node, then parks on it with
+ * a futex. The lock is handed over to the waiters in FIFO order.
+ */
+struct rl_mcs_node {
+    _Alignas(64) atomic_int owner; /**< The PID of the process using the node,
+                                    * 0 if it is free
+                                    */
+    atomic_int next; /**< The index + 1 of the next node in the queue, 0 if
+                      * there is none yet
+                      */
+    atomic_int prev; /**< The index + 1 of the previous node in the queue, 0
+                      * if there was none, set before the node became the tail
+                      */
+    atomic_int wait; /**< Whether the owner is still waiting for the lock */
+};
+
+/**
+ * @brief The local lock of the processes running on a NUMA node, with
+ * `RL_ATTR_COHORT`
+ *
+ * A process takes the local lock of its node, then the lock of the open file
+ * unless a process of the same node handed it over with the local lock.
+ */
+struct rl_cohort {
+    _Alignas(64) atomic_int tail; /**< The index + 1 of the last node in the
+                                   * local queue, 0 if it is free
+                                   */
+    int holder; /**< The index of the node of the holder of the local lock */
+    int batch; /**< The number of handovers inside the cohort since it took
+                * the lock of the open file
+                */
+    int global_held; /**< Whether the cohort holds the lock of the open file */
+    rl_mcs_node nodes[RL_COHORT_NODES]; /**< The nodes of the local queue */
+};
+
+/**
+ * @brief A lock request published for the holder of the mutex of an open file,
+ * with `RL_ATTR_COMBINING`
+ *
+ * The fields other than `state` are written by the requester before the
+ * request is posted, then `result` and `error` by the process that applies it.
+ */
+struct rl_request_slot {
+    _Alignas(64) atomic_int state; /**< The state of the request */
+    rl_owner owner; /**< The owner of the lock */
+    pid_t pid; /**< The PID of the requester */
+    short type; /**< The type (F_RDLCK, F_WRLCK, F_UNLCK) of the request */
+    off_t start; /**< The beginning of the segment */
+    off_t len; /**< The length of the segment */
+    int result; /**< The return value of the request, 0 or -1 */
+    int error; /**< The value of errno after the request */
+};
+
+/**
+ * @brief A lock request waiting to be granted asynchronously, see
+ * `rl_fcntl_async()`
+ *
+ * The process that releases a lock applies the waiting requests on behalf of
+ * their owners, then signals them on the abstract unix datagram socket named
+ * after `pid` and `id`.
+ */
+struct rl_pending_request {
+    _Alignas(64) atomic_int state; /**< The state of the request */
+    rl_owner owner; /**< The owner of the lock */
+    pid_t pid; /**< The PID of the requester */
+    unsigned int id; /**< The number of the request in its process */
+    short type; /**< The type (F_RDLCK, F_WRLCK) of the lock */
+    off_t start; /**< The beginning of the segment */
+    off_t len; /**< The length of the segment */
+    int error; /**< The value of errno if the request failed */
+};
+
+/**
+ * @brief A range reserved at the end of a file by `rl_append_reserve()`
+ */
+struct rl_append_slot {
+    _Alignas(64) atomic_int state; /**< The state of the reservation */
+    pid_t pid; /**< The PID of the process that reserved the range */
+    off_t start; /**< The beginning of the range */
+    off_t len; /**< The length of the range */
+};
+
+/**
+ * @brief A file-level mode held by an owner, with `RL_ATTR_INTENTS`
+ */
+struct rl_intent {
+    rl_owner owner; /**< The holder of the mode, free if `owner.fd` is
+                     * `RL_FREE_OWNER`
+                     */
+    int mode; /**< The `RL_MODE_*` mode held */
+};
+
+/**
+ * @brief The lease of an owner on the locks of a file created with a positive
+ * `lease_ns`
+ */
+struct rl_lease {
+    rl_owner owner; /**< The holder of the lease, free if `owner.fd` is
+                     * `RL_FREE_OWNER`
+                     */
+    long long expires; /**< The CLOCK_MONOTONIC time in ns after which the
+                        * locks of `owner` may be revoked
+                        */
+    int revoked; /**< Whether the locks of `owner` were revoked since its
+                  * last request
+                  */
+};
+
+/**
+ * @brief A lock group, see `rl_join_group()`
+ *
+ * The locks of a group are held by the owner `{.pid = -2 - g, .fd = 0}`,
+ * where `g` is the index of the group in `groups`, on behalf of all its
+ * members.
+ */
+struct rl_group {
+    char name[RL_GROUP_NAME_MAX]; /**< The name of the group, empty if the
+                                   * group is free
+                                   */
+    int nb_members; /**< The number of members */
+    rl_owner members[RL_MAX_MEMBERS]; /**< The descriptors that joined the
+                                       * group, free if `fd` is
+                                       * `RL_FREE_OWNER`
+                                       */
+};
+
+/**
+ * @brief The attributes of a lock-tracked file
+ *
+ * Attributes are only taken into account by the process that creates the
+ * shared memory object of the file, the following openers use the
+ * representation chosen by the creator.
+ */
+struct rl_file_attr {
+    int flags; /**< A bitwise OR of `RL_ATTR_*` flags */
+    size_t block_size; /**< The size of a block, with `RL_ATTR_BLOCKS` */
+    size_t nb_blocks; /**< The number of blocks, with `RL_ATTR_BLOCKS` */
+    int escalation; /**< The number of locks of a type an owner may hold before
+                     * they are coalesced, 0 to never coalesce them
+                     */
+    long long lease_ns; /**< The time in ns after which the locks of an owner
+                         * that has not called the library may be revoked,
+                         * 0 to never revoke them, not with
+                         * `RL_ATTR_LEASES`
+                         */
+    int quota; /**< The number of locks of the lock table an owner may own, 0
+                * for no limit
+                */
+    int group_quota; /**< The number of locks of the lock table a lock group
+                      * may own, 0 to use `quota`
+                      */
 };
 
 /**
  * @brief The locks on an open file description
+ *
+ * The structure only holds the state every file uses. It is followed in the
+ * shared memory object by `lock_table`, then by the areas at the `*_offset`
+ * fields, which are laid out from the attributes of the file: an area used by
+ * an attribute is only there with the attribute, its offset is 0 otherwise.
+ * Pages of an area are only allocated once it is used.
+ *
+ * With `RL_ATTR_BLOCKS`, the locks are not stored in `lock_table` but in a
+ * block area starting at `blocks_offset`. It holds per-block reader counts,
+ * per-block writers, a writer bitmap and the read bitmaps of at most
+ * `RL_MAX_BLOCK_HOLDERS` descriptors.
+ *
+ * Otherwise, locks that conflict with nothing are granted without the mutex in
+ * `fast_slots`. The summary fields describe the locks of `lock_table` so that
+ * such requests can be checked against it without taking the mutex. They are
+ * only written under the mutex, between two increments of `summary_seq`.
+ *
+ * With `RL_ATTR_READER_BIAS`, while `bias` is on, read locks are granted in
+ * biased slots by only checking `bias`, since no write lock can exist then. A
+ * write request turns `bias` off and moves the biased locks into `lock_table`.
+ *
+ * With `RL_ATTR_COHORT`, `RL_MAX_COHORTS` cohorts, one per page, start at
+ * `cohorts_offset`. The page of the cohort `c` is preferably placed on the NUMA
+ * node `c`.
+ *
+ * With `RL_ATTR_COMBINING`, requests that need the mutex are posted in
+ * request slots and the holder of the mutex applies all the posted requests.
+ *
+ * When an owner holds more than `escalation` locks of a type in `lock_table`,
+ * its locks separated by segments where it could put the same lock are
+ * coalesced. With `RL_ATTR_ESCALATE_FILE`, they are replaced by a lock on the
+ * whole file if no other owner holds locks on the file.
+ *
+ * With `RL_ATTR_INTENTS`, owners take a file-level mode before locking ranges,
+ * and `nb_modes` counts the holders of each mode, so that whole-file requests
+ * are checked against the counters only.
+ *
+ * The descriptors that joined a lock group lock on behalf of the group.
+ *
+ * When `lease_ns` is positive, each owner of locks of `lock_table` has a
+ * lease, which expires `lease_ns` ns after its last request or `rl_renew()`.
+ * A request that conflicts with a lock of an owner whose lease expired revokes
+ * all the locks of this owner, which is recorded in its lease until its next
+ * request fails with EKEYEXPIRED. A lock shared with other owners still
+ * conflicts while one of them holds a valid lease.
+ *
+ * A named lock space, see `rl_open_named()`, has no backing file: its offsets
+ * are keys of a logical space of `space` keys. So has a private lock space,
+ * see `rl_open_private()`, which lives in the memory of its process.
+ *
+ * When `quota` or `group_quota` is positive, a lock request fails with EDQUOT
+ * if its owner would be an owner of more locks of `lock_table` than allowed.
+ *
+ * The owners of a lock beyond its inline ones are stored in a chunk of the
+ * shared pool `pool_id`, see `rl_chunk_pool`. A private lock space has its own
+ * `RL_OWNER_CHUNKS` chunks at `chunks_offset` instead.
  */
 struct rl_open_file {
+    int flags; /**< The `RL_ATTR_*` flags the file was created with */
+    size_t size; /**< The size of the shared memory object */
+    char key[RL_MAX_KEY]; /**< The key of a named lock space, empty for a
+                           * file
+                           */
+    off_t space; /**< The size of a named lock space, 0 if unbounded */
+    size_t block_size; /**< The size of a block, with `RL_ATTR_BLOCKS` */
+    size_t nb_blocks; /**< The number of blocks, with `RL_ATTR_BLOCKS` */
+    size_t blocks_offset; /**< The offset of the block area, with
+                           * `RL_ATTR_BLOCKS`
+                           */
+    size_t cohorts_offset; /**< The offset of the cohorts, with
+                            * `RL_ATTR_COHORT`
+                            */
+    long long pool_id; /**< The identifier of the shared pool of overflow
+                        * chunks the file draws from, 0 if none yet
+                        */
+    size_t chunks_offset; /**< The offset of the overflow chunks of a private
+                           * lock space, 0 for a shared file
+                           */
+    unsigned long long chunk_map; /**< The chunks of a private lock space in
+                                   * use
+                                   */
+    size_t pid_map_offset; /**< The offset of the map storing which processes
+                            * have opened the file and how many times
+                            */
+    size_t mcs_nodes_offset; /**< The offset of the `RL_MCS_NODES` queue nodes
+                              * of the exclusive lock on the open file
+                              */
+    size_t bias_slots_offset; /**< The offset of the `RL_BIAS_SLOTS` biased
+                               * read locks, with `RL_ATTR_READER_BIAS`
+                               */
+    size_t requests_offset; /**< The offset of the `RL_REQUEST_SLOTS` requests
+                             * posted for the holder of the lock, with
+                             * `RL_ATTR_COMBINING`
+                             */
+    size_t readers_offset; /**< The offset of the `RL_MAX_READERS` owners of
+                            * the reader registry, with
+                            * `RL_ATTR_COUNTED_READERS`
+                            */
+    size_t reader_maps_offset; /**< The offset of the reader maps of the locks
+                                * of `lock_table`, with
+                                * `RL_ATTR_COUNTED_READERS`
+                                */
+    size_t intents_offset; /**< The offset of the `RL_MAX_INTENTS` holders of
+                            * file-level modes, with `RL_ATTR_INTENTS`
+                            */
+    size_t leases_offset; /**< The offset of the `RL_MAX_LEASES` leases of the
+                           * owners, with a positive `lease_ns`
+                           */
+    size_t pending_offset; /**< The offset of the `RL_MAX_PENDING` lock
+                            * requests waiting to be granted asynchronously,
+                            * with `RL_ATTR_ASYNC`
+                            */
+    size_t appends_offset; /**< The offset of the `RL_MAX_APPENDS` reserved
+                            * ranges which are not in the committed prefix,
+                            * with `RL_ATTR_APPENDS`
+                            */
+    size_t groups_offset; /**< The offset of the `RL_MAX_GROUPS` lock groups,
+                           * with `RL_ATTR_GROUPS`
+                           */
+    atomic_uint summary_seq; /**< The sequence number of the summary, odd
+                              * while it is being written
+                              */
+    _Atomic off_t summary_start; /**< The start of the bounding segment of the
+                                  * locks of `lock_table`
+                                  */
+    _Atomic off_t summary_len; /**< The length of the bounding segment, 0 if
+                                * extensible, -1 if there are no locks
+                                */
+    atomic_int summary_writer; /**< Whether `lock_table` has a write lock */
+    rl_fast_slot fast_slots[RL_FAST_SLOTS]; /**< The locks granted without the
+                                             * mutex
+                                             */
+    _Alignas(64) atomic_int bias; /**< The state of the reader bias, with
+                                   * `RL_ATTR_READER_BIAS`
+                                   */
+    _Atomic long long bias_inhibit_until; /**< The CLOCK_MONOTONIC time in ns
+                                           * before which the bias can't be
+                                           * turned on again
+                                           */
     int nb_locks; /**< The number of locks */
-    pthread_mutex_t mutex; /**< The exclusive lock on the open file */
-    rl_lock lock_table[RL_MAX_LOCKS]; /**< The locks on the open file */
-    int nb_map_entries; /**< The number of entries in `pid_map` */
-    rl_pid_fd_count pid_map[RL_MAX_MAP_ENTRIES]; /**< The map storing which
-                                                  * processes have opened the
-                                                  * file and how many times
-                                                  */
+    int escalation; /**< The number of locks of a type an owner may hold before
+                     * they are coalesced, 0 to never coalesce them
+                     */
+    long long lease_ns; /**< The duration of the leases of the owners in ns,
+                         * 0 if they never expire
+                         */
+    int quota; /**< The number of locks an owner may own, 0 for no limit */
+    int group_quota; /**< The number of locks a lock group may own, 0 for no
+                      * limit
+                      */
+    _Alignas(64) atomic_int mcs_tail; /**< The index + 1 of the last node in
+                                       * the queue of the exclusive lock on
+                                       * the open file, 0 if it is free
+                                       */
+    int mcs_holder; /**< The index of the node of the holder of the lock */
+    int cohort_holder; /**< The cohort of the holder of the lock, -1 if it
+                        * took the lock without a cohort
+                        */
+    _Alignas(64) atomic_int release_seq; /**< Incremented when locks are
+                                          * released while processes wait
+                                          * for a lock
+                                          */
+    atomic_int nb_waiters; /**< The number of processes waiting for a lock */
+    atomic_int nb_parked; /**< The number of waiters parked on `release_seq` */
+    _Atomic long long wait_ns; /**< The moving average of the time waiters
+                                * wait for a release, in ns
+                                */
+    atomic_int nb_pending; /**< The number of requests waiting to be granted
+                            * asynchronously
+                            */
+    _Alignas(64) _Atomic off_t append_tail; /**< The end of the ranges
+                                             * reserved for appends
+                                             */
+    atomic_int append_init; /**< Whether `append_tail` was initialized */
+    _Atomic off_t append_committed; /**< The end of the longest prefix whose
+                                     * reserved ranges are all committed
+                                     */
+    atomic_int commit_seq; /**< Incremented when `append_committed` grows */
+    atomic_int append_lock; /**< The tail of the MCS queue of the lock on the
+                             * committed prefix
+                             */
+    int nb_modes[RL_NB_MODES]; /**< The number of holders of each file-level
+                                * mode, with `RL_ATTR_INTENTS`
+                                */
+    int nb_map_entries; /**< The number of entries in the PID map */
+    rl_lock lock_table[]; /**< The `RL_MAX_LOCKS` locks on the open file */
 };
 
 /**
@@ -70,17 +526,182 @@ struct rl_descriptor {
     rl_open_file *file; /**< The locks on the open file */
 };
 
+/**
+ * @brief The handle of an asynchronous lock request
+ */
+struct rl_async_request {
+    int fd; /**< The descriptor which becomes readable once the request is
+             * granted, has failed or has been cancelled, -1 if the request
+             * was granted at once
+             */
+    rl_open_file *file; /**< The open file of the request */
+    int slot; /**< The index of the request in `file->pending` */
+};
+
+/**
+ * @brief The handle of a range reserved for an append
+ */
+struct rl_append {
+    off_t offset; /**< The beginning of the range */
+    off_t len; /**< The length of the range */
+    int slot; /**< The index of the reservation in `file->appends` */
+};
+
+/**
+ * @brief The I/O policy of a descriptor, see `rl_set_policy()`
+ *
+ * Segments are described by their start and length, 0 if extensible, -1 if
+ * empty.
+ */
+struct rl_fd_policy {
+    int fd; /**< The descriptor, -1 if the entry is free */
+    int flags; /**< A bitwise OR of `RL_POLICY_*` flags */
+    int batch; /**< The number of write-unlocks per sync */
+    int nb_unlocks; /**< The number of write-unlocks since the last sync */
+    int error; /**< The errno of the last failed sync, 0 if none */
+    off_t written_start; /**< The start of the segment write-locked since the
+                          * last sync
+                          */
+    off_t written_len; /**< The length of the segment write-locked since the
+                        * last sync
+                        */
+    off_t dirty_start; /**< The start of the segment to sync */
+    off_t dirty_len; /**< The length of the segment to sync */
+};
+
+/**
+ * @brief The number of locks of the lock table owned by an owner, see
+ * `rl_lock_usage()`
+ */
+struct rl_usage {
+    rl_owner owner; /**< The owner */
+    int nb_locks; /**< The number of locks of which it is an owner */
+};
+
+/**
+ * @brief The membership of a descriptor in a lock group
+ */
+struct rl_fd_group {
+    int fd; /**< The descriptor, -1 if the entry is free */
+    rl_open_file *file; /**< The open file of the descriptor */
+    int group; /**< The index of the group in `file->groups` */
+};
+
+/**
+ * @brief A slot of the arena of huge pages
+ */
+struct rl_arena_slot {
+    char name[RL_SHM_NAME_MAX]; /**< The name of the shared memory object the
+                                 * open file in the slot stands for, empty if
+                                 * the slot is free
+                                 */
+};
+
+/**
+ * @brief The shared arena of huge pages which holds the open files created
+ * with `RL_ATTR_HUGE_PAGES`
+ *
+ * The arena is a file of a hugetlbfs mounted at `RL_HUGETLBFS_DIR`, or else
+ * the shared memory object `SHM_ARENA_NAME` advised to use transparent huge
+ * pages. Each open file takes `slot_size` bytes from `slots_offset`: the lock
+ * tables of many files share a few huge pages. The shared memory object of a
+ * file in a slot is only a marker holding the flags of the file.
+ *
+ * The arena is built under a temporary name and published once initialized.
+ * It is removed when its last slot is freed.
+ */
+struct rl_arena {
+    atomic_int lock; /**< The PID of the holder of the lock on the slots, 0 if
+                      * it is free
+                      */
+    size_t size; /**< The size of the arena */
+    size_t slot_size; /**< The size of a slot */
+    size_t slots_offset; /**< The offset of the first slot */
+    int hugetlbfs; /**< Whether the arena is a file of the hugetlbfs */
+    int unlinked; /**< Whether the arena was removed, once empty */
+    rl_arena_slot slots[RL_ARENA_SLOTS]; /**< The slots */
+};
+
+/**
+ * @brief The shared pool of the overflow chunks of the locks with more than
+ * `RL_INLINE_OWNERS` owners
+ *
+ * The pool is the shared memory object `SHM_POOL_NAME`, of `RL_POOL_CHUNKS`
+ * chunks from `chunks_offset`: a file only uses pages of the pool once its
+ * locks have many owners. A file records the pool it draws from at its first
+ * chunk and keeps it until the file is removed, when its chunks are given
+ * back. The pool is removed once no file draws from it.
+ *
+ * The pool is built under a temporary name and published once initialized.
+ */
+struct rl_chunk_pool {
+    atomic_int lock; /**< The PID of the holder of the lock on the chunks, 0 if
+                      * it is free
+                      */
+    long long id; /**< The identifier of the pool, which differs from the ones
+                   * of the pools removed before it
+                   */
+    size_t size; /**< The size of the pool */
+    size_t chunks_offset; /**< The offset of the first chunk */
+    int nb_files; /**< The number of files that draw from the pool */
+    int unlinked; /**< Whether the pool was removed, once unused */
+    unsigned long long chunk_map[RL_POOL_CHUNKS / 64]; /**< The chunks in use */
+};
+
 /**
  * @brief All the open file descriptions of a process
  */
 struct rl_all_files {
     int nb_files; /**< The number of open file descriptions */
     rl_open_file *open_files[RL_MAX_FILES]; /**< The open file descriptions */
+    int nb_policies; /**< The number of descriptors with an I/O policy */
+    rl_fd_policy policies[RL_MAX_FILES]; /**< The I/O policies of the
+                                          * descriptors
+                                          */
+    int nb_groups; /**< The number of descriptors in a lock group */
+    rl_fd_group groups[RL_MAX_FILES]; /**< The lock groups of the
+                                       * descriptors
+                                       */
 };
 
 rl_descriptor rl_open(const char *path, int oflag, ...);
+rl_descriptor rl_open_attr(const char *path, int oflag,
+        const rl_file_attr *attr, ...);
+rl_descriptor rl_open_named(const char *key, size_t space);
+rl_descriptor rl_open_named_attr(const char *key, size_t space,
+        const rl_file_attr *attr);
+rl_descriptor rl_open_private(size_t space, const rl_file_attr *attr);
 int rl_close(rl_descriptor lfd);
 int rl_fcntl(rl_descriptor lfd, int cmd, struct flock *lck);
+int rl_fcntl_timed(rl_descriptor lfd, struct flock *lck,
+        const struct timespec *deadline);
+int rl_lock_file(rl_descriptor lfd, int cmd, int mode);
+int rl_upgrade(rl_descriptor lfd, struct flock *lck);
+int rl_downgrade(rl_descriptor lfd, struct flock *lck);
+rl_owner rl_get_owner(rl_descriptor lfd);
+int rl_transfer(rl_descriptor lfd, struct flock *lck, rl_owner target);
+int rl_renew(rl_descriptor lfd);
+int rl_lock_usage(rl_descriptor lfd, rl_usage *usage, int max);
+int rl_fcntl_async(rl_descriptor lfd, struct flock *lck,
+        rl_async_request *async);
+int rl_async_result(rl_async_request *async);
+int rl_async_cancel(rl_async_request *async);
+ssize_t rl_pread_locked(rl_descriptor lfd, void *buf, size_t count,
+        off_t offset);
+ssize_t rl_pwrite_locked(rl_descriptor lfd, const void *buf, size_t count,
+        off_t offset);
+ssize_t rl_preadv_locked(rl_descriptor lfd, const struct iovec *iov,
+        int iovcnt, off_t offset);
+ssize_t rl_pwritev_locked(rl_descriptor lfd, const struct iovec *iov,
+        int iovcnt, off_t offset);
+int rl_set_policy(rl_descriptor lfd, int flags, int batch);
+int rl_flush(rl_descriptor lfd);
+int rl_append_reserve(rl_descriptor lfd, off_t len, rl_append *append);
+int rl_append_commit(rl_descriptor lfd, rl_append *append);
+int rl_append_wait(rl_descriptor lfd, off_t end,
+        const struct timespec *deadline);
+int rl_join_group(rl_descriptor lfd, const char *name);
+int rl_leave_group(rl_descriptor lfd);
 rl_descriptor rl_dup(rl_descriptor lfd);
 rl_descriptor rl_dup2(rl_descriptor lfd, int newd);
 pid_t rl_fork();
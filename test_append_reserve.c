@@ -0,0 +1,140 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * NB_CHILDREN child processes each append MAX records to a file, reserving
+ * the range of every record with rl_append_reserve() and committing it once
+ * written. The parent waits with rl_append_wait() until all the records are
+ * committed and checks that every record is whole, and that each child wrote
+ * MAX of them. Waiting for a prefix which is never reserved times out, and
+ * waiting with a negative end or an invalid deadline is refused.
+ *
+ * The file is created with RL_ATTR_APPENDS: a lock space created without it
+ * refuses reservations.
+ */
+
+#define FILENAME "/tmp/test-append-reserve.txt"
+#define NB_CHILDREN 4
+#define MAX 200
+#define RECORD 8
+
+static void append_records(int child) {
+    rl_descriptor lfd = rl_open(FILENAME, O_RDWR);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    char record[RECORD] = "child0\n";
+    record[5] = '0' + child;
+    for (int i = 0; i < MAX; i++) {
+        rl_append append;
+        if (rl_append_reserve(lfd, RECORD, &append) < 0)
+            PANIC_EXIT("rl_append_reserve()");
+        if (pwrite(lfd.fd, record, RECORD, append.offset) != RECORD)
+            PANIC_EXIT("pwrite()");
+        if (rl_append_commit(lfd, &append) < 0)
+            PANIC_EXIT("rl_append_commit()");
+    }
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+}
+
+int main() {
+    rl_init_library();
+
+    rl_append append;
+    rl_descriptor plain = rl_open_private(0, NULL);
+    if (plain.fd < 0 || plain.file == NULL)
+        PANIC_EXIT("rl_open_private()");
+    if (rl_append_reserve(plain, RECORD, &append) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_append_reserve()");
+    if (rl_close(plain) < 0)
+        PANIC_EXIT("rl_close()");
+
+    rl_file_attr attr = {.flags = RL_ATTR_APPENDS};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    for (int i = 0; i < NB_CHILDREN; i++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            PANIC_EXIT("fork()");
+        if (pid == 0) {
+            append_records(i);
+            return 0;
+        }
+    }
+
+    off_t end = NB_CHILDREN * MAX * RECORD;
+    struct timespec deadline;
+    if (clock_gettime(CLOCK_MONOTONIC, &deadline) < 0)
+        PANIC_EXIT("clock_gettime()");
+    deadline.tv_sec += 10;
+    if (rl_append_wait(lfd, end, &deadline) < 0)
+        PANIC_EXIT("rl_append_wait()");
+    printf("All the records up to %lld are committed\n", (long long) end);
+
+    int counts[NB_CHILDREN] = {0};
+    for (off_t offset = 0; offset < end; offset += RECORD) {
+        char record[RECORD];
+        if (pread(lfd.fd, record, RECORD, offset) != RECORD)
+            PANIC_EXIT("pread()");
+        int child = record[5] - '0';
+        if (record[0] != 'c' || record[6] != '\n' || child < 0
+                || child >= NB_CHILDREN)
+            PANIC_EXIT("record");
+        counts[child]++;
+    }
+    for (int i = 0; i < NB_CHILDREN; i++) {
+        printf("Child %d: %d records, expected: %d\n", i, counts[i], MAX);
+        if (counts[i] != MAX)
+            PANIC_EXIT("records");
+    }
+
+    for (int i = 0; i < NB_CHILDREN; i++) {
+        if (wait(NULL) < 0)
+            PANIC_EXIT("wait()");
+    }
+
+    if (clock_gettime(CLOCK_MONOTONIC, &deadline) < 0)
+        PANIC_EXIT("clock_gettime()");
+    deadline.tv_nsec += 100000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    if (rl_append_wait(lfd, end + RECORD, &deadline) == 0
+            || errno != ETIMEDOUT)
+        PANIC_EXIT("rl_append_wait()");
+    printf("Waiting for an unreserved record timed out\n");
+
+    struct timespec invalid = {.tv_sec = deadline.tv_sec,
+                               .tv_nsec = 1000000000};
+    if (rl_append_wait(lfd, -1, NULL) == 0 || errno != EINVAL
+            || rl_append_wait(lfd, end, &invalid) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_append_wait()");
+    invalid.tv_sec = -1;
+    invalid.tv_nsec = 0;
+    if (rl_append_wait(lfd, end, &invalid) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_append_wait()");
+    printf("Invalid ends and deadlines were refused\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
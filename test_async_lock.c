@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process write-locks the segments [0; 10[ and [50; 60[ of a file,
+ * then creates a child process which opens the file again. The child requests
+ * a write lock on [5; 15[ asynchronously: the request stays pending and its
+ * descriptor is not readable. The child asks the parent to unlock [0; 10[,
+ * which grants the request: the descriptor becomes readable and the child
+ * holds the lock. Then the child requests [50; 60[ asynchronously and cancels
+ * the request, which is still pending.
+ *
+ * The file is created with RL_ATTR_ASYNC: a lock space created without it
+ * refuses asynchronous requests.
+ */
+
+#define FILENAME "/tmp/test-async-lock.txt"
+
+static void set(struct flock *lck, short type, off_t start, off_t len) {
+    lck->l_type = type;
+    lck->l_whence = SEEK_SET;
+    lck->l_start = start;
+    lck->l_len = len;
+}
+
+int main() {
+    rl_init_library();
+
+    struct flock lck;
+    rl_async_request async;
+    rl_descriptor plain = rl_open_private(0, NULL);
+    if (plain.fd < 0 || plain.file == NULL)
+        PANIC_EXIT("rl_open_private()");
+    set(&lck, F_WRLCK, 0, 10);
+    if (rl_fcntl_async(plain, &lck, &async) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_fcntl_async()");
+    if (rl_close(plain) < 0)
+        PANIC_EXIT("rl_close()");
+
+    rl_file_attr attr = {.flags = RL_ATTR_ASYNC};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    set(&lck, F_WRLCK, 0, 10);
+    if (rl_fcntl(lfd, F_SETLK, &lck) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    set(&lck, F_WRLCK, 50, 10);
+    if (rl_fcntl(lfd, F_SETLK, &lck) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [0; 10[ and [50; 60[\n");
+    fflush(stdout);
+
+    int to_parent[2];
+    if (pipe(to_parent) < 0)
+        PANIC_EXIT("pipe()");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        rl_async_request async;
+        set(&lck, F_WRLCK, 5, 10);
+        if (rl_fcntl_async(lfd2, &lck, &async) != 1)
+            PANIC_EXIT("rl_fcntl_async()");
+        struct pollfd pfd = {.fd = async.fd, .events = POLLIN};
+        if (poll(&pfd, 1, 100) != 0)
+            PANIC_EXIT("poll()");
+        if (rl_async_result(&async) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_async_result()");
+        printf("CHILD: Request for [5; 15[ pending\n");
+        fflush(stdout);
+
+        char c = 0;
+        if (write(to_parent[1], &c, 1) != 1)
+            PANIC_EXIT("write()");
+
+        if (poll(&pfd, 1, 5000) != 1)
+            PANIC_EXIT("poll()");
+        if (rl_async_result(&async) < 0)
+            PANIC_EXIT("rl_async_result()");
+        printf("CHILD: Request for [5; 15[ granted\n");
+
+        set(&lck, F_WRLCK, 50, 10);
+        if (rl_fcntl_async(lfd2, &lck, &async) != 1)
+            PANIC_EXIT("rl_fcntl_async()");
+        if (rl_async_cancel(&async) != 0)
+            PANIC_EXIT("rl_async_cancel()");
+        printf("CHILD: Request for [50; 60[ cancelled\n");
+
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    char c = 0;
+    if (read(to_parent[0], &c, 1) != 1)
+        PANIC_EXIT("read()");
+
+    printf("PARENT: Unlocking [0; 10[\n");
+    fflush(stdout);
+    set(&lck, F_UNLCK, 0, 10);
+    if (rl_fcntl(lfd, F_SETLK, &lck) < 0)
+        PANIC_EXIT("rl_fcntl()");
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file seen as an array of 16 blocks of 4096 bytes. The parent
+ * process write-locks the blocks [0; 2[ and read-locks the block 3, then
+ * creates a child process which opens the file again. The child fails to
+ * write-lock the block 1 and the block 3, succeeds in read-locking the blocks
+ * [3; 5[ and fails to lock a region which does not end on a block boundary.
+ * Once the child has closed its descriptor, the parent converts its read lock
+ * on the block 3 into a write lock, which is possible as it is the only
+ * reader left.
+ */
+
+#define FILENAME "/tmp/test-block-locks.txt"
+#define BLOCK 4096
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.flags = RL_ATTR_BLOCKS, .block_size = BLOCK,
+                         .nb_blocks = 16};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    if (lock(lfd, F_WRLCK, 0, 2 * BLOCK) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd, F_RDLCK, 3 * BLOCK, BLOCK) < 0)
+        PANIC_EXIT("rl_fcntl()");
+
+    printf("Write-locked blocks [0; 2[ and read-locked block 3\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+    printf("\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        if (lock(lfd2, F_WRLCK, BLOCK, BLOCK) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Attempt to write-lock block 1 failed\n");
+
+        if (lock(lfd2, F_WRLCK, 3 * BLOCK, BLOCK) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Attempt to write-lock block 3 failed\n");
+
+        if (lock(lfd2, F_RDLCK, 3 * BLOCK, 2 * BLOCK) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Read-locked blocks [3; 5[\n");
+
+        if (lock(lfd2, F_RDLCK, 6 * BLOCK, 10) == 0 || errno != EINVAL)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Attempt to lock a partial block failed\n");
+
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+        printf("\n");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (lock(lfd, F_WRLCK, 3 * BLOCK, BLOCK) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Converted read lock on block 3 into a write lock\n");
+
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
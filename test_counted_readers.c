@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file with counted readers, then NB_READERS child processes, more
+ * than RL_MAX_OWNERS. Each child opens the file and read-locks the segment
+ * [0; 100[, then waits for the parent. The parent checks that it cannot
+ * write-lock the segment and prints the lock, which counts every reader. Once
+ * the children have closed their descriptors, the parent write-locks the
+ * segment.
+ */
+
+#define FILENAME "/tmp/test-counted-readers.txt"
+#define NB_READERS (RL_MAX_OWNERS + 8)
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.flags = RL_ATTR_COUNTED_READERS};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    int locked[2];
+    int done[2];
+    if (pipe(locked) < 0 || pipe(done) < 0)
+        PANIC_EXIT("pipe()");
+    fflush(stdout);
+
+    for (int i = 0; i < NB_READERS; i++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            PANIC_EXIT("fork()");
+        if (pid > 0)
+            continue;
+
+        close(done[1]);
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+        if (lock(lfd2, F_RDLCK, 0, 100) < 0)
+            PANIC_EXIT("rl_fcntl()");
+
+        char c = 0;
+        if (write(locked[1], &c, 1) != 1)
+            PANIC_EXIT("write()");
+        /* returns once the parent has closed the pipe */
+        if (read(done[0], &c, 1) != 0)
+            PANIC_EXIT("read()");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        exit(0);
+    }
+    close(done[0]);
+
+    for (int i = 0; i < NB_READERS; i++) {
+        char c;
+        if (read(locked[0], &c, 1) != 1)
+            PANIC_EXIT("read()");
+    }
+    printf("PARENT: %d children read-locked [0; 100[\n", NB_READERS);
+
+    if (lock(lfd, F_WRLCK, 0, 100) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Attempt to write-lock [0; 100[ failed\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+    printf("\n");
+
+    close(done[1]);
+    for (int i = 0; i < NB_READERS; i++) {
+        int status;
+        if (wait(&status) < 0)
+            PANIC_EXIT("wait()");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            PANIC_EXIT("child");
+    }
+
+    if (lock(lfd, F_WRLCK, 0, 100) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [0; 100[ after the children closed the file\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * NB_PROCS child processes race on the same file for NB_ROUNDS rounds. In each
+ * round, a child write-locks a byte of its own, which conflicts with nothing
+ * and is granted in a fast slot, then write-locks the record [0; 10[ and
+ * read-locks the overlapping record [5; 15[ with F_SETLKW. These conflict with
+ * the locks of the other children, so that fast locks are moved into the lock
+ * table and requests go through the mutex. Counters shared by the children
+ * check that a write lock is never held with another lock, and that no
+ * increment of the record is lost.
+ *
+ * The parent then write-locks [50; 60[ in a fast slot. A conflicting request on
+ * [55; 56[ through another descriptor moves it into the lock table and is
+ * refused. Once [50; 60[ is unlocked, the lock table and its summary are empty
+ * and the whole file can be write-locked.
+ */
+
+#define FILENAME "/tmp/test-fast-path.txt"
+#define NB_PROCS 4
+#define NB_ROUNDS 2000
+
+typedef struct {
+    atomic_int writers;
+    atomic_int readers;
+    long counter;
+} shared_state;
+
+static int lock(rl_descriptor lfd, int cmd, short type, off_t start,
+        off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, cmd, &lck);
+}
+
+static void race(shared_state *state, int c) {
+    rl_descriptor lfd = rl_open(FILENAME, O_RDWR);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    for (int i = 0; i < NB_ROUNDS; i++) {
+        if (lock(lfd, F_SETLK, F_WRLCK, 100 + c, 1) < 0
+                || lock(lfd, F_SETLK, F_UNLCK, 100 + c, 1) < 0)
+            PANIC_EXIT("rl_fcntl() on a disjoint range");
+
+        if (lock(lfd, F_SETLKW, F_WRLCK, 0, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        if (atomic_fetch_add(&state->writers, 1) != 0
+                || atomic_load(&state->readers) != 0)
+            PANIC_EXIT("write lock not exclusive");
+        long value = state->counter;
+        sched_yield();
+        state->counter = value + 1;
+        atomic_fetch_sub(&state->writers, 1);
+        if (lock(lfd, F_SETLK, F_UNLCK, 0, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+
+        if (lock(lfd, F_SETLKW, F_RDLCK, 5, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        atomic_fetch_add(&state->readers, 1);
+        if (atomic_load(&state->writers) != 0)
+            PANIC_EXIT("read lock held with a write lock");
+        sched_yield();
+        atomic_fetch_sub(&state->readers, 1);
+        if (lock(lfd, F_SETLK, F_UNLCK, 5, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open(FILENAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    shared_state *state = mmap(NULL, sizeof(shared_state),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (state == MAP_FAILED)
+        PANIC_EXIT("mmap()");
+
+    for (int c = 0; c < NB_PROCS; c++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            PANIC_EXIT("fork()");
+        if (pid == 0) {
+            race(state, c);
+            return 0;
+        }
+    }
+    for (int c = 0; c < NB_PROCS; c++) {
+        int status;
+        if (wait(&status) < 0)
+            PANIC_EXIT("wait()");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            PANIC_EXIT("child");
+    }
+    printf("Counter: %ld\n", state->counter);
+    if (state->counter != NB_PROCS * NB_ROUNDS)
+        PANIC_EXIT("counter");
+    if (lfd.file->nb_locks != 0 || lfd.file->summary_len != -1)
+        PANIC_EXIT("summary");
+
+    if (lock(lfd, F_SETLK, F_WRLCK, 50, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (lfd.file->nb_locks != 0)
+        PANIC_EXIT("fast slot");
+    printf("Write-locked [50; 60[ in a fast slot\n");
+
+    rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+    if (lfd2.fd < 0 || lfd2.file == NULL)
+        PANIC_EXIT("rl_open()");
+    if (lock(lfd2, F_SETLK, F_WRLCK, 55, 1) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    if (lfd.file->nb_locks != 1 || lfd.file->summary_start != 50
+            || lfd.file->summary_len != 10 || !lfd.file->summary_writer)
+        PANIC_EXIT("absorption");
+    printf("[55; 56[ refused, [50; 60[ moved into the lock table\n");
+
+    if (lock(lfd, F_SETLK, F_UNLCK, 50, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (lfd.file->nb_locks != 0 || lfd.file->summary_len != -1)
+        PANIC_EXIT("summary");
+    if (lock(lfd2, F_SETLK, F_WRLCK, 0, 0) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Unlocked [50; 60[, the whole file is free\n");
+
+    if (rl_close(lfd2) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file whose contended lock requests are applied by flat combining
+ * and stores an integer in it. NB_CHILDREN child processes each increment the
+ * integer MAX times, retrying to write-lock it until they get the lock. Once all of them have
+ * ended, the parent checks that the integer is equal to NB_CHILDREN * MAX.
+ *
+ * The parent then claims every queue node of the mutex of the file, so that
+ * its next request, an update lock which has no fast path, can't take the
+ * mutex: the request fails with ENOLCK and is withdrawn from its slot without
+ * being applied.
+ */
+
+#define FILENAME "/tmp/test-flat-combining.txt"
+#define NB_CHILDREN 8
+#define MAX 5000
+
+static int lock(rl_descriptor lfd, short type) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = 0;
+    lck.l_len = sizeof(int);
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+static void count_to_max() {
+    rl_descriptor lfd = rl_open(FILENAME, O_RDWR);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    for (int i = 0; i < MAX; i++) {
+        int code;
+        while ((code = lock(lfd, F_WRLCK)) < 0 && errno == EAGAIN)
+            ;
+        if (code < 0)
+            PANIC_EXIT("rl_fcntl()");
+
+        int n;
+        if (lseek(lfd.fd, 0, SEEK_SET) < 0)
+            PANIC_EXIT("lseek()");
+        if (read(lfd.fd, &n, sizeof(int)) != sizeof(int))
+            PANIC_EXIT("read()");
+        n++;
+        if (lseek(lfd.fd, 0, SEEK_SET) < 0)
+            PANIC_EXIT("lseek()");
+        if (write(lfd.fd, &n, sizeof(int)) != sizeof(int))
+            PANIC_EXIT("write()");
+
+        if (lock(lfd, F_UNLCK) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.flags = RL_ATTR_COMBINING};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    int count = 0;
+    if (write(lfd.fd, &count, sizeof(int)) != sizeof(int))
+        PANIC_EXIT("write()");
+
+    for (int i = 0; i < NB_CHILDREN; i++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            PANIC_EXIT("fork()");
+        if (pid == 0) {
+            count_to_max();
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < NB_CHILDREN; i++) {
+        if (wait(NULL) < 0)
+            PANIC_EXIT("wait()");
+    }
+
+    if (lseek(lfd.fd, 0, SEEK_SET) < 0)
+        PANIC_EXIT("lseek()");
+    if (read(lfd.fd, &count, sizeof(int)) != sizeof(int))
+        PANIC_EXIT("read()");
+    printf("Counter: %d, expected: %d\n", count, NB_CHILDREN * MAX);
+    if (count != NB_CHILDREN * MAX)
+        PANIC_EXIT("counter");
+
+    rl_mcs_node *nodes = (rl_mcs_node *) ((char *) lfd.file
+            + lfd.file->mcs_nodes_offset);
+    for (int n = 0; n < RL_MCS_NODES; n++)
+        atomic_store(&nodes[n].owner, getpid());
+    if (lock(lfd, RL_UPDLCK) == 0 || errno != ENOLCK)
+        PANIC_EXIT("rl_fcntl()");
+    for (int n = 0; n < RL_MCS_NODES; n++)
+        atomic_store(&nodes[n].owner, 0);
+    rl_request_slot *slots = (rl_request_slot *) ((char *) lfd.file
+            + lfd.file->requests_offset);
+    for (int r = 0; r < RL_REQUEST_SLOTS; r++) {
+        if (atomic_load(&slots[r].state) != 0)
+            PANIC_EXIT("request slot");
+    }
+    if (lfd.file->nb_locks != 0)
+        PANIC_EXIT("lock table");
+    printf("The request was withdrawn without the mutex\n");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
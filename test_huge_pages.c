@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process creates two files with RL_ATTR_HUGE_PAGES: both are put
+ * in slots of the arena of huge pages, and their shared memory objects are
+ * only markers. The parent write-locks [0; 10[ of the first file. A child
+ * process opens the file without attributes and finds it in the arena: it
+ * can't write-lock [5; 6[ but can read-lock [20; 30[. Once the parent has
+ * closed the files, the markers and the arena are removed, and the first file
+ * opened again gets a shared memory object of its own.
+ */
+
+#define FILENAME "/tmp/test-huge-pages.txt"
+#define FILENAME2 "/tmp/test-huge-pages-2.txt"
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+static off_t get_object_size(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1 && errno != ENOENT)
+        PANIC_EXIT("shm_open()");
+    if (fd == -1)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        PANIC_EXIT("fstat()");
+    close(fd);
+    return st.st_size;
+}
+
+static off_t get_shm_size(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0)
+        PANIC_EXIT("stat()");
+    char name[256];
+    sprintf(name, "/%s_%lu_%lu", SHM_PREFIX, st.st_dev, st.st_ino);
+    return get_object_size(name);
+}
+
+static int has_arena(void) {
+    return access(RL_HUGETLBFS_DIR SHM_ARENA_NAME, F_OK) == 0
+        || get_object_size(SHM_ARENA_NAME) != -1;
+}
+
+static int is_marker(const char *path) {
+    off_t size = get_shm_size(path);
+    return size != -1 && size < (off_t) sizeof(rl_open_file);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.flags = RL_ATTR_HUGE_PAGES};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+    rl_descriptor lfd2 = rl_open_attr(FILENAME2, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd2.fd < 0 || lfd2.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    long distance = (char *) lfd2.file - (char *) lfd.file;
+    if (!is_marker(FILENAME) || !is_marker(FILENAME2) || distance == 0
+            || distance % (long) lfd.file->size != 0)
+        PANIC_EXIT("arena");
+    printf("PARENT: Both files are in the arena, %ld bytes apart\n", distance);
+
+    if (lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [0; 10[\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd3 = rl_open(FILENAME, O_RDWR);
+        if (lfd3.fd < 0 || lfd3.file == NULL)
+            PANIC_EXIT("rl_open()");
+        if (lock(lfd3, F_WRLCK, 5, 1) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd3, F_RDLCK, 20, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: [5; 6[ refused, read-locked [20; 30[\n");
+        if (rl_print_open_file_safe(lfd3.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+        if (rl_close(lfd3) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (rl_close(lfd2) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+    if (get_shm_size(FILENAME) != -1 || get_shm_size(FILENAME2) != -1
+            || has_arena())
+        PANIC_EXIT("arena");
+    printf("PARENT: The markers and the arena were removed\n");
+    lfd = rl_open(FILENAME, O_RDWR);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+    if (get_shm_size(FILENAME) < (off_t) sizeof(rl_open_file))
+        PANIC_EXIT("arena");
+    printf("PARENT: The file got a shared memory object\n");
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0 || unlink(FILENAME2) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
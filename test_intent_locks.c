@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file with file-level modes. The parent process can't write-lock a
+ * range before holding a mode, then takes IX and write-locks [0; 10[. A child
+ * process opens the file again: S and X are refused, IS is granted and lets
+ * it read-lock [20; 30[ but not [5; 15[. Then the child releases IS and waits
+ * for X with F_SETLKW. The parent can't release IX while it holds [0; 10[, so
+ * it unlocks the range first, then releases IX, which grants X to the child.
+ */
+
+#define FILENAME "/tmp/test-intent-locks.txt"
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.flags = RL_ATTR_INTENTS};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) == 0 || errno != EPERM)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_lock_file(lfd, F_SETLK, RL_MODE_IX) < 0)
+        PANIC_EXIT("rl_lock_file()");
+    if (lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Took IX and write-locked [0; 10[\n");
+    fflush(stdout);
+
+    int to_parent[2];
+    if (pipe(to_parent) < 0)
+        PANIC_EXIT("pipe()");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        if (rl_lock_file(lfd2, F_SETLK, RL_MODE_S) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_lock_file()");
+        if (rl_lock_file(lfd2, F_SETLK, RL_MODE_X) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_lock_file()");
+        if (rl_lock_file(lfd2, F_SETLK, RL_MODE_IS) < 0)
+            PANIC_EXIT("rl_lock_file()");
+        if (lock(lfd2, F_RDLCK, 20, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd2, F_RDLCK, 5, 10) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: S and X refused, IS granted\n");
+        if (lock(lfd2, F_UNLCK, 20, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        if (rl_lock_file(lfd2, F_SETLK, RL_MODE_NONE) < 0)
+            PANIC_EXIT("rl_lock_file()");
+        printf("CHILD: Waiting for X\n");
+        fflush(stdout);
+
+        char c = 0;
+        if (write(to_parent[1], &c, 1) != 1)
+            PANIC_EXIT("write()");
+
+        if (rl_lock_file(lfd2, F_SETLKW, RL_MODE_X) < 0)
+            PANIC_EXIT("rl_lock_file()");
+        if (lock(lfd2, F_WRLCK, 0, 0) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Took X and write-locked the whole file\n");
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    char c = 0;
+    if (read(to_parent[0], &c, 1) != 1)
+        PANIC_EXIT("read()");
+
+    if (rl_lock_file(lfd, F_SETLK, RL_MODE_NONE) == 0 || errno != EBUSY)
+        PANIC_EXIT("rl_lock_file()");
+    if (lock(lfd, F_UNLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Releasing IX\n");
+    fflush(stdout);
+    if (rl_lock_file(lfd, F_SETLK, RL_MODE_NONE) < 0)
+        PANIC_EXIT("rl_lock_file()");
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
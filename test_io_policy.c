@@ -0,0 +1,78 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <errno.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Opens a file with an I/O policy which syncs the segments released by
+ * write-unlocks every two write-unlocks and reads ahead the segments of read
+ * locks. Three records are written under write locks, then read back under a
+ * read lock. The third write-unlock stays batched until rl_flush(). Invalid
+ * policies are refused with EINVAL.
+ */
+
+#define FILENAME "/tmp/test-io-policy.txt"
+#define RECORD 16
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open(FILENAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    if (rl_set_policy(lfd, 0x100, 1) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_set_policy()");
+    if (rl_set_policy(lfd, RL_POLICY_SYNC_RANGE, 0) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_set_policy()");
+    if (rl_set_policy(lfd, RL_POLICY_SYNC_RANGE | RL_POLICY_FDATASYNC
+                | RL_POLICY_WILLNEED, 2) < 0)
+        PANIC_EXIT("rl_set_policy()");
+    printf("Set a policy syncing every 2 write-unlocks\n");
+
+    char record[RECORD] = "record";
+    for (int i = 0; i < 3; i++) {
+        if (lock(lfd, F_WRLCK, i * RECORD, RECORD) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        record[6] = '0' + i;
+        if (pwrite(lfd.fd, record, RECORD, i * RECORD) != RECORD)
+            PANIC_EXIT("pwrite()");
+        if (lock(lfd, F_UNLCK, i * RECORD, RECORD) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+    printf("Wrote 3 records under write locks\n");
+
+    if (rl_flush(lfd) < 0)
+        PANIC_EXIT("rl_flush()");
+    printf("Flushed the batched write-unlock\n");
+
+    if (lock(lfd, F_RDLCK, 0, 3 * RECORD) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    char read_record[RECORD];
+    if (pread(lfd.fd, read_record, RECORD, 2 * RECORD) != RECORD
+            || read_record[6] != '2')
+        PANIC_EXIT("pread()");
+    printf("Read the last record back under a read lock\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <errno.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file whose owners may hold 4 locks of a type before they are
+ * coalesced. A second descriptor read-locks the byte 61, then the first one
+ * write-locks every other byte of [0; 80[. The write locks are coalesced into
+ * few locks, which still leave the byte 61 to the reader: the second
+ * descriptor can't write-lock the gaps of [0; 61[, but can read-lock [61; 62[
+ * again. A second file is created with RL_ATTR_ESCALATE_FILE: since nobody
+ * else locks it, the write locks are replaced by a lock on the whole file.
+ */
+
+#define FILENAME "/tmp/test-lock-escalation.txt"
+#define FILENAME2 "/tmp/test-lock-escalation-2.txt"
+#define NB_RECORDS 40
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.escalation = 4};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+    rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+    if (lfd2.fd < 0 || lfd2.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    if (lock(lfd2, F_RDLCK, 61, 1) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    for (int i = 0; i < NB_RECORDS; i++) {
+        if (lock(lfd, F_WRLCK, 2 * i, 1) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+    printf("Write-locked %d records, %d locks in the lock table\n",
+            NB_RECORDS, lfd.file->nb_locks);
+    if (lfd.file->nb_locks > 5)
+        PANIC_EXIT("escalation");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (lock(lfd2, F_WRLCK, 1, 1) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd2, F_RDLCK, 61, 1) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("The gaps are locked, the byte 61 is still readable\n");
+
+    if (rl_close(lfd2) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    attr.flags = RL_ATTR_ESCALATE_FILE;
+    lfd = rl_open_attr(FILENAME2, O_CREAT | O_RDWR | O_TRUNC, &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+    for (int i = 0; i < NB_RECORDS; i++) {
+        if (lock(lfd, F_WRLCK, 2 * i, 1) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+    if (lfd.file->nb_locks != 1 || lfd.file->lock_table[0].len != 0)
+        PANIC_EXIT("escalation");
+    printf("Write-locked the whole uncontended file\n");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0 || unlink(FILENAME2) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file whose locks expire LEASE_MS ms after the last request of
+ * their owner. The parent process write-locks [0; 10[ and renews its lease,
+ * then stops calling the library as if it was hung. A child process opens the
+ * file again: its write request on [5; 6[ is refused at once, but a request
+ * waiting for at most 5 s is granted once the lease of the parent expires.
+ * The next call of the parent fails with EKEYEXPIRED, the following ones
+ * succeed.
+ *
+ * The lease belongs to each owner of a lock: the parent read-locks [20; 30[
+ * and hangs again, while a second descriptor read-locks [20; 30[ too and keeps
+ * renewing its lease. A write request on [25; 26[ is refused as long as the
+ * second descriptor holds the lock, and granted at once after it unlocks it,
+ * the lease of the parent having expired.
+ *
+ * NB_RENEWERS other descriptors, more than the owners of a lock, each renew
+ * a lease without holding any lock.
+ *
+ * Leases of fast locks, `RL_ATTR_LEASES`, can't be combined with `lease_ns`.
+ */
+
+#define FILENAME "/tmp/test-lock-expiry.txt"
+#define FILENAME2 "/tmp/test-lock-expiry-2.txt"
+#define LEASE_MS 300
+#define RENEW_MS 50
+#define NB_RENEWERS (2 * RL_MAX_OWNERS + 100)
+
+static void set(struct flock *lck, short type, off_t start, off_t len) {
+    lck->l_type = type;
+    lck->l_whence = SEEK_SET;
+    lck->l_start = start;
+    lck->l_len = len;
+}
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    set(&lck, type, start, len);
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.lease_ns = LEASE_MS * 1000000LL};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_renew(lfd) < 0)
+        PANIC_EXIT("rl_renew()");
+    printf("PARENT: Write-locked [0; 10[\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        if (lock(lfd2, F_WRLCK, 5, 1) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: [5; 6[ refused while the lease is valid\n");
+
+        struct timespec deadline;
+        if (clock_gettime(CLOCK_MONOTONIC, &deadline) < 0)
+            PANIC_EXIT("clock_gettime()");
+        deadline.tv_sec += 5;
+        struct flock lck;
+        set(&lck, F_WRLCK, 5, 1);
+        if (rl_fcntl_timed(lfd2, &lck, &deadline) < 0)
+            PANIC_EXIT("rl_fcntl_timed()");
+        printf("CHILD: Revoked the expired lease, write-locked [5; 6[\n");
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) == 0 || errno != EKEYEXPIRED)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_renew(lfd) < 0 || lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Notified of the revocation, write-locked [0; 10[ again\n");
+
+    rl_descriptor lfd3 = rl_open(FILENAME, O_RDWR);
+    rl_descriptor lfd4 = rl_open(FILENAME, O_RDWR);
+    if (lfd3.fd < 0 || lfd3.file == NULL || lfd4.fd < 0 || lfd4.file == NULL)
+        PANIC_EXIT("rl_open()");
+    if (lock(lfd, F_RDLCK, 20, 10) < 0 || lock(lfd3, F_RDLCK, 20, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    for (int ms = 0; ms < 2 * LEASE_MS; ms += RENEW_MS) {
+        usleep(RENEW_MS * 1000);
+        if (rl_renew(lfd3) < 0)
+            PANIC_EXIT("rl_renew()");
+    }
+    if (lock(lfd4, F_WRLCK, 25, 1) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: [25; 26[ refused while a reader renews its lease\n");
+    if (lock(lfd3, F_UNLCK, 20, 10) < 0 || lock(lfd4, F_WRLCK, 25, 1) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd, F_RDLCK, 40, 10) == 0 || errno != EKEYEXPIRED)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: The hung reader was revoked on its own\n");
+
+    rl_descriptor renewers[NB_RENEWERS];
+    for (int i = 0; i < NB_RENEWERS; i++) {
+        renewers[i] = rl_open(FILENAME, O_RDWR);
+        if (renewers[i].fd < 0 || renewers[i].file == NULL)
+            PANIC_EXIT("rl_open()");
+        if (rl_renew(renewers[i]) < 0)
+            PANIC_EXIT("rl_renew()");
+    }
+    for (int i = 0; i < NB_RENEWERS; i++) {
+        if (rl_close(renewers[i]) < 0)
+            PANIC_EXIT("rl_close()");
+    }
+    printf("PARENT: %d descriptors without locks renewed a lease\n",
+            NB_RENEWERS);
+
+    if (rl_close(lfd4) < 0 || rl_close(lfd3) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    attr.flags = RL_ATTR_LEASES;
+    lfd = rl_open_attr(FILENAME2, O_CREAT | O_RDWR | O_TRUNC, &attr, 0644);
+    if (lfd.fd >= 0 || errno != EINVAL)
+        PANIC_EXIT("rl_open_attr()");
+    printf("RL_ATTR_LEASES with lease_ns refused\n");
+
+    if (unlink(FILENAME) < 0 || unlink(FILENAME2) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process joins the lock group "pool" of a file and write-locks
+ * [0; 10[, then creates a child process with rl_fork(), which is also a
+ * member of the group. The child write-locks [5; 15[ without conflicting with
+ * the parent, and unlocks [0; 5[ although the parent took that lock. A
+ * descriptor of the child that is not in the group can't write-lock [8; 9[.
+ * The child exits without leaving the group, so that when the parent leaves
+ * it, the group keeps [5; 15[ on behalf of its dead member. Since all its
+ * members are dead, the group is released when a new descriptor of the parent
+ * write-locks [5; 15[.
+ *
+ * The file is created with RL_ATTR_GROUPS: a lock space created without it
+ * has no lock groups.
+ */
+
+#define FILENAME "/tmp/test-lock-groups.txt"
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor plain = rl_open_private(0, NULL);
+    if (plain.fd < 0 || plain.file == NULL)
+        PANIC_EXIT("rl_open_private()");
+    if (rl_join_group(plain, "pool") == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_join_group()");
+    if (rl_close(plain) < 0)
+        PANIC_EXIT("rl_close()");
+
+    rl_file_attr attr = {.flags = RL_ATTR_GROUPS};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    if (rl_join_group(lfd, "a name longer than RL_GROUP_NAME_MAX") == 0
+            || errno != ENAMETOOLONG)
+        PANIC_EXIT("rl_join_group()");
+    if (rl_join_group(lfd, "pool") < 0)
+        PANIC_EXIT("rl_join_group()");
+    if (rl_join_group(lfd, "pool") == 0 || errno != EBUSY)
+        PANIC_EXIT("rl_join_group()");
+    if (lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Joined the group and write-locked [0; 10[\n");
+    fflush(stdout);
+
+    pid_t pid = rl_fork();
+    if (pid < 0)
+        PANIC_EXIT("rl_fork()");
+
+    if (pid == 0) {
+        if (lock(lfd, F_WRLCK, 5, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd, F_UNLCK, 0, 5) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Write-locked [5; 15[ and unlocked [0; 5[\n");
+
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+        if (lock(lfd2, F_WRLCK, 8, 1) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd2, F_WRLCK, 0, 5) < 0 || lock(lfd2, F_UNLCK, 0, 5) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Outside of the group, [8; 9[ is refused\n");
+        if (rl_print_open_file_safe(lfd.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    if (waitpid(pid, NULL, 0) < 0)
+        PANIC_EXIT("waitpid()");
+
+    if (rl_leave_group(lfd) < 0)
+        PANIC_EXIT("rl_leave_group()");
+    if (rl_leave_group(lfd) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_leave_group()");
+    if (lfd.file->nb_locks != 1)
+        PANIC_EXIT("group");
+    printf("PARENT: Left the group, which still holds [5; 15[\n");
+
+    rl_descriptor lfd3 = rl_open(FILENAME, O_RDWR);
+    if (lfd3.fd < 0 || lfd3.file == NULL)
+        PANIC_EXIT("rl_open()");
+    if (lock(lfd3, F_WRLCK, 5, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: The group of dead members was released\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd3) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file with lock leases. The parent process write-locks the segment
+ * [0; 10[ and unlocks it twice: each time the lock stays recorded as a lease of
+ * the parent, which locks it again without contention. Then a child process
+ * opens the file and write-locks the same segment, which revokes the lease of
+ * the parent. While the child holds its lock, the parent fails to lock the
+ * segment again. Once the child has closed its descriptor, the parent locks it.
+ */
+
+#define FILENAME "/tmp/test-lock-leases.txt"
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.flags = RL_ATTR_LEASES};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    for (int i = 0; i < 2; i++) {
+        if (lock(lfd, F_WRLCK, 0, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd, F_UNLCK, 0, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+    printf("PARENT: Locked and unlocked [0; 10[ twice\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+    printf("\n");
+    fflush(stdout);
+
+    int to_parent[2];
+    int to_child[2];
+    if (pipe(to_parent) < 0 || pipe(to_child) < 0)
+        PANIC_EXIT("pipe()");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        if (lock(lfd2, F_WRLCK, 0, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Write-locked [0; 10[, revoking the lease\n");
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+        printf("\n");
+        fflush(stdout);
+
+        char c = 0;
+        if (write(to_parent[1], &c, 1) != 1 || read(to_child[0], &c, 1) != 1)
+            PANIC_EXIT("pipe");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    char c = 0;
+    if (read(to_parent[0], &c, 1) != 1)
+        PANIC_EXIT("read()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Attempt to lock [0; 10[ again failed\n\n");
+    fflush(stdout);
+
+    if (write(to_child[1], &c, 1) != 1)
+        PANIC_EXIT("write()");
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [0; 10[ after the child closed its file\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
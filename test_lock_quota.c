@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <errno.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file whose owners may own at most QUOTA locks of the lock table.
+ * The first descriptor write-locks every other byte until its request fails
+ * with EDQUOT, after QUOTA locks. Extending one of its locks still works, but
+ * read-locking the middle of the extended lock would split it beyond the
+ * quota: the request fails with EDQUOT and leaves the table unchanged. The
+ * second descriptor read-locks [100; 120[, then splits it by unlocking
+ * [105; 110[, which needs new entries in the table. rl_lock_usage() reports
+ * the first descriptor as the owner that uses the most of the table.
+ *
+ * On a file created with RL_ATTR_COUNTED_READERS and a quota of 1 lock, a
+ * descriptor that holds a write lock can't read-lock another range, and is not
+ * left in the reader registry by the refused request.
+ */
+
+#define FILENAME "/tmp/test-lock-quota.txt"
+#define FILENAME2 "/tmp/test-lock-quota-2.txt"
+#define QUOTA 8
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.quota = QUOTA};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+    rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+    if (lfd2.fd < 0 || lfd2.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    int nb = 0;
+    while (lock(lfd, F_WRLCK, 2 * nb, 1) == 0)
+        nb++;
+    if (errno != EDQUOT || nb != QUOTA)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Write-locked %d records before EDQUOT\n", nb);
+    if (lock(lfd, F_WRLCK, 1, 1) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Merged two records within the quota\n");
+    int nb_locks = lfd.file->nb_locks;
+    if (lock(lfd, F_RDLCK, 1, 1) == 0 || errno != EDQUOT
+            || lfd.file->nb_locks != nb_locks)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Refused to split a lock beyond the quota\n");
+
+    if (lock(lfd2, F_RDLCK, 100, 20) < 0 || lock(lfd2, F_UNLCK, 105, 5) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Split a lock of another owner\n");
+
+    rl_usage usage[2];
+    if (rl_lock_usage(lfd, usage, 2) != 2)
+        PANIC_EXIT("rl_lock_usage()");
+    for (int i = 0; i < 2; i++)
+        printf("Owner fd = %d: %d locks\n", usage[i].owner.fd,
+                usage[i].nb_locks);
+    if (usage[0].owner.fd != lfd.fd || usage[0].nb_locks != QUOTA - 1
+            || usage[1].owner.fd != lfd2.fd || usage[1].nb_locks != 2)
+        PANIC_EXIT("rl_lock_usage()");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd2) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    rl_file_attr counted = {.flags = RL_ATTR_COUNTED_READERS, .quota = 1};
+    rl_descriptor lfd3 = rl_open_attr(FILENAME2, O_CREAT | O_RDWR | O_TRUNC,
+            &counted, 0644);
+    if (lfd3.fd < 0 || lfd3.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+    if (lock(lfd3, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd3, F_RDLCK, 20, 10) == 0 || errno != EDQUOT)
+        PANIC_EXIT("rl_fcntl()");
+    rl_owner owner = rl_get_owner(lfd3);
+    rl_owner *readers = (rl_owner *) ((char *) lfd3.file
+            + lfd3.file->readers_offset);
+    for (int r = 0; r < RL_MAX_READERS; r++) {
+        if (readers[r].pid == owner.pid && readers[r].fd == owner.fd)
+            PANIC_EXIT("reader left in the registry");
+    }
+    printf("The refused read lock left no reader behind\n");
+    if (rl_close(lfd3) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0 || unlink(FILENAME2) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
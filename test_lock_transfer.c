@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process write-locks [0; 10[ and [10; 20[ of a file, then creates
+ * a child process which opens the file again and sends the owner of its
+ * descriptor to the parent through a pipe. The parent can't hand over [5; 10[
+ * which does not contain its lock entirely, then hands over [0; 10[ to the
+ * child. The parent can't write-lock [0; 10[ anymore but keeps [10; 20[. The
+ * child holds the lock without having requested it and releases it. Handing
+ * over a lock to the dead child fails with ESRCH.
+ *
+ * On a second file created with RL_ATTR_INTENTS and a quota of 1 lock, the
+ * parent write-locks [0; 10[ in mode IX. Handing it over fails with EPERM to a
+ * descriptor in mode IS, and with EDQUOT to a descriptor in mode IX which
+ * holds a lock already, until that one releases it.
+ */
+
+#define FILENAME "/tmp/test-lock-transfer.txt"
+#define FILENAME2 "/tmp/test-lock-transfer-2.txt"
+
+static void set(struct flock *lck, short type, off_t start, off_t len) {
+    lck->l_type = type;
+    lck->l_whence = SEEK_SET;
+    lck->l_start = start;
+    lck->l_len = len;
+}
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    set(&lck, type, start, len);
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open(FILENAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) < 0 || lock(lfd, F_WRLCK, 10, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [0; 10[ and [10; 20[\n");
+    fflush(stdout);
+
+    int to_parent[2], to_child[2];
+    if (pipe(to_parent) < 0 || pipe(to_child) < 0)
+        PANIC_EXIT("pipe()");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        rl_owner owner = rl_get_owner(lfd2);
+        if (write(to_parent[1], &owner, sizeof(owner)) != sizeof(owner))
+            PANIC_EXIT("write()");
+        char c = 0;
+        if (read(to_child[0], &c, 1) != 1)
+            PANIC_EXIT("read()");
+
+        printf("CHILD: Received [0; 10[\n");
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+        if (lock(lfd2, F_WRLCK, 10, 1) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd2, F_UNLCK, 0, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    rl_owner target;
+    if (read(to_parent[0], &target, sizeof(target)) != sizeof(target))
+        PANIC_EXIT("read()");
+
+    struct flock lck;
+    set(&lck, F_WRLCK, 5, 5);
+    if (rl_transfer(lfd, &lck, target) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_transfer()");
+    set(&lck, F_WRLCK, 0, 10);
+    if (rl_transfer(lfd, &lck, target) < 0)
+        PANIC_EXIT("rl_transfer()");
+    if (lock(lfd, F_WRLCK, 0, 10) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd, F_WRLCK, 10, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Handed over [0; 10[, kept [10; 20[\n");
+    fflush(stdout);
+
+    char c = 0;
+    if (write(to_child[1], &c, 1) != 1)
+        PANIC_EXIT("write()");
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_transfer(lfd, &lck, target) == 0 || errno != ESRCH)
+        PANIC_EXIT("rl_transfer()");
+    printf("PARENT: Can't hand over [0; 10[ to the dead child\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    rl_file_attr attr = {.flags = RL_ATTR_INTENTS, .quota = 1};
+    rl_descriptor from = rl_open_attr(FILENAME2, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    rl_descriptor reader = rl_open(FILENAME2, O_RDWR);
+    rl_descriptor writer = rl_open(FILENAME2, O_RDWR);
+    if (from.fd < 0 || from.file == NULL || reader.fd < 0
+            || reader.file == NULL || writer.fd < 0 || writer.file == NULL)
+        PANIC_EXIT("rl_open()");
+    if (rl_lock_file(from, F_SETLK, RL_MODE_IX) < 0
+            || rl_lock_file(reader, F_SETLK, RL_MODE_IS) < 0
+            || rl_lock_file(writer, F_SETLK, RL_MODE_IX) < 0)
+        PANIC_EXIT("rl_lock_file()");
+    if (lock(from, F_WRLCK, 0, 10) < 0 || lock(writer, F_WRLCK, 20, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_transfer(from, &lck, rl_get_owner(reader)) == 0 || errno != EPERM)
+        PANIC_EXIT("rl_transfer()");
+    if (rl_transfer(from, &lck, rl_get_owner(writer)) == 0 || errno != EDQUOT)
+        PANIC_EXIT("rl_transfer()");
+    printf("PARENT: Can't hand over [0; 10[ beyond the mode or the quota\n");
+    if (lock(writer, F_UNLCK, 20, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_transfer(from, &lck, rl_get_owner(writer)) < 0)
+        PANIC_EXIT("rl_transfer()");
+    if (lock(from, F_WRLCK, 0, 10) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Handed over [0; 10[ once the quota allowed it\n");
+    if (rl_close(writer) < 0 || rl_close(reader) < 0 || rl_close(from) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0 || unlink(FILENAME2) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
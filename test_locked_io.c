@@ -0,0 +1,153 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process writes "hello" at the offset 10 of a file with
+ * rl_pwrite_locked() and "world" at the offset 20 with rl_pwritev_locked(),
+ * from two buffers. Then it write-locks [30; 40[ and creates a child process
+ * which opens the file again, reads both words back with rl_pread_locked() and
+ * rl_preadv_locked(), and writes "child" at the offset 30, which waits for
+ * the parent to write a mark at the offset 100 and unlock [30; 40[. Once the
+ * child has ended, no lock is left on the file.
+ *
+ * The locks held before a locked I/O are kept: the parent writes and reads
+ * [200; 205[ inside a write lock on [200; 210[, which still refuses a read
+ * lock of another descriptor on [205; 206[. It then writes [300; 310[ while it
+ * holds a read lock on [300; 305[: afterwards, the other descriptor can
+ * read-lock [302; 303[ but not write-lock it, and can write-lock [305; 310[.
+ */
+
+#define FILENAME "/tmp/test-locked-io.txt"
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck = {.l_type = type, .l_whence = SEEK_SET,
+                        .l_start = start, .l_len = len};
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open(FILENAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    if (rl_pwrite_locked(lfd, "hello", 5, 10) != 5)
+        PANIC_EXIT("rl_pwrite_locked()");
+    struct iovec wiov[2] = {{.iov_base = "wo", .iov_len = 2},
+                            {.iov_base = "rld", .iov_len = 3}};
+    if (rl_pwritev_locked(lfd, wiov, 2, 20) != 5)
+        PANIC_EXIT("rl_pwritev_locked()");
+    printf("PARENT: Wrote \"hello\" and \"world\"\n");
+
+    struct flock lck = {.l_type = F_WRLCK, .l_whence = SEEK_SET, .l_start = 30,
+                        .l_len = 10};
+    if (rl_fcntl(lfd, F_SETLK, &lck) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [30; 40[\n");
+    fflush(stdout);
+
+    int to_parent[2];
+    if (pipe(to_parent) < 0)
+        PANIC_EXIT("pipe()");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        char word[6] = {0};
+        if (rl_pread_locked(lfd2, word, 5, 10) != 5 || strcmp(word, "hello"))
+            PANIC_EXIT("rl_pread_locked()");
+        char first[4] = {0};
+        char second[3] = {0};
+        struct iovec riov[2] = {{.iov_base = first, .iov_len = 3},
+                                {.iov_base = second, .iov_len = 2}};
+        if (rl_preadv_locked(lfd2, riov, 2, 20) != 5 || strcmp(first, "wor")
+                || strncmp(second, "ld", 2))
+            PANIC_EXIT("rl_preadv_locked()");
+        printf("CHILD: Read \"%s\" and \"%s%.2s\"\n", word, first, second);
+        fflush(stdout);
+
+        char c = 0;
+        if (write(to_parent[1], &c, 1) != 1)
+            PANIC_EXIT("write()");
+
+        if (rl_pwrite_locked(lfd2, "child", 5, 30) != 5)
+            PANIC_EXIT("rl_pwrite_locked()");
+        if (pread(lfd2.fd, &c, 1, 100) != 1 || c != 'u')
+            PANIC_EXIT("pread()");
+        printf("CHILD: Wrote \"child\" after the parent released [30; 40[\n");
+        fflush(stdout);
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    char c = 0;
+    if (read(to_parent[0], &c, 1) != 1)
+        PANIC_EXIT("read()");
+
+    if (pwrite(lfd.fd, "u", 1, 100) != 1)
+        PANIC_EXIT("pwrite()");
+    printf("PARENT: Unlocking [30; 40[\n");
+    fflush(stdout);
+    lck.l_type = F_UNLCK;
+    if (rl_fcntl(lfd, F_SETLK, &lck) < 0)
+        PANIC_EXIT("rl_fcntl()");
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    char word[6] = {0};
+    if (rl_pread_locked(lfd, word, 5, 30) != 5 || strcmp(word, "child"))
+        PANIC_EXIT("rl_pread_locked()");
+    printf("PARENT: Read \"%s\"\n", word);
+
+    rl_descriptor lfd3 = rl_open(FILENAME, O_RDWR);
+    if (lfd3.fd < 0 || lfd3.file == NULL)
+        PANIC_EXIT("rl_open()");
+    if (lock(lfd, F_WRLCK, 200, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_pwrite_locked(lfd, "inner", 5, 200) != 5
+            || rl_pread_locked(lfd, word, 5, 200) != 5 || strcmp(word, "inner"))
+        PANIC_EXIT("locked I/O");
+    if (lock(lfd3, F_RDLCK, 205, 1) == 0 || errno != EAGAIN)
+        PANIC_EXIT("write lock not kept");
+    printf("PARENT: The write lock on [200; 210[ was kept\n");
+
+    if (lock(lfd, F_RDLCK, 300, 5) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (rl_pwrite_locked(lfd, "0123456789", 10, 300) != 10)
+        PANIC_EXIT("rl_pwrite_locked()");
+    if (lock(lfd3, F_WRLCK, 302, 1) == 0 || errno != EAGAIN
+            || lock(lfd3, F_RDLCK, 302, 1) < 0
+            || lock(lfd3, F_WRLCK, 305, 5) < 0)
+        PANIC_EXIT("read lock not restored");
+    printf("PARENT: The read lock on [300; 305[ was restored\n");
+    if (rl_close(lfd3) < 0)
+        PANIC_EXIT("rl_close()");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The file is created with a quota, so that every request goes through the
+ * exclusive lock of the file, an MCS queue lock.
+ *
+ * A child process puts itself at the head of the queue as if it held the lock,
+ * and waits. NB_WAITERS children then request write locks on [w; w + 1[ one
+ * after the other, each one once the previous one is queued. The waiter 2 is
+ * killed while queued, then the holder is killed. The successor of the dead
+ * holder takes the lock over, and so does the successor of the dead waiter
+ * once the lock is handed over to it: the lock table holds the locks of the
+ * waiters 1, 3 and 4 in this order, and every queue node is free again.
+ *
+ * A holder is put at the head of the queue again, and a child process takes
+ * the tail after it but dies before linking its node to the one of the holder.
+ * Once the holder is killed too, the main process requests a write lock: it
+ * queues behind the dead waiter, which was never granted the lock, and takes
+ * the lock over from the dead holder before it.
+ *
+ * NB_PROCS children then increment a shared counter NB_ROUNDS times each,
+ * under a write lock on [0; 1[ taken with F_SETLK. A counter of holders checks
+ * that the lock is never held twice, and no increment is lost.
+ */
+
+#define FILENAME "/tmp/test-mcs-queue.txt"
+#define NB_WAITERS 4
+#define DEAD_WAITER 2
+#define NB_PROCS 4
+#define NB_ROUNDS 2000
+
+typedef struct {
+    atomic_int holders;
+    long counter;
+} shared_state;
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+static void notify(int fd) {
+    if (write(fd, "x", 1) != 1)
+        PANIC_EXIT("write()");
+}
+
+static void await(int fd) {
+    char c;
+    if (read(fd, &c, 1) != 1)
+        PANIC_EXIT("read()");
+}
+
+static rl_mcs_node *get_nodes(rl_descriptor lfd) {
+    return (rl_mcs_node *) ((char *) lfd.file + lfd.file->mcs_nodes_offset);
+}
+
+static void hold_queue(rl_descriptor lfd, int ready) {
+    rl_mcs_node *node = &get_nodes(lfd)[RL_MCS_NODES - 1];
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&node->owner, &expected, getpid()))
+        PANIC_EXIT("node");
+    atomic_store(&node->next, 0);
+    atomic_store(&node->wait, 0); /* granted */
+    expected = 0;
+    if (!atomic_compare_exchange_strong(&lfd.file->mcs_tail, &expected,
+                RL_MCS_NODES))
+        PANIC_EXIT("queue");
+    notify(ready);
+    for (;;)
+        pause();
+}
+
+static void queue_unlinked(rl_descriptor lfd, int ready) {
+    rl_mcs_node *node = &get_nodes(lfd)[RL_MCS_NODES - 2];
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&node->owner, &expected, getpid()))
+        PANIC_EXIT("node");
+    atomic_store(&node->next, 0);
+    atomic_store(&node->prev, RL_MCS_NODES);
+    atomic_store(&node->wait, 1); /* spinning */
+    expected = RL_MCS_NODES;
+    if (!atomic_compare_exchange_strong(&lfd.file->mcs_tail, &expected,
+                RL_MCS_NODES - 1))
+        PANIC_EXIT("queue");
+    /* dies before setting the next node of the holder */
+    notify(ready);
+    for (;;)
+        pause();
+}
+
+static void wait_in_queue(int w, int ready, int go, int done) {
+    rl_descriptor lfd = rl_open(FILENAME, O_RDWR);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+    notify(ready);
+    await(go);
+    if (lock(lfd, F_WRLCK, w, 1) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    notify(done);
+    await(go);
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+}
+
+static void increment(shared_state *state) {
+    rl_descriptor lfd = rl_open(FILENAME, O_RDWR);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+    for (int i = 0; i < NB_ROUNDS; i++) {
+        while (lock(lfd, F_WRLCK, 0, 1) < 0) {
+            if (errno != EAGAIN)
+                PANIC_EXIT("rl_fcntl()");
+            sched_yield();
+        }
+        if (atomic_fetch_add(&state->holders, 1) != 0)
+            PANIC_EXIT("lock held twice");
+        long value = state->counter;
+        sched_yield();
+        state->counter = value + 1;
+        atomic_fetch_sub(&state->holders, 1);
+        if (lock(lfd, F_UNLCK, 0, 1) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+}
+
+static void kill_child(pid_t pid) {
+    if (kill(pid, SIGKILL) < 0 || waitpid(pid, NULL, 0) < 0)
+        PANIC_EXIT("kill()");
+}
+
+static void wait_children(int nb) {
+    for (int i = 0; i < nb; i++) {
+        int status;
+        if (wait(&status) < 0)
+            PANIC_EXIT("wait()");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            PANIC_EXIT("child");
+    }
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.quota = RL_MAX_LOCKS};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    int ready[2], done[2], go[NB_WAITERS + 1][2];
+    if (pipe(ready) < 0 || pipe(done) < 0)
+        PANIC_EXIT("pipe()");
+    pid_t waiters[NB_WAITERS + 1];
+    for (int w = 1; w <= NB_WAITERS; w++) {
+        if (pipe(go[w]) < 0)
+            PANIC_EXIT("pipe()");
+        waiters[w] = fork();
+        if (waiters[w] < 0)
+            PANIC_EXIT("fork()");
+        if (waiters[w] == 0) {
+            wait_in_queue(w, ready[1], go[w][0], done[1]);
+            return 0;
+        }
+        await(ready[0]);
+    }
+
+    pid_t holder = fork();
+    if (holder < 0)
+        PANIC_EXIT("fork()");
+    if (holder == 0)
+        hold_queue(lfd, ready[1]);
+    await(ready[0]);
+    printf("The holder is at the head of the queue\n");
+
+    for (int w = 1; w <= NB_WAITERS; w++) {
+        int tail = atomic_load(&lfd.file->mcs_tail);
+        notify(go[w][1]);
+        while (atomic_load(&lfd.file->mcs_tail) == tail)
+            sched_yield();
+    }
+    printf("%d waiters queued\n", NB_WAITERS);
+
+    kill_child(waiters[DEAD_WAITER]);
+    kill_child(holder);
+    printf("Killed the waiter %d and the holder\n", DEAD_WAITER);
+    for (int w = 1; w < NB_WAITERS; w++)
+        await(done[0]);
+
+    if (lfd.file->nb_locks != NB_WAITERS - 1)
+        PANIC_EXIT("lock table");
+    for (int w = 1, i = 0; w <= NB_WAITERS; w++) {
+        if (w == DEAD_WAITER)
+            continue;
+        if (lfd.file->lock_table[i++].start != w)
+            PANIC_EXIT("FIFO order");
+    }
+    if (atomic_load(&lfd.file->mcs_tail) != 0)
+        PANIC_EXIT("queue");
+    for (int n = 0; n < RL_MCS_NODES; n++) {
+        if (atomic_load(&get_nodes(lfd)[n].owner) != 0)
+            PANIC_EXIT("node leaked");
+    }
+    printf("The lock was handed over in FIFO order, all the nodes are free\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    for (int w = 1; w <= NB_WAITERS; w++) {
+        if (w != DEAD_WAITER)
+            notify(go[w][1]);
+    }
+    wait_children(NB_WAITERS - 1);
+    fflush(stdout);
+
+    holder = fork();
+    if (holder < 0)
+        PANIC_EXIT("fork()");
+    if (holder == 0)
+        hold_queue(lfd, ready[1]);
+    await(ready[0]);
+    pid_t unlinked = fork();
+    if (unlinked < 0)
+        PANIC_EXIT("fork()");
+    if (unlinked == 0)
+        queue_unlinked(lfd, ready[1]);
+    await(ready[0]);
+    kill_child(unlinked);
+    kill_child(holder);
+    printf("Killed a holder and a waiter not linked to it\n");
+    if (lock(lfd, F_WRLCK, 0, 1) < 0 || lock(lfd, F_UNLCK, 0, 1) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (atomic_load(&lfd.file->mcs_tail) != 0)
+        PANIC_EXIT("queue");
+    for (int n = 0; n < RL_MCS_NODES; n++) {
+        if (atomic_load(&get_nodes(lfd)[n].owner) != 0)
+            PANIC_EXIT("node leaked");
+    }
+    printf("The lock was taken over past the unlinked waiter\n");
+    fflush(stdout);
+
+    shared_state *state = mmap(NULL, sizeof(shared_state),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (state == MAP_FAILED)
+        PANIC_EXIT("mmap()");
+    for (int c = 0; c < NB_PROCS; c++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            PANIC_EXIT("fork()");
+        if (pid == 0) {
+            increment(state);
+            return 0;
+        }
+    }
+    wait_children(NB_PROCS);
+    printf("Counter: %ld\n", state->counter);
+    if (state->counter != NB_PROCS * NB_ROUNDS)
+        PANIC_EXIT("counter");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process opens the named lock space "test-named-space" of SPACE
+ * keys, which has no backing file, and write-locks the keys [10; 20[. A child
+ * process opens the space again: it can't write-lock the key 15, but can
+ * read-lock [0; 10[ and the last 10 keys relative to the end of the space.
+ * Locks beyond the space, relative to a current offset, and I/O are refused.
+ * Once both descriptors are closed, the shared memory object of the space is
+ * removed.
+ */
+
+#define KEY "test-named-space"
+#define SPACE 1000
+
+static int lock(rl_descriptor lfd, short type, short whence, off_t start,
+        off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = whence;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    if (rl_open_named("a/b", SPACE).fd != -1 || errno != EINVAL)
+        PANIC_EXIT("rl_open_named()");
+    rl_descriptor lfd = rl_open_named(KEY, SPACE);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_named()");
+
+    if (lock(lfd, F_WRLCK, SEEK_SET, 10, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked the keys [10; 20[\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open_named(KEY, 0);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open_named()");
+
+        if (lock(lfd2, F_WRLCK, SEEK_SET, 15, 1) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd2, F_RDLCK, SEEK_SET, 0, 10) < 0
+                || lock(lfd2, F_RDLCK, SEEK_END, -10, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Key 15 refused, read-locked [0; 10[ and the last keys\n");
+
+        if (lock(lfd2, F_RDLCK, SEEK_SET, SPACE - 5, 10) == 0
+                || lock(lfd2, F_RDLCK, SEEK_CUR, 0, 1) == 0)
+            PANIC_EXIT("rl_fcntl()");
+        char c = 0;
+        if (rl_pwrite_locked(lfd2, &c, 1, 0) != -1 || errno != EINVAL)
+            PANIC_EXIT("rl_pwrite_locked()");
+        printf("CHILD: Locks out of the space and I/O refused\n");
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+    if (shm_open("/" SHM_NAMED_PREFIX "_" KEY, O_RDWR, 0) != -1
+            || errno != ENOENT)
+        PANIC_EXIT("shm_open()");
+    printf("PARENT: The space was removed\n");
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Opens the named lock space "test-owner-overflow" and read-locks [0; 10[:
+ * the shared memory object of the space takes at most two pages, and the
+ * space draws from no pool of overflow chunks yet. RL_MAX_OWNERS - 1
+ * duplicates of the descriptor then read-lock [0; 10[ too, so that the owners
+ * of the lock overflow into a chunk of the shared pool, and a write request on
+ * [5; 6[ is refused. Once the duplicates are closed, the chunk is given back
+ * to the pool. Once the space is closed, it no longer draws from the pool,
+ * which is removed if no other file does.
+ */
+
+#define KEY "test-owner-overflow"
+#define NB_DUPS (RL_MAX_OWNERS - 1)
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+static rl_chunk_pool *map_pool(void) {
+    int fd = shm_open(SHM_POOL_NAME, O_RDONLY, 0);
+    if (fd == -1)
+        PANIC_EXIT("shm_open()");
+    rl_chunk_pool *pool = mmap(NULL, sizeof(rl_chunk_pool), PROT_READ,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (pool == MAP_FAILED)
+        PANIC_EXIT("mmap()");
+    return pool;
+}
+
+static off_t get_allocated(void) {
+    int fd = shm_open("/" SHM_NAMED_PREFIX "_" KEY, O_RDONLY, 0);
+    if (fd == -1)
+        PANIC_EXIT("shm_open()");
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        PANIC_EXIT("fstat()");
+    close(fd);
+    return st.st_blocks * 512;
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open_named(KEY, 0);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_named()");
+    if (lock(lfd, F_RDLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Allocated %ld of %zu bytes\n", (long) get_allocated(),
+            lfd.file->size);
+    if (lfd.file->size > 2 * (size_t) sysconf(_SC_PAGESIZE)
+            || lfd.file->pool_id != 0)
+        PANIC_EXIT("pool");
+
+    rl_descriptor dups[NB_DUPS];
+    for (int i = 0; i < NB_DUPS; i++) {
+        dups[i] = rl_dup(lfd);
+        if (dups[i].fd < 0 || dups[i].file == NULL)
+            PANIC_EXIT("rl_dup()");
+        if (lock(dups[i], F_RDLCK, 0, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+    rl_chunk_pool *pool = map_pool();
+    int chunk = lfd.file->lock_table[0].overflow - 1;
+    if (lfd.file->nb_locks != 1 || lfd.file->lock_table[0].nb_owners
+            != RL_MAX_OWNERS || chunk < 0 || pool->id != lfd.file->pool_id
+            || !(pool->chunk_map[chunk / 64] & (1ULL << (chunk % 64))))
+        PANIC_EXIT("pool");
+    int nb_files = pool->nb_files;
+    printf("Read-locked [0; 10[ with %d owners, chunk %d of the pool\n",
+            RL_MAX_OWNERS, chunk);
+
+    rl_descriptor lfd2 = rl_open_named(KEY, 0);
+    if (lfd2.fd < 0 || lfd2.file == NULL)
+        PANIC_EXIT("rl_open_named()");
+    if (lock(lfd2, F_WRLCK, 5, 1) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Write request on [5; 6[ refused\n");
+
+    for (int i = 0; i < NB_DUPS; i++) {
+        if (rl_close(dups[i]) < 0)
+            PANIC_EXIT("rl_close()");
+    }
+    if (lfd.file->lock_table[0].nb_owners != 1
+            || lfd.file->lock_table[0].overflow != 0
+            || pool->chunk_map[chunk / 64] & (1ULL << (chunk % 64)))
+        PANIC_EXIT("pool");
+    printf("The chunk was given back to the pool\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd2) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+    if (pool->nb_files != nb_files - 1 || (nb_files == 1 && !pool->unlinked))
+        PANIC_EXIT("pool");
+    printf("The space no longer draws from the pool\n");
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Opens a private lock space of SPACE keys, which lives in the memory of the
+ * process. Two duplicates of its descriptor conflict like two descriptors of
+ * a file: a write lock on [10; 20[ refuses a read lock on the key 15, while
+ * the last 10 keys can be read-locked relative to the end of the space.
+ * NB_THREADS threads then increment a counter NB_INCREMENTS times each, every
+ * increment under a write lock on the key 0 taken with F_SETLKW through the
+ * own duplicate of the thread. No increment is lost. The space is freed when
+ * its last descriptor is closed.
+ */
+
+#define SPACE 1000
+#define NB_THREADS 4
+#define NB_INCREMENTS 2000
+
+static long counter = 0;
+
+static void set(struct flock *lck, short type, short whence, off_t start,
+        off_t len) {
+    lck->l_type = type;
+    lck->l_whence = whence;
+    lck->l_start = start;
+    lck->l_len = len;
+}
+
+static int lock(rl_descriptor lfd, short type, short whence, off_t start,
+        off_t len) {
+    struct flock lck;
+    set(&lck, type, whence, start, len);
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+static void *increment(void *arg) {
+    rl_descriptor *lfd = arg;
+    struct flock lck;
+    for (int i = 0; i < NB_INCREMENTS; i++) {
+        set(&lck, F_WRLCK, SEEK_SET, 0, 1);
+        if (rl_fcntl(*lfd, F_SETLKW, &lck) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        long value = counter;
+        sched_yield();
+        counter = value + 1;
+        set(&lck, F_UNLCK, SEEK_SET, 0, 1);
+        if (rl_fcntl(*lfd, F_SETLK, &lck) < 0)
+            PANIC_EXIT("rl_fcntl()");
+    }
+    return NULL;
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open_private(SPACE, NULL);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_private()");
+    rl_descriptor lfd2 = rl_dup(lfd);
+    if (lfd2.fd < 0 || lfd2.file == NULL)
+        PANIC_EXIT("rl_dup()");
+
+    if (lock(lfd, F_WRLCK, SEEK_SET, 10, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd2, F_RDLCK, SEEK_SET, 15, 1) == 0 || errno != EAGAIN)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd2, F_RDLCK, SEEK_END, -10, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    if (lock(lfd2, F_RDLCK, SEEK_SET, SPACE - 5, 10) == 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("Key 15 refused, read-locked the last keys\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+    if (lock(lfd, F_UNLCK, SEEK_SET, 0, 0) < 0
+            || lock(lfd2, F_UNLCK, SEEK_SET, 0, 0) < 0)
+        PANIC_EXIT("rl_fcntl()");
+
+    pthread_t threads[NB_THREADS];
+    rl_descriptor lfds[NB_THREADS];
+    for (int t = 0; t < NB_THREADS; t++) {
+        lfds[t] = rl_dup(lfd);
+        if (lfds[t].fd < 0 || lfds[t].file == NULL)
+            PANIC_EXIT("rl_dup()");
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        if (pthread_create(&threads[t], NULL, increment, &lfds[t]) != 0)
+            PANIC_EXIT("pthread_create()");
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        if (pthread_join(threads[t], NULL) != 0)
+            PANIC_EXIT("pthread_join()");
+        if (rl_close(lfds[t]) < 0)
+            PANIC_EXIT("rl_close()");
+    }
+    printf("Counter: %ld\n", counter);
+    if (counter != NB_THREADS * NB_INCREMENTS)
+        PANIC_EXIT("counter");
+
+    if (rl_close(lfd2) < 0 || rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+    printf("The space was freed\n");
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * Creates a file with reader bias. The parent process read-locks the segment
+ * [0; 100[ then creates a child process which opens the file again and
+ * read-locks [50; 150[: both locks are biased. The child then write-locks
+ * [200; 300[, which revokes the bias and moves the read locks into the lock
+ * table, and fails to write-lock [0; 10[. Once the child has closed its
+ * descriptor, the parent converts [0; 10[ into a write lock.
+ */
+
+#define FILENAME "/tmp/test-reader-bias.txt"
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_file_attr attr = {.flags = RL_ATTR_READER_BIAS};
+    rl_descriptor lfd = rl_open_attr(FILENAME, O_CREAT | O_RDWR | O_TRUNC,
+            &attr, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open_attr()");
+
+    if (lock(lfd, F_RDLCK, 0, 100) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Read-locked [0; 100[\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        if (lock(lfd2, F_RDLCK, 50, 100) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Read-locked [50; 150[\n");
+        if (rl_print_open_file(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file()");
+        printf("\n");
+
+        if (lock(lfd2, F_WRLCK, 200, 100) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Write-locked [200; 300[, revoking the bias\n");
+
+        if (lock(lfd2, F_WRLCK, 0, 10) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Attempt to write-lock [0; 10[ failed\n");
+        if (rl_print_open_file(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file()");
+        printf("\n");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (lock(lfd, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Converted [0; 10[ into a write lock\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process write-locks the segment [0; 10[ of a file, then creates
+ * a child process which opens the file again and waits with F_SETLKW for a
+ * write lock on [5; 15[. One second later, the parent writes a mark at the
+ * offset 100 of the file and unlocks [0; 10[. The child must then get its
+ * lock and see the mark, written before the release of the parent.
+ */
+
+#define FILENAME "/tmp/test-setlkw.txt"
+
+static int lock(rl_descriptor lfd, int cmd, short type, off_t start,
+        off_t len) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    return rl_fcntl(lfd, cmd, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open(FILENAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    if (lock(lfd, F_SETLK, F_WRLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [0; 10[\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        if (lock(lfd2, F_SETLK, F_WRLCK, 5, 10) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Waiting for a write lock on [5; 15[\n");
+        fflush(stdout);
+
+        if (lock(lfd2, F_SETLKW, F_WRLCK, 5, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+
+        char mark = 0;
+        if (lseek(lfd2.fd, 100, SEEK_SET) < 0)
+            PANIC_EXIT("lseek()");
+        if (read(lfd2.fd, &mark, 1) != 1 || mark != 'u')
+            PANIC_EXIT("read()");
+        printf("CHILD: Write-locked [5; 15[ after the parent released it\n");
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    sleep(1);
+    if (lseek(lfd.fd, 100, SEEK_SET) < 0)
+        PANIC_EXIT("lseek()");
+    if (write(lfd.fd, "u", 1) != 1)
+        PANIC_EXIT("write()");
+    printf("PARENT: Unlocking [0; 10[\n");
+    fflush(stdout);
+    if (lock(lfd, F_SETLK, F_UNLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
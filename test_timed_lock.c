@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process write-locks the segment [0; 10[ of a file, then creates
+ * a child process which opens the file again. The child tries to read-lock
+ * [0; 5[ with a deadline 200 ms away: the attempt must fail with ETIMEDOUT no
+ * sooner than the deadline. Then the child asks the parent to unlock its
+ * segment and read-locks [0; 5[ again with a deadline 5 s away, which must
+ * succeed.
+ */
+
+#define FILENAME "/tmp/test-timed-lock.txt"
+
+static long long now_ns() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        PANIC_EXIT("clock_gettime()");
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int lock_before(rl_descriptor lfd, short type, off_t start, off_t len,
+        long long deadline) {
+    struct flock lck;
+    lck.l_type = type;
+    lck.l_whence = SEEK_SET;
+    lck.l_start = start;
+    lck.l_len = len;
+    struct timespec ts = {.tv_sec = deadline / 1000000000LL,
+                          .tv_nsec = deadline % 1000000000LL};
+    return rl_fcntl_timed(lfd, &lck, &ts);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open(FILENAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    struct flock lck = {.l_type = F_WRLCK, .l_whence = SEEK_SET, .l_start = 0,
+                        .l_len = 10};
+    if (rl_fcntl(lfd, F_SETLK, &lck) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Write-locked [0; 10[\n");
+    fflush(stdout);
+
+    int to_parent[2];
+    if (pipe(to_parent) < 0)
+        PANIC_EXIT("pipe()");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        long long deadline = now_ns() + 200000000LL;
+        if (lock_before(lfd2, F_RDLCK, 0, 5, deadline) == 0
+                || errno != ETIMEDOUT)
+            PANIC_EXIT("rl_fcntl_timed()");
+        if (now_ns() < deadline)
+            PANIC_EXIT("rl_fcntl_timed() returned before the deadline");
+        printf("CHILD: Attempt to read-lock [0; 5[ timed out\n");
+        fflush(stdout);
+
+        char c = 0;
+        if (write(to_parent[1], &c, 1) != 1)
+            PANIC_EXIT("write()");
+
+        if (lock_before(lfd2, F_RDLCK, 0, 5, now_ns() + 5000000000LL) < 0)
+            PANIC_EXIT("rl_fcntl_timed()");
+        printf("CHILD: Read-locked [0; 5[ before the deadline\n");
+        if (rl_print_open_file_safe(lfd2.file, 0) < 0)
+            PANIC_EXIT("rl_print_open_file_safe()");
+
+        if (rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    char c = 0;
+    if (read(to_parent[0], &c, 1) != 1)
+        PANIC_EXIT("read()");
+
+    printf("PARENT: Unlocking [0; 10[\n");
+    fflush(stdout);
+    lck.l_type = F_UNLCK;
+    if (rl_fcntl(lfd, F_SETLK, &lck) < 0)
+        PANIC_EXIT("rl_fcntl()");
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "panic.h"
+#include "rl_lock_library.h"
+
+/*
+ * The parent process puts an update lock on [0; 10[ of a file, then creates a
+ * child process which opens the file again: its update and write requests on
+ * [5; 15[ are refused, its read request is granted. The parent then upgrades
+ * its lock with rl_upgrade(), which waits for the child. Meanwhile, a new read
+ * request of the child on [5; 6[ is refused, since the upgrade has priority.
+ * Once the child unlocks its read lock, the parent holds a write lock on
+ * [0; 10[, which it downgrades back to an update lock, then to a read lock.
+ */
+
+#define FILENAME "/tmp/test-update-lock.txt"
+
+static void set(struct flock *lck, short type, off_t start, off_t len) {
+    lck->l_type = type;
+    lck->l_whence = SEEK_SET;
+    lck->l_start = start;
+    lck->l_len = len;
+}
+
+static int lock(rl_descriptor lfd, short type, off_t start, off_t len) {
+    struct flock lck;
+    set(&lck, type, start, len);
+    return rl_fcntl(lfd, F_SETLK, &lck);
+}
+
+int main() {
+    rl_init_library();
+
+    rl_descriptor lfd = rl_open(FILENAME, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (lfd.fd < 0 || lfd.file == NULL)
+        PANIC_EXIT("rl_open()");
+
+    if (lock(lfd, RL_UPDLCK, 0, 10) < 0)
+        PANIC_EXIT("rl_fcntl()");
+    printf("PARENT: Update-locked [0; 10[\n");
+    fflush(stdout);
+
+    int to_parent[2];
+    if (pipe(to_parent) < 0)
+        PANIC_EXIT("pipe()");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        PANIC_EXIT("fork()");
+
+    if (pid == 0) {
+        rl_descriptor lfd2 = rl_open(FILENAME, O_RDWR);
+        if (lfd2.fd < 0 || lfd2.file == NULL)
+            PANIC_EXIT("rl_open()");
+
+        if (lock(lfd2, RL_UPDLCK, 5, 10) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd2, F_WRLCK, 5, 10) == 0 || errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        if (lock(lfd2, F_RDLCK, 5, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Update and write refused, read-locked [5; 15[\n");
+        fflush(stdout);
+
+        char c = 0;
+        if (write(to_parent[1], &c, 1) != 1)
+            PANIC_EXIT("write()");
+
+        rl_descriptor lfd3 = rl_open(FILENAME, O_RDWR);
+        if (lfd3.fd < 0 || lfd3.file == NULL)
+            PANIC_EXIT("rl_open()");
+        int code;
+        while ((code = lock(lfd3, F_RDLCK, 5, 1)) == 0) {
+            if (lock(lfd3, F_UNLCK, 5, 1) < 0)
+                PANIC_EXIT("rl_fcntl()");
+            sched_yield();
+        }
+        if (errno != EAGAIN)
+            PANIC_EXIT("rl_fcntl()");
+        printf("CHILD: Read request refused during the upgrade\n");
+        fflush(stdout);
+
+        if (lock(lfd2, F_UNLCK, 5, 10) < 0)
+            PANIC_EXIT("rl_fcntl()");
+        if (rl_close(lfd3) < 0 || rl_close(lfd2) < 0)
+            PANIC_EXIT("rl_close()");
+        return 0;
+    }
+
+    char c = 0;
+    if (read(to_parent[0], &c, 1) != 1)
+        PANIC_EXIT("read()");
+
+    struct flock lck;
+    set(&lck, F_WRLCK, 0, 10);
+    if (rl_upgrade(lfd, &lck) < 0)
+        PANIC_EXIT("rl_upgrade()");
+    printf("PARENT: Upgraded [0; 10[ to a write lock\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (wait(NULL) < 0)
+        PANIC_EXIT("wait()");
+
+    set(&lck, RL_UPDLCK, 0, 10);
+    if (rl_downgrade(lfd, &lck) < 0)
+        PANIC_EXIT("rl_downgrade()");
+    set(&lck, F_RDLCK, 0, 10);
+    if (rl_downgrade(lfd, &lck) < 0)
+        PANIC_EXIT("rl_downgrade()");
+    if (rl_downgrade(lfd, &lck) == 0 || errno != EINVAL)
+        PANIC_EXIT("rl_downgrade()");
+    printf("PARENT: Downgraded [0; 10[ to an update lock, then a read lock\n");
+    if (rl_print_open_file_safe(lfd.file, 0) < 0)
+        PANIC_EXIT("rl_print_open_file_safe()");
+
+    if (rl_close(lfd) < 0)
+        PANIC_EXIT("rl_close()");
+
+    if (unlink(FILENAME) < 0)
+        PANIC_EXIT("unlink()");
+
+    return 0;
+}